@@ -19,6 +19,22 @@ check_tool()
 	export X${varname}=${prefix}/bin/${tool}
 }
 
+#
+# Find the major version of ${XCC} (e.g., "13"), asking the compiler only
+# if we haven't been told by whatever ran us: wrappers like lpcc run once
+# per compilation, so they shouldn't each start another compiler to ask.
+#
+check_clang_major()
+{
+	if [ "${XCC_MAJOR}" = "" ] || [ "${XCC_MAJOR_OF}" != "${XCC}" ]
+	then
+		XCC_MAJOR=`echo __clang_major__ | ${XCC} -E -P - | tr -d '[:space:]'`
+		XCC_MAJOR_OF=${XCC}
+	fi
+
+	export XCC_MAJOR XCC_MAJOR_OF
+}
+
 check_llvm_prefix()
 {
 	if [ "${LLVM_PREFIX}" = "" ]
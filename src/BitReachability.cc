@@ -0,0 +1,138 @@
+//! @file BitReachability.cc  Definition of @ref llvm::prov::BitReachability.
+/*
+ * Copyright (c) 2017 Jonathan Anderson
+ * All rights reserved.
+ *
+ * This software was developed by BAE Systems, the University of Cambridge
+ * Computer Laboratory, and Memorial University under DARPA/AFRL contract
+ * FA8650-15-C-7558 ("CADETS"), as part of the DARPA Transparent Computing
+ * (TC) research program.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "BitReachability.hh"
+
+#include <llvm/ADT/Statistic.h>
+#include <llvm/Support/MathExtras.h>
+
+#include <algorithm>
+
+using namespace llvm;
+using namespace llvm::prov;
+
+#define DEBUG_TYPE "prov-reachability"
+
+STATISTIC(NumBatches, "Number of bit-parallel reachability batches");
+STATISTIC(NumSweeps, "Number of bit-parallel propagation sweeps");
+
+using NodeID = FlowGraph::NodeID;
+
+const size_t BitReachability::MaxBatch;
+
+
+BitReachability::BitReachability(const FlowGraph &G, const BitVector &Sinks)
+  : G(G), Sinks(Sinks)
+{
+  assert(Sinks.size() == G.NumNodes());
+}
+
+std::vector<std::vector<NodeID>>
+BitReachability::SinksFrom(ArrayRef<NodeID> Sources) const
+{
+  std::vector<std::vector<NodeID>> Result(Sources.size());
+  MutableArrayRef<std::vector<NodeID>> Out(Result);
+
+  if (Sources.size() <= 64) {
+    Propagate<1>(Sources, Out);
+    return Result;
+  }
+
+  for (size_t i = 0; i < Sources.size(); i += MaxBatch) {
+    size_t Len = std::min(MaxBatch, Sources.size() - i);
+    Propagate<MaxBatch / 64>(Sources.slice(i, Len), Out.slice(i, Len));
+  }
+
+  return Result;
+}
+
+template<unsigned Words>
+void BitReachability::Propagate(ArrayRef<NodeID> Batch,
+                                MutableArrayRef<std::vector<NodeID>> Result)
+  const
+{
+  assert(Batch.size() <= Words * 64);
+  assert(Batch.size() == Result.size());
+
+  const size_t Nodes = G.NumNodes();
+  std::vector<uint64_t> Masks(Nodes * Words, 0);
+  BitVector Dirty(Nodes);
+
+  for (size_t i = 0; i < Batch.size(); i++) {
+    Masks[Batch[i] * Words + i / 64] |= uint64_t(1) << (i % 64);
+    Dirty.set(Batch[i]);
+  }
+
+  // Sweep in node order, pushing each dirty node's bits to its successors.
+  // Successors later in the order are handled in the same sweep; only flows
+  // that go backwards (e.g., around loops) require another one.
+  while (Dirty.any()) {
+    ++NumSweeps;
+
+    for (int N = Dirty.find_first(); N != -1; N = Dirty.find_next(N)) {
+      Dirty.reset(N);
+      const uint64_t *From = &Masks[N * Words];
+
+      for (FlowGraph::Edge E : G.Successors(N)) {
+        uint64_t *To = &Masks[E.Node() * Words];
+        uint64_t New = 0;
+
+        for (unsigned w = 0; w < Words; w++) {
+          New |= From[w] & ~To[w];
+          To[w] |= From[w];
+        }
+
+        if (New) {
+          Dirty.set(E.Node());
+        }
+      }
+    }
+  }
+
+  // Read the source x sink relation off the sink nodes' bitsets.
+  for (int Sink = Sinks.find_first(); Sink != -1;
+       Sink = Sinks.find_next(Sink)) {
+    const uint64_t *Mask = &Masks[Sink * Words];
+
+    for (unsigned w = 0; w < Words; w++) {
+      for (uint64_t Bits = Mask[w]; Bits != 0; Bits &= Bits - 1) {
+        size_t i = w * 64 + countTrailingZeros(Bits);
+
+        if (Batch[i] != static_cast<NodeID>(Sink)) {
+          Result[i].push_back(Sink);
+        }
+      }
+    }
+  }
+
+  ++NumBatches;
+}
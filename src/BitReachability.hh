@@ -0,0 +1,94 @@
+//! @file BitReachability.hh  Declaration of @ref llvm::prov::BitReachability.
+/*
+ * Copyright (c) 2017 Jonathan Anderson
+ * All rights reserved.
+ *
+ * This software was developed by BAE Systems, the University of Cambridge
+ * Computer Laboratory, and Memorial University under DARPA/AFRL contract
+ * FA8650-15-C-7558 ("CADETS"), as part of the DARPA Transparent Computing
+ * (TC) research program.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef LLVM_PROV_BIT_REACHABILITY_H
+#define LLVM_PROV_BIT_REACHABILITY_H
+
+#include "FlowGraph.hh"
+
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/BitVector.h>
+
+#include <vector>
+
+
+namespace llvm {
+namespace prov {
+
+/**
+ * Bit-parallel, multi-source reachability over a @ref FlowGraph.
+ *
+ * Rather than searching from each source in turn, this engine gives every
+ * node a bitset with one bit per source and propagates those bits along
+ * flows until nothing changes. Propagation is an iterative sweep in node
+ * (i.e., roughly program) order, so long def-use chains cost no stack and
+ * most flows are handled in the first sweep.
+ *
+ * Up to 64 sources fit in a single machine word per node; larger batches use
+ * 256-bit node sets whose word-wise operations the compiler can vectorize.
+ */
+class BitReachability {
+public:
+  //! The largest number of sources propagated together in one batch.
+  static const size_t MaxBatch = 256;
+
+  /**
+   * Constructor.
+   *
+   * @param   Sinks     one bit per node in @b G: which nodes are sinks
+   */
+  BitReachability(const FlowGraph &G, const BitVector &Sinks);
+
+  /**
+   * Find the sinks reachable from each of a set of sources.
+   *
+   * As with @ref FlowFinder::FindEventual, a source is never reported as
+   * its own sink.
+   *
+   * @returns   for each source, the reachable sink nodes in ascending order
+   */
+  std::vector<std::vector<FlowGraph::NodeID>>
+  SinksFrom(ArrayRef<FlowGraph::NodeID> Sources) const;
+
+private:
+  template<unsigned Words>
+  void Propagate(ArrayRef<FlowGraph::NodeID> Batch,
+                 MutableArrayRef<std::vector<FlowGraph::NodeID>> Result) const;
+
+  const FlowGraph &G;
+  const BitVector &Sinks;
+};
+
+} // namespace prov
+} // namespace llvm
+
+#endif // LLVM_PROV_BIT_REACHABILITY_H
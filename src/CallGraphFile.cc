@@ -0,0 +1,477 @@
+//! @file CallGraphFile.cc  Definition of @ref llvm::prov::CallGraphFile.
+/*
+ * Copyright (c) 2017 Jonathan Anderson
+ * All rights reserved.
+ *
+ * This software was developed by BAE Systems, the University of Cambridge
+ * Computer Laboratory, and Memorial University under DARPA/AFRL contract
+ * FA8650-15-C-7558 ("CADETS"), as part of the DARPA Transparent Computing
+ * (TC) research program.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "CallGraphFile.hh"
+
+#include <llvm/Support/MathExtras.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <algorithm>
+#include <cstring>
+
+using namespace llvm;
+using namespace llvm::prov;
+using std::string;
+
+
+namespace {
+  //! The header of a call graph file.
+  struct GraphHeader {
+    uint32_t Magic;
+    uint32_t Version;
+    uint32_t NumSymbols;
+    uint32_t NumCalls;
+    uint32_t NumTargets;
+    uint32_t ModuleOffset;    //!< in the string table
+    uint32_t ModuleLength;
+    uint32_t StringsOffset;   //!< from the start of the file
+    uint32_t StringsSize;
+  };
+
+  struct GraphSymbol {
+    uint32_t NameOffset;
+    uint32_t NameLength;
+    uint32_t Flags;
+  };
+
+  //! "PCGR" in native byte order: graphs are written for the host.
+  const uint32_t GraphMagic = 0x52474350;
+  const uint32_t GraphVersion = 1;
+
+  //! The number of 32-bit words in each symbol's reachability bitmap.
+  uint64_t WordsPerRow(uint64_t NumTargets) { return (NumTargets + 31) / 32; }
+
+  /**
+   * The layout of a graph file: the header, then symbols, call offsets (one
+   * per symbol plus one), callees, targets, reachability bitmaps (one row
+   * per symbol) and finally strings.
+   */
+  struct Layout {
+    const GraphHeader *Header;
+    const GraphSymbol *Symbols;
+    const uint32_t *CallOffsets;
+    const uint32_t *Callees;
+    const uint32_t *Targets;
+    const uint32_t *Reach;
+    const char *Strings;
+
+    Layout(StringRef Data)
+      : Header(reinterpret_cast<const GraphHeader*>(Data.data())),
+        Symbols(reinterpret_cast<const GraphSymbol*>(Header + 1)),
+        CallOffsets(reinterpret_cast<const uint32_t*>(
+          Symbols + Header->NumSymbols)),
+        Callees(CallOffsets + Header->NumSymbols + 1),
+        Targets(Callees + Header->NumCalls),
+        Reach(Targets + Header->NumTargets),
+        Strings(Data.data() + Header->StringsOffset)
+    {
+    }
+
+    //! The size of everything before the string table.
+    static uint64_t StringsOffset(const GraphHeader &H) {
+      return sizeof(GraphHeader)
+        + uint64_t(H.NumSymbols) * sizeof(GraphSymbol)
+        + (uint64_t(H.NumSymbols) + 1) * sizeof(uint32_t)
+        + uint64_t(H.NumCalls) * sizeof(uint32_t)
+        + uint64_t(H.NumTargets) * sizeof(uint32_t)
+        + uint64_t(H.NumSymbols) * WordsPerRow(H.NumTargets)
+          * sizeof(uint32_t)
+        ;
+    }
+  };
+}
+
+/**
+ * Compute which targets each symbol can reach.
+ *
+ * Strongly-connected components of the call graph are found with an
+ * (iterative) Tarjan search, which completes every component after all of
+ * the components that it calls into. Each component's bitmap is then the
+ * union of its members' direct calls to targets and the bitmaps of the
+ * components that they call, so every call is visited once.
+ *
+ * @returns one row of @ref WordsPerRow words per symbol
+ */
+static std::vector<uint32_t> IndexReachability(ArrayRef<uint32_t> Offsets,
+                                               ArrayRef<uint32_t> Callees,
+                                               ArrayRef<uint32_t> Targets)
+{
+  typedef CallGraphFile::SymbolID SymbolID;
+
+  const size_t NumSymbols = Offsets.size() - 1;
+  const size_t Words = WordsPerRow(Targets.size());
+
+  const uint32_t None = UINT32_MAX;
+  std::vector<uint32_t> TargetIndex(NumSymbols, None);
+  for (size_t i = 0; i < Targets.size(); i++) {
+    TargetIndex[Targets[i]] = i;
+  }
+
+  std::vector<uint32_t> Order(NumSymbols, None), Low(NumSymbols);
+  std::vector<uint32_t> ComponentOf(NumSymbols, None);
+  std::vector<uint32_t> ComponentRows;
+  std::vector<SymbolID> Stack;
+  std::vector<std::pair<SymbolID, uint32_t>> Search;
+  uint32_t NextOrder = 0;
+
+  for (SymbolID Root = 0; Root < NumSymbols; Root++) {
+    if (Order[Root] != None) {
+      continue;
+    }
+
+    Search.emplace_back(Root, Offsets[Root]);
+    Order[Root] = Low[Root] = NextOrder++;
+    Stack.push_back(Root);
+
+    while (not Search.empty()) {
+      SymbolID S = Search.back().first;
+      uint32_t &Next = Search.back().second;
+
+      if (Next < Offsets[S + 1]) {
+        SymbolID Callee = Callees[Next++];
+
+        if (Order[Callee] == None) {
+          Search.emplace_back(Callee, Offsets[Callee]);
+          Order[Callee] = Low[Callee] = NextOrder++;
+          Stack.push_back(Callee);
+        } else if (ComponentOf[Callee] == None) {
+          Low[S] = std::min(Low[S], Order[Callee]);
+        }
+
+        continue;
+      }
+
+      Search.pop_back();
+      if (not Search.empty()) {
+        SymbolID Caller = Search.back().first;
+        Low[Caller] = std::min(Low[Caller], Low[S]);
+      }
+
+      if (Low[S] != Order[S]) {
+        continue;
+      }
+
+      // S is the root of a component: pop its members and compute their
+      // (shared) row from their calls.
+      const uint32_t Component = ComponentRows.size() / Words;
+      auto First = std::find(Stack.rbegin(), Stack.rend(), S).base() - 1;
+
+      for (auto i = First; i != Stack.end(); i++) {
+        ComponentOf[*i] = Component;
+      }
+
+      std::vector<uint32_t> Row(Words);
+      for (auto i = First; i != Stack.end(); i++) {
+        for (uint32_t j = Offsets[*i]; j < Offsets[*i + 1]; j++) {
+          SymbolID Callee = Callees[j];
+
+          if (TargetIndex[Callee] != None) {
+            Row[TargetIndex[Callee] / 32] |= 1u << (TargetIndex[Callee] % 32);
+          }
+
+          uint32_t C = ComponentOf[Callee];
+          if (C != Component) {
+            for (size_t w = 0; w < Words; w++) {
+              Row[w] |= ComponentRows[C * Words + w];
+            }
+          }
+        }
+      }
+
+      ComponentRows.insert(ComponentRows.end(), Row.begin(), Row.end());
+      Stack.erase(First, Stack.end());
+    }
+  }
+
+  std::vector<uint32_t> Rows(NumSymbols * Words);
+  for (SymbolID S = 0; S < NumSymbols; S++) {
+    std::copy_n(ComponentRows.begin() + ComponentOf[S] * Words, Words,
+                Rows.begin() + S * Words);
+  }
+
+  return Rows;
+}
+
+
+const CallGraphFile::SymbolID CallGraphFile::NoSymbol;
+
+CallGraphFile::SymbolID CallGraphFile::Builder::AddSymbol(StringRef Name,
+                                                          uint8_t Flags)
+{
+  Symbol S;
+  S.Name = Strings.size();
+  S.NameLength = Name.size();
+  S.Flags = Flags;
+
+  Strings += Name;
+  Symbols.push_back(S);
+
+  return Symbols.size() - 1;
+}
+
+void CallGraphFile::Builder::AddCall(SymbolID Caller, SymbolID Callee)
+{
+  assert(Caller < Symbols.size() and Callee < Symbols.size());
+  Calls.emplace_back(Caller, Callee);
+}
+
+void CallGraphFile::Builder::AddCalls(SymbolID Caller,
+                                      ArrayRef<SymbolID> Callees)
+{
+  for (SymbolID Callee : Callees) {
+    AddCall(Caller, Callee);
+  }
+}
+
+void CallGraphFile::Builder::SetTargets(ArrayRef<SymbolID> T)
+{
+  Targets.assign(T.begin(), T.end());
+}
+
+void CallGraphFile::Builder::Write(raw_ostream &Out) const
+{
+  // Pack calls into rows by caller, discarding duplicates.
+  auto Sorted = Calls;
+  std::sort(Sorted.begin(), Sorted.end());
+  Sorted.erase(std::unique(Sorted.begin(), Sorted.end()), Sorted.end());
+
+  std::vector<uint32_t> Offsets(Symbols.size() + 1);
+  std::vector<uint32_t> Callees;
+  Callees.reserve(Sorted.size());
+
+  for (auto &C : Sorted) {
+    Offsets[C.first + 1]++;
+    Callees.push_back(C.second);
+  }
+
+  for (size_t i = 1; i < Offsets.size(); i++) {
+    Offsets[i] += Offsets[i - 1];
+  }
+
+  std::vector<uint32_t> Reach;
+  if (not Targets.empty()) {
+    Reach = IndexReachability(Offsets, Callees, Targets);
+  }
+
+  string Strings = this->Strings;
+  const uint32_t ModuleOffset = Strings.size();
+  Strings += Module;
+
+  GraphHeader Header;
+  std::memset(&Header, 0, sizeof(Header));
+  Header.Magic = GraphMagic;
+  Header.Version = GraphVersion;
+  Header.NumSymbols = Symbols.size();
+  Header.NumCalls = Callees.size();
+  Header.NumTargets = Targets.size();
+  Header.ModuleOffset = ModuleOffset;
+  Header.ModuleLength = Module.size();
+  Header.StringsOffset = Layout::StringsOffset(Header);
+  Header.StringsSize = Strings.size();
+
+  auto Emit = [&Out](const void *Data, size_t Size) {
+    Out.write(static_cast<const char*>(Data), Size);
+  };
+
+  Emit(&Header, sizeof(Header));
+
+  for (const Symbol &S : Symbols) {
+    GraphSymbol GS = { S.Name, S.NameLength, S.Flags };
+    Emit(&GS, sizeof(GS));
+  }
+
+  Emit(Offsets.data(), Offsets.size() * sizeof(uint32_t));
+  Emit(Callees.data(), Callees.size() * sizeof(uint32_t));
+  Emit(Targets.data(), Targets.size() * sizeof(uint32_t));
+  Emit(Reach.data(), Reach.size() * sizeof(uint32_t));
+  Out << Strings;
+}
+
+
+std::unique_ptr<CallGraphFile> CallGraphFile::Open(StringRef Data,
+                                                   string &Err)
+{
+  if (Data.size() < sizeof(GraphHeader)) {
+    Err = "call graph is truncated";
+    return nullptr;
+  }
+
+  if (reinterpret_cast<uintptr_t>(Data.data()) % alignof(GraphHeader)) {
+    Err = "call graph is misaligned";
+    return nullptr;
+  }
+
+  const GraphHeader &H = *reinterpret_cast<const GraphHeader*>(Data.data());
+
+  if (H.Magic != GraphMagic) {
+    Err = (H.Magic == ByteSwap_32(GraphMagic))
+      ? "call graph was written on a host with a different byte order"
+      : "not a call graph";
+    return nullptr;
+  }
+
+  if (H.Version != GraphVersion) {
+    Err = "unsupported call graph version " + std::to_string(H.Version);
+    return nullptr;
+  }
+
+  const uint64_t StringsOffset = Layout::StringsOffset(H);
+
+  if (H.NumSymbols == NoSymbol or H.StringsOffset != StringsOffset
+      or StringsOffset + H.StringsSize > Data.size()) {
+    Err = "call graph is truncated or corrupt";
+    return nullptr;
+  }
+
+  // Check all offsets and symbol IDs, so that queries needn't.
+  Layout L(Data);
+  auto InStrings = [&H](uint32_t Offset, uint32_t Length) {
+    return uint64_t(Offset) + Length <= H.StringsSize;
+  };
+  auto IsSymbol = [&H](uint32_t S) { return S < H.NumSymbols; };
+
+  bool Valid = InStrings(H.ModuleOffset, H.ModuleLength)
+    and L.CallOffsets[0] == 0 and L.CallOffsets[H.NumSymbols] == H.NumCalls;
+
+  for (uint32_t i = 0; Valid and i < H.NumSymbols; i++) {
+    Valid = InStrings(L.Symbols[i].NameOffset, L.Symbols[i].NameLength)
+      and L.CallOffsets[i] <= L.CallOffsets[i + 1];
+  }
+
+  Valid = Valid
+    and std::all_of(L.Callees, L.Callees + H.NumCalls, IsSymbol)
+    and std::all_of(L.Targets, L.Targets + H.NumTargets, IsSymbol);
+
+  if (not Valid) {
+    Err = "call graph is corrupt";
+    return nullptr;
+  }
+
+  return std::unique_ptr<CallGraphFile>(new CallGraphFile(Data));
+}
+
+std::unique_ptr<CallGraphFile> CallGraphFile::Load(StringRef Path,
+                                                   string &Err)
+{
+  auto Buffer = MemoryBuffer::getFile(Path, -1, false);
+  if (std::error_code EC = Buffer.getError()) {
+    Err = EC.message();
+    return nullptr;
+  }
+
+  std::unique_ptr<CallGraphFile> Graph = Open((*Buffer)->getBuffer(), Err);
+  if (Graph) {
+    Graph->Buffer = std::move(*Buffer);
+  }
+
+  return Graph;
+}
+
+CallGraphFile::CallGraphFile(StringRef Data,
+                             std::unique_ptr<MemoryBuffer> Buffer)
+  : Data(Data), Buffer(std::move(Buffer))
+{
+}
+
+CallGraphFile::~CallGraphFile()
+{
+}
+
+StringRef CallGraphFile::Module() const
+{
+  Layout L(Data);
+  return StringRef(L.Strings + L.Header->ModuleOffset,
+                   L.Header->ModuleLength);
+}
+
+size_t CallGraphFile::NumSymbols() const
+{
+  return Layout(Data).Header->NumSymbols;
+}
+
+size_t CallGraphFile::NumCalls() const
+{
+  return Layout(Data).Header->NumCalls;
+}
+
+StringRef CallGraphFile::Name(SymbolID S) const
+{
+  Layout L(Data);
+  assert(S < L.Header->NumSymbols);
+
+  return StringRef(L.Strings + L.Symbols[S].NameOffset,
+                   L.Symbols[S].NameLength);
+}
+
+uint8_t CallGraphFile::Flags(SymbolID S) const
+{
+  Layout L(Data);
+  assert(S < L.Header->NumSymbols);
+
+  return L.Symbols[S].Flags;
+}
+
+ArrayRef<CallGraphFile::SymbolID> CallGraphFile::Callees(SymbolID S) const
+{
+  Layout L(Data);
+  assert(S < L.Header->NumSymbols);
+
+  return makeArrayRef(L.Callees + L.CallOffsets[S],
+                      L.Callees + L.CallOffsets[S + 1]);
+}
+
+CallGraphFile::SymbolID CallGraphFile::Find(StringRef Name) const
+{
+  for (SymbolID S = 0; S < NumSymbols(); S++) {
+    if (this->Name(S) == Name) {
+      return S;
+    }
+  }
+
+  return NoSymbol;
+}
+
+ArrayRef<CallGraphFile::SymbolID> CallGraphFile::Targets() const
+{
+  Layout L(Data);
+  return makeArrayRef(L.Targets, L.Header->NumTargets);
+}
+
+bool CallGraphFile::CanReach(SymbolID S, size_t i) const
+{
+  Layout L(Data);
+  assert(S < L.Header->NumSymbols and i < L.Header->NumTargets);
+
+  const uint32_t *Row = L.Reach + S * WordsPerRow(L.Header->NumTargets);
+  return Row[i / 32] & (1u << (i % 32));
+}
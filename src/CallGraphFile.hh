@@ -0,0 +1,166 @@
+//! @file CallGraphFile.hh  Declaration of @ref llvm::prov::CallGraphFile.
+/*
+ * Copyright (c) 2017 Jonathan Anderson
+ * All rights reserved.
+ *
+ * This software was developed by BAE Systems, the University of Cambridge
+ * Computer Laboratory, and Memorial University under DARPA/AFRL contract
+ * FA8650-15-C-7558 ("CADETS"), as part of the DARPA Transparent Computing
+ * (TC) research program.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef LLVM_PROV_CALL_GRAPH_FILE_H
+#define LLVM_PROV_CALL_GRAPH_FILE_H
+
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/StringRef.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+namespace llvm {
+
+class MemoryBuffer;
+class raw_ostream;
+
+namespace prov {
+
+/**
+ * A call graph in a binary format that can be used in place.
+ *
+ * A call graph file describes one module (as written by `-callgraph
+ * -cg-format=binary`) or many modules merged together (by `prov-callgraph`).
+ * Every function is a symbol with a dense ID and the calls out of each
+ * symbol are stored in compressed sparse row form.
+ *
+ * A graph can also carry a reachability index: a set of target symbols
+ * (e.g., system calls) and, for every symbol, a bit per target that says
+ * whether the symbol can (transitively) call it.
+ */
+class CallGraphFile {
+public:
+  //! Dense identifier for a function in the graph.
+  using SymbolID = uint32_t;
+
+  //! Properties of a symbol.
+  enum SymbolFlags : uint8_t {
+    //! The function has a body in (one of) the graph's module(s).
+    Defined = 1,
+
+    //! The function has local linkage (e.g., a static C function).
+    Local = 2,
+  };
+
+  //! A symbol ID that is not in the graph.
+  static const SymbolID NoSymbol = UINT32_MAX;
+
+  //! Accumulates symbols and calls and then writes them out.
+  class Builder {
+  public:
+    Builder(StringRef Module) : Module(Module) {}
+
+    //! Add a symbol (symbols are numbered in the order they are added).
+    SymbolID AddSymbol(StringRef Name, uint8_t Flags);
+
+    //! Add a call between symbols that have already been added.
+    void AddCall(SymbolID Caller, SymbolID Callee);
+
+    //! Add calls from one symbol to several others.
+    void AddCalls(SymbolID Caller, ArrayRef<SymbolID> Callees);
+
+    /**
+     * Index reachability to a set of target symbols when writing: for each
+     * symbol, record which of the targets it can reach through calls.
+     */
+    void SetTargets(ArrayRef<SymbolID> Targets);
+
+    //! Write the graph (and reachability index, if any) in binary form.
+    void Write(raw_ostream&) const;
+
+  private:
+    struct Symbol {
+      uint32_t Name;
+      uint32_t NameLength;
+      uint8_t Flags;
+    };
+
+    std::string Module;
+    std::string Strings;
+    std::vector<Symbol> Symbols;
+    std::vector<std::pair<SymbolID, SymbolID>> Calls;
+    std::vector<SymbolID> Targets;
+  };
+
+  /**
+   * Use a graph in place.
+   *
+   * The data must be 4-byte aligned and must outlive the graph. Every offset
+   * and symbol ID in the graph is checked here, so queries needn't be.
+   *
+   * @returns the graph, or null (with a description in @b Err) if invalid
+   */
+  static std::unique_ptr<CallGraphFile> Open(StringRef Data, std::string &Err);
+
+  //! Map a graph file into memory and use it in place.
+  static std::unique_ptr<CallGraphFile> Load(StringRef Path,
+                                             std::string &Err);
+
+  ~CallGraphFile();
+
+  //! The module (or, for merged graphs, modules) that this graph describes.
+  StringRef Module() const;
+
+  size_t NumSymbols() const;
+  size_t NumCalls() const;
+
+  StringRef Name(SymbolID) const;
+  uint8_t Flags(SymbolID) const;
+
+  //! The functions that a symbol calls, in ID order.
+  ArrayRef<SymbolID> Callees(SymbolID) const;
+
+  //! Find a symbol by name (a linear search), or @ref NoSymbol.
+  SymbolID Find(StringRef Name) const;
+
+  //! The indexed targets (empty if the graph has no reachability index).
+  ArrayRef<SymbolID> Targets() const;
+
+  //! Can a symbol reach the @b i'th indexed target through calls?
+  bool CanReach(SymbolID, size_t i) const;
+
+private:
+  CallGraphFile(StringRef Data, std::unique_ptr<MemoryBuffer> = nullptr);
+
+  StringRef Data;
+  std::unique_ptr<MemoryBuffer> Buffer;
+};
+
+} // namespace prov
+} // namespace llvm
+
+#endif // LLVM_PROV_CALL_GRAPH_FILE_H
@@ -30,17 +30,23 @@
  * SUCH DAMAGE.
  */
 
-#include <llvm/IR/Instructions.h>
-#include <llvm/IR/InstIterator.h>
+#include "CallGraphFile.hh"
+#include "DirectCalls.hh"
+#include "JSON.hh"
+#include "Passes.hh"
+
+#include <llvm/ADT/DenseMap.h>
 #include <llvm/IR/Module.h>
+#include <llvm/Support/CommandLine.h>
 #include <llvm/Support/Error.h>
 #include <llvm/Support/FileSystem.h>
 #include <llvm/Support/raw_ostream.h>
 #include <llvm/Pass.h>
 
-#include <unordered_set>
+#include <algorithm>
 
 using namespace llvm;
+using namespace llvm::prov;
 using std::string;
 
 
@@ -54,19 +60,44 @@ namespace llvm {
 }
 
 namespace {
-  struct FunctionData {
-    const string Name;
-    std::unordered_set<string> CallTargets;
+  /**
+   * A module's direct call graph.
+   *
+   * Every function that is defined or called in the module is interned as
+   * a dense symbol ID, so call edges are pairs of integers rather than
+   * copies of names.
+   */
+  struct CallGraph {
+    using SymbolID = CallGraphFile::SymbolID;
+
+    struct FunctionData {
+      SymbolID Symbol;
+      std::vector<SymbolID> CallTargets;    //!< sorted, unique
+    };
+
+    CallGraph(Module&);
+
+    //! The ID of a function, interning it if necessary.
+    SymbolID Intern(const Function&);
+
+    StringRef Name(SymbolID S) const { return Symbols[S]->getName(); }
+
+    StringRef ModuleName;
+    std::vector<const Function*> Symbols;
+    DenseMap<const Function*, SymbolID> IDs;
+
+    //! Functions that make direct calls.
+    std::vector<FunctionData> Functions;
   };
 
-  using FnVec = std::vector<const FunctionData>;
-
   struct FileFormat {
-    enum class Kind { Dot, JSON, YAML };
+    enum class Kind { Binary, Dot, JSON, YAML };
 
     virtual string Filename(StringRef Prefix) const = 0;
-    virtual void Write(raw_ostream&, const FnVec&)
-      const = 0;
+    virtual void Write(raw_ostream&, const CallGraph&) const = 0;
+
+    //! Does this format need a file opened in text mode?
+    virtual bool IsText() const { return true; }
 
     static std::unique_ptr<FileFormat> Create(Kind);
 
@@ -76,6 +107,8 @@ namespace {
   cl::opt<FileFormat::Kind> CGFormat("cg-format",
     cl::desc("callgraph output format"),
     cl::values(
+      clEnumValN(FileFormat::Kind::Binary, "binary",
+                 "binary call graph (for prov-callgraph)"),
       clEnumValN(FileFormat::Kind::Dot,  "dot",  "GraphViz dot"),
       clEnumValN(FileFormat::Kind::JSON, "json", "JavaScript Object Notation"),
       clEnumValN(FileFormat::Kind::YAML, "yaml", "Yet Another Markup Language")
@@ -83,51 +116,128 @@ namespace {
   );
 }
 
+static void WriteCallGraph(Module&);
+
 
 bool CallGraphPass::runOnModule(Module &M)
+{
+  WriteCallGraph(M);
+  return false;
+}
+
+PreservedAnalyses CallGraphPrinterPass::run(Module &M, ModuleAnalysisManager&)
+{
+  WriteCallGraph(M);
+  return PreservedAnalyses::all();
+}
+
+static void WriteCallGraph(Module &M)
 {
   auto Format = FileFormat::Create(CGFormat);
   assert(Format);
 
+  auto Flags = sys::fs::OpenFlags::F_RW;
+  if (Format->IsText()) {
+    Flags |= sys::fs::OpenFlags::F_Text;
+  }
+
   std::error_code Err;
-  raw_fd_ostream FlowGraph(Format->Filename((M.getName() + ".callgraph").str()),
-      Err, sys::fs::OpenFlags::F_RW | sys::fs::OpenFlags::F_Text);
+  raw_fd_ostream Out(Format->Filename((M.getName() + ".callgraph").str()),
+                     Err, Flags);
 
   if (Err) {
     errs() << "Error opening graph file: " << Err.message() << "\n";
-    return false;
+    return;
   }
 
-  std::vector<const FunctionData> Functions;
+  Format->Write(Out, CallGraph(M));
+}
 
-  for (auto &Fn : M) {
-    FunctionData FnData = { .Name = Fn.getName() };
 
-    for (auto& I : instructions(Fn)) {
-      if (CallInst* Call = dyn_cast<CallInst>(&I)) {
-        if (Function *DirectTarget = Call->getCalledFunction()) {
-          FnData.CallTargets.insert(DirectTarget->getName());
-        }
-      }
+CallGraph::CallGraph(Module &M)
+  : ModuleName(M.getName())
+{
+  for (Function &Fn : M) {
+    // Intern every defined function (even if it makes no calls), so that
+    // merged graphs know where functions are defined.
+    if (not Fn.isDeclaration()) {
+      Intern(Fn);
     }
 
-    if (not FnData.CallTargets.empty()) {
-      Functions.emplace_back(FnData);
+    std::vector<Function*> Callees = DirectCallees(Fn);
+    if (Callees.empty()) {
+      continue;
     }
+
+    FunctionData FnData;
+    FnData.Symbol = Intern(Fn);
+
+    for (Function *Target : Callees) {
+      FnData.CallTargets.push_back(Intern(*Target));
+    }
+
+    std::sort(FnData.CallTargets.begin(), FnData.CallTargets.end());
+    FnData.CallTargets.erase(std::unique(FnData.CallTargets.begin(),
+                                         FnData.CallTargets.end()),
+                             FnData.CallTargets.end());
+
+    Functions.push_back(std::move(FnData));
+  }
+}
+
+CallGraph::SymbolID CallGraph::Intern(const Function &Fn)
+{
+  auto i = IDs.find(&Fn);
+  if (i != IDs.end()) {
+    return i->second;
   }
 
-  Format->Write(FlowGraph, Functions);
+  SymbolID ID = Symbols.size();
+  Symbols.push_back(&Fn);
+  IDs[&Fn] = ID;
 
-  return false;
+  return ID;
 }
 
 
+struct BinaryFormat : public FileFormat {
+  string Filename(StringRef Prefix) const override {
+    return (Prefix + ".pcg").str();
+  }
+
+  bool IsText() const override { return false; }
+
+  void Write(raw_ostream &Out, const CallGraph &CG) const override {
+    CallGraphFile::Builder Builder(CG.ModuleName);
+
+    for (const Function *Fn : CG.Symbols) {
+      uint8_t Flags = 0;
+
+      if (not Fn->isDeclaration()) {
+        Flags |= CallGraphFile::Defined;
+      }
+
+      if (Fn->hasLocalLinkage()) {
+        Flags |= CallGraphFile::Local;
+      }
+
+      Builder.AddSymbol(Fn->getName(), Flags);
+    }
+
+    for (const CallGraph::FunctionData &Fn : CG.Functions) {
+      Builder.AddCalls(Fn.Symbol, Fn.CallTargets);
+    }
+
+    Builder.Write(Out);
+  }
+};
+
 struct DotFormat : public FileFormat {
   string Filename(StringRef Prefix) const override {
     return (Prefix + ".dot").str();
   }
 
-  void Write(raw_ostream &Out, const FnVec &Functions) const override {
+  void Write(raw_ostream &Out, const CallGraph &CG) const override {
     Out
       << "digraph {\n"
       << "  node [ shape = \"rectangle\" ];\n"
@@ -135,17 +245,19 @@ struct DotFormat : public FileFormat {
       << "\n"
       ;
 
-    for (const FunctionData& Fn : Functions) {
+    for (const CallGraph::FunctionData& Fn : CG.Functions) {
+      StringRef Name = CG.Name(Fn.Symbol);
       Out
-        << "  \"" << Fn.Name << "\" [ label = \"" << Fn.Name << "\" ];\n"
+        << "  \"" << Name << "\" [ label = \"" << Name << "\" ];\n"
         ;
     }
 
     Out << "\n";
 
-    for (const FunctionData& Fn : Functions) {
-      for (const auto &Target : Fn.CallTargets) {
-        Out << "  \"" << Fn.Name << "\" -> \"" << Target << "\";\n";
+    for (const CallGraph::FunctionData& Fn : CG.Functions) {
+      for (CallGraph::SymbolID Target : Fn.CallTargets) {
+        Out << "  \"" << CG.Name(Fn.Symbol) << "\" -> \"" << CG.Name(Target)
+          << "\";\n";
       }
     }
 
@@ -158,26 +270,27 @@ struct JSONFormat : public FileFormat {
     return (Prefix + ".json").str();
   }
 
-  void Write(raw_ostream &Out, const FnVec &Functions) const override {
+  void Write(raw_ostream &Out, const CallGraph &CG) const override {
     Out
       << "{"
       << "\"functions\":{"
       ;
 
     // Sigh, JSON... sigh.
-    for (size_t i = 0, Len = Functions.size(); i < Len; i++) {
-      const FunctionData &Fn = Functions[i];
+    for (size_t i = 0, Len = CG.Functions.size(); i < Len; i++) {
+      const CallGraph::FunctionData &Fn = CG.Functions[i];
+      WriteQuoted(Out, CG.Name(Fn.Symbol));
       Out
-        << "\"" << Fn.Name << "\":{"
+        << ":{"
         << "\"calls\":["
         ;
 
-      size_t Count = 0, Targets = Fn.CallTargets.size();
-      for (const auto &Target : Fn.CallTargets) {
-        Out << "\"" << Target << "\"";
-        if ((++Count) < Targets) {
+      for (size_t j = 0; j < Fn.CallTargets.size(); j++) {
+        if (j > 0) {
           Out << ',';
         }
+
+        WriteQuoted(Out, CG.Name(Fn.CallTargets[j]));
       }
 
       Out << "]}";
@@ -195,17 +308,21 @@ struct YAMLFormat : public FileFormat {
     return (Prefix + ".yaml").str();
   }
 
-  void Write(raw_ostream &Out, const FnVec &Functions) const override {
+  void Write(raw_ostream &Out, const CallGraph &CG) const override {
     Out << "functions:\n";
 
-    for (const FunctionData& Fn : Functions) {
+    for (const CallGraph::FunctionData& Fn : CG.Functions) {
+      Out << "  ";
+      WriteQuoted(Out, CG.Name(Fn.Symbol));
       Out
-        << "  " << Fn.Name << ":\n"
+        << ":\n"
         << "    calls:\n"
         ;
 
-      for (const auto &Target : Fn.CallTargets) {
-        Out << "      - " << Target << "\n";
+      for (CallGraph::SymbolID Target : Fn.CallTargets) {
+        Out << "      - ";
+        WriteQuoted(Out, CG.Name(Target));
+        Out << "\n";
       }
     }
   }
@@ -214,6 +331,9 @@ struct YAMLFormat : public FileFormat {
 
 std::unique_ptr<FileFormat> FileFormat::Create(Kind K) {
   switch (K) {
+  case Kind::Binary:
+    return std::unique_ptr<FileFormat>(new BinaryFormat());
+
   case Kind::Dot:
     return std::unique_ptr<FileFormat>(new DotFormat());
 
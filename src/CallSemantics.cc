@@ -31,9 +31,86 @@
  */
 
 #include "CallSemantics.hh"
+
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/raw_ostream.h>
+
+using namespace llvm;
 using namespace llvm::prov;
 
 
+namespace {
+
+/**
+ * CallSemantics whose roles have been looked up for every function in
+ * a module ahead of time.
+ */
+class ResolvedCallSemantics : public CallSemantics {
+public:
+  ResolvedCallSemantics(const CallSemantics &Base, const Module &M)
+    : Base(Base)
+  {
+    for (const Function &F : M) {
+      Table[&F] = Base.RolesOf(F);
+    }
+  }
+
+  StringRef Name() const override { return Base.Name(); }
+
+  Roles RolesOf(const Function &F) const override {
+    auto i = Table.find(&F);
+    return (i == Table.end()) ? Base.RolesOf(F) : i->second;
+  }
+
+private:
+  const CallSemantics &Base;
+  DenseMap<const Function*, Roles> Table;
+};
+
+} // anonymous namespace
+
+
 CallSemantics::~CallSemantics()
 {
 }
+
+std::unique_ptr<CallSemantics> CallSemantics::Resolve(const Module &M) const {
+  return std::unique_ptr<CallSemantics>(new ResolvedCallSemantics(*this, M));
+}
+
+SmallVector<Value*, 2> CallSemantics::CallOutputs(CallInst *Call) const {
+  SmallVector<Value*, 2> Outputs = { Call };
+
+  Function *Target = Call->getCalledFunction();
+  if (not Target) {
+    return Outputs;
+  }
+
+  for (unsigned ArgNum : RolesOf(*Target).OutputArgs) {
+    if (ArgNum >= Call->getNumArgOperands()) {
+      errs()
+        << "ERROR: " << Target->getName() << " has only "
+        << Call->getNumArgOperands() << " params, expected at least "
+        << (ArgNum + 1)
+        ;
+
+      return {};
+    }
+
+    Outputs.push_back(Call->getArgOperand(ArgNum));
+  }
+
+  return Outputs;
+}
+
+bool CallSemantics::IsSource(const CallInst *Call) const {
+  const Function *F = Call->getCalledFunction();
+  return F and RolesOf(*F).Source;
+}
+
+bool CallSemantics::CanSink(const CallInst *Call) const {
+  const Function *F = Call->getCalledFunction();
+  return F and RolesOf(*F).Sink;
+}
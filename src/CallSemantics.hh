@@ -37,12 +37,17 @@
 
 #include <loom/Instrumenter.hh>
 
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/StringRef.h>
+
 #include <memory>
 
 
 namespace llvm {
 
 class CallInst;
+class Function;
 class Module;
 class Value;
 
@@ -68,6 +73,51 @@ class CallSemantics
   //! Create an object to describe POSIX information-flow semantics.
   static std::unique_ptr<CallSemantics> Posix();
 
+  /**
+   * The semantics to use by default: those loaded from the table named by
+   * `-prov-semantics` if any (see `prov-semc`), or else POSIX semantics.
+   */
+  static const CallSemantics& Default();
+
+  /**
+   * The information-flow roles that calls to a function can play.
+   *
+   * This is a lightweight view of data owned by the CallSemantics that
+   * describes the function.
+   */
+  struct Roles {
+    //! Values of @ref Data that don't name an argument.
+    enum : int { NoData = -2, ReturnValue = -1 };
+
+    //! Calls to the function are sources of information to track.
+    bool Source = false;
+
+    //! Calls to the function can be sinks for tracked information.
+    bool Sink = false;
+
+    //! Arguments that the function outputs information through.
+    ArrayRef<uint8_t> OutputArgs;
+
+    //! The argument (or @ref ReturnValue) that a source outputs data via.
+    int Data = NoData;
+
+    //! The function to replace calls with when instrumenting them, if any.
+    StringRef Wrapper;
+  };
+
+  /**
+   * Resolve these semantics against the functions in a module, once,
+   * so that queries about calls to those functions are pointer lookups
+   * rather than name lookups.
+   *
+   * The result is valid for as long as both these semantics and the module
+   * are; functions added to the module later are resolved by name.
+   */
+  std::unique_ptr<CallSemantics> Resolve(const Module&) const;
+
+  //! What roles can calls to this function play?
+  virtual Roles RolesOf(const Function&) const = 0;
+
   /**
    * Report which values associated with a call are semantic outputs.
    *
@@ -76,13 +126,19 @@ class CallSemantics
    * pointer to the `read(2)` system call, we are outputting data into that
    * buffer, so we should treat that pointer as an output rather than an input.
    */
-  virtual SmallVector<Value*, 2> CallOutputs(CallInst*) const = 0;
+  SmallVector<Value*, 2> CallOutputs(CallInst*) const;
+
+  /**
+   * A name for these semantics: analysis results that depend on them (e.g.,
+   * cached flows) are only valid for semantics with the same name.
+   */
+  virtual StringRef Name() const = 0;
 
   //! Is this function call a source of information to track?
-  virtual bool IsSource(const CallInst*) const = 0;
+  bool IsSource(const CallInst*) const;
 
   //! Can this function call be a sink for tracked information?
-  virtual bool CanSink(const CallInst*) const = 0;
+  bool CanSink(const CallInst*) const;
 };
 
 } // namespace prov
@@ -0,0 +1,221 @@
+//! @file ClobberCache.cc  Definition of @ref llvm::prov::ClobberCache.
+/*
+ * Copyright (c) 2017 Jonathan Anderson
+ * All rights reserved.
+ *
+ * This software was developed by BAE Systems, the University of Cambridge
+ * Computer Laboratory, and Memorial University under DARPA/AFRL contract
+ * FA8650-15-C-7558 ("CADETS"), as part of the DARPA Transparent Computing
+ * (TC) research program.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "ClobberCache.hh"
+
+#include <llvm/ADT/SmallPtrSet.h>
+#include <llvm/ADT/Statistic.h>
+#include <llvm/Analysis/MemorySSA.h>
+
+#include <algorithm>
+
+using namespace llvm;
+using namespace llvm::prov;
+
+#define DEBUG_TYPE "prov-clobber-cache"
+
+STATISTIC(NumWalkerHits, "Number of clobber queries answered from cache");
+STATISTIC(NumWalkerMisses, "Number of MemorySSA clobber walker queries");
+STATISTIC(NumPhiHits, "Number of MemoryPhi expansions answered from cache");
+STATISTIC(NumPhiMisses, "Number of MemoryPhi webs expanded");
+
+
+SmallVector<Value*, 4> ClobberCache::ClobberersOf(Instruction *I)
+{
+  MemoryAccess *MA = MSSA.getMemoryAccess(I);
+  if (not MA) {
+    return {};
+  }
+
+  SmallVector<Value*, 4> Clobberers;
+  MemoryAccess *Clobberer = ClobberingAccess(MA);
+
+  if (auto *Def = dyn_cast<MemoryDef>(Clobberer)) {
+    // The memory was written to by an easily-discernable instruction like
+    // a store that comes earlier in the function.
+    if (not MSSA.isLiveOnEntryDef(Def)) {
+      Clobberers.push_back(Def->getMemoryInst());
+    }
+
+  } else if (auto *Phi = dyn_cast<MemoryPhi>(Clobberer)) {
+    // Is there a potentially more complex scenario in which multiple stores
+    // can clobber the memory location? If so, we'll need to (recursively)
+    // chase down all of the possible clobbering instructions.
+    for (Instruction *Def : PhiClobberers(Phi)) {
+      if (Def != I) {
+        Clobberers.push_back(Def);
+      }
+    }
+  }
+
+  return Clobberers;
+}
+
+MemoryAccess* ClobberCache::ClobberingAccess(MemoryAccess *MA)
+{
+  auto i = Clobbering.find(MA);
+  if (i != Clobbering.end()) {
+    ++HitCount;
+    ++NumWalkerHits;
+    return i->second;
+  }
+
+  ++MissCount;
+  ++NumWalkerMisses;
+
+  MemoryAccess *Clobberer = MSSA.getWalker()->getClobberingMemoryAccess(MA);
+  Clobbering[MA] = Clobberer;
+
+  return Clobberer;
+}
+
+const std::vector<Instruction*>& ClobberCache::PhiClobberers(MemoryPhi *Root)
+{
+  auto i = PhiIndex.find(Root);
+  if (i != PhiIndex.end()) {
+    ++HitCount;
+    ++NumPhiHits;
+    return PhiDefs[i->second];
+  }
+
+  ++MissCount;
+  ++NumPhiMisses;
+
+  // Walk the web of MemoryPhis beneath Root, memoizing every Phi in it so
+  // that later queries rooted at any of them aren't walked again. Phis that
+  // can reach each other (e.g., around a loop) are clobbered by the same
+  // instructions, so the web is expanded one strongly-connected component
+  // at a time (Tarjan's algorithm, iteratively), with each component's
+  // clobberers computed after those of the components beneath it. Phis that
+  // have already been expanded aren't walked again.
+  struct Frame {
+    MemoryPhi *Phi;
+    unsigned Next;
+  };
+
+  DenseMap<MemoryPhi*, unsigned> Order, Low;
+  SmallVector<MemoryPhi*, 8> Component;
+  SmallVector<Frame, 8> Stack;
+
+  auto Visit = [&](MemoryPhi *Phi) {
+    unsigned N = Order.size();
+    Order[Phi] = Low[Phi] = N;
+    Component.push_back(Phi);
+    Stack.push_back({ Phi, 0 });
+  };
+
+  Visit(Root);
+
+  while (not Stack.empty()) {
+    Frame &Current = Stack.back();
+    MemoryPhi *Phi = Current.Phi;
+
+    if (Current.Next < Phi->getNumIncomingValues()) {
+      auto *SubPhi = dyn_cast<MemoryPhi>(Phi->getIncomingValue(Current.Next++));
+      if (not SubPhi or PhiIndex.count(SubPhi)) {
+        continue;
+      }
+
+      auto j = Order.find(SubPhi);
+      if (j == Order.end()) {
+        Visit(SubPhi);
+      } else {
+        // Not yet expanded, so it's in the component being built.
+        Low[Phi] = std::min(Low[Phi], j->second);
+      }
+
+      continue;
+    }
+
+    Stack.pop_back();
+    if (not Stack.empty()) {
+      MemoryPhi *Parent = Stack.back().Phi;
+      Low[Parent] = std::min(Low[Parent], Low[Phi]);
+    }
+
+    if (Low[Phi] != Order[Phi]) {
+      continue;
+    }
+
+    // Phi is the first of a strongly-connected component's Phis to be
+    // visited: the component is everything above it on the stack.
+    auto First = std::find(Component.begin(), Component.end(), Phi);
+    SmallVector<MemoryPhi*, 8> Members(First, Component.end());
+    Component.erase(First, Component.end());
+
+    std::vector<Instruction*> Defs;
+    SmallPtrSet<Instruction*, 8> SeenDefs;
+
+    auto AddDef = [&](Instruction *I) {
+      if (SeenDefs.insert(I).second) {
+        Defs.push_back(I);
+      }
+    };
+
+    for (MemoryPhi *Member : Members) {
+      for (Use &U : Member->incoming_values()) {
+        Value *V = U.get();
+
+        if (auto *SubPhi = dyn_cast<MemoryPhi>(V)) {
+          // Phis in this component have no clobberers of their own; those
+          // beneath it have all been expanded by now.
+          auto j = PhiIndex.find(SubPhi);
+          if (j != PhiIndex.end()) {
+            for (Instruction *I : PhiDefs[j->second]) {
+              AddDef(I);
+            }
+          }
+
+          continue;
+        }
+
+        auto *MD = dyn_cast<MemoryDef>(V);
+        assert(MD);
+
+        if (MSSA.isLiveOnEntryDef(MD)) {
+          continue;
+        }
+
+        assert(MD->getMemoryInst());
+        AddDef(MD->getMemoryInst());
+      }
+    }
+
+    for (MemoryPhi *Member : Members) {
+      PhiIndex[Member] = PhiDefs.size();
+    }
+
+    PhiDefs.push_back(std::move(Defs));
+  }
+
+  return PhiDefs[PhiIndex[Root]];
+}
@@ -0,0 +1,107 @@
+//! @file ClobberCache.hh  Declaration of @ref llvm::prov::ClobberCache.
+/*
+ * Copyright (c) 2017 Jonathan Anderson
+ * All rights reserved.
+ *
+ * This software was developed by BAE Systems, the University of Cambridge
+ * Computer Laboratory, and Memorial University under DARPA/AFRL contract
+ * FA8650-15-C-7558 ("CADETS"), as part of the DARPA Transparent Computing
+ * (TC) research program.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef LLVM_PROV_CLOBBER_CACHE_H
+#define LLVM_PROV_CLOBBER_CACHE_H
+
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/SmallVector.h>
+
+#include <vector>
+
+
+namespace llvm {
+
+class Instruction;
+class MemoryAccess;
+class MemoryPhi;
+class MemorySSA;
+class Value;
+
+namespace prov {
+
+/**
+ * A per-function cache of MemorySSA clobber information.
+ *
+ * Finding the instructions that may have clobbered a memory location means
+ * asking the MemorySSA walker for the clobbering access and, when that access
+ * is a MemoryPhi, chasing the Phi's incoming values back through any further
+ * Phis to the MemoryDefs underneath. Both steps are memoized here, by
+ * MemoryAccess, so that each walker query is made once and each web of
+ * MemoryPhis is expanded once no matter how many loads sit beneath it.
+ */
+class ClobberCache {
+public:
+  ClobberCache(MemorySSA &MSSA) : MSSA(MSSA) {}
+
+  //! The MemorySSA that this cache answers queries about.
+  MemorySSA& getMSSA() const { return MSSA; }
+
+  /**
+   * Find all memory operations that may have clobbered the location being
+   * accessed by an Instruction.
+   */
+  SmallVector<Value*, 4> ClobberersOf(Instruction*);
+
+  //! Number of queries answered from the cache.
+  size_t Hits() const { return HitCount; }
+
+  //! Number of queries that required a walker query or a Phi expansion.
+  size_t Misses() const { return MissCount; }
+
+private:
+  //! The (memoized) clobbering access of a MemoryAccess.
+  MemoryAccess* ClobberingAccess(MemoryAccess*);
+
+  /**
+   * The (memoized) clobbering instructions underneath a MemoryPhi, found by
+   * walking backwards through MemoryPhi operations until we reach
+   * MemoryDef operations and real Instruction values that clobber memory.
+   */
+  const std::vector<Instruction*>& PhiClobberers(MemoryPhi*);
+
+  MemorySSA &MSSA;
+
+  DenseMap<const MemoryAccess*, MemoryAccess*> Clobbering;
+
+  //! MemoryPhi -> index into PhiDefs (shared by Phis that reach each other)
+  DenseMap<const MemoryPhi*, unsigned> PhiIndex;
+  std::vector<std::vector<Instruction*>> PhiDefs;
+
+  size_t HitCount = 0;
+  size_t MissCount = 0;
+};
+
+} // namespace prov
+} // namespace llvm
+
+#endif // LLVM_PROV_CLOBBER_CACHE_H
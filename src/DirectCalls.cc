@@ -0,0 +1,144 @@
+//! @file DirectCalls.cc  Direct call edges between functions in a module.
+/*
+ * Copyright (c) 2017 Jonathan Anderson
+ * All rights reserved.
+ *
+ * This software was developed by BAE Systems, the University of Cambridge
+ * Computer Laboratory, and Memorial University under DARPA/AFRL contract
+ * FA8650-15-C-7558 ("CADETS"), as part of the DARPA Transparent Computing
+ * (TC) research program.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "DirectCalls.hh"
+
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/SmallPtrSet.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/InstIterator.h>
+#include <llvm/IR/Module.h>
+
+#include <algorithm>
+
+using namespace llvm;
+using namespace llvm::prov;
+
+
+std::vector<Function*> llvm::prov::DirectCallees(Function &Fn)
+{
+  std::vector<Function*> Callees;
+  SmallPtrSet<Function*, 8> Seen;
+
+  for (auto& I : instructions(Fn)) {
+    if (CallInst* Call = dyn_cast<CallInst>(&I)) {
+      if (Function *DirectTarget = Call->getCalledFunction()) {
+        if (Seen.insert(DirectTarget).second) {
+          Callees.push_back(DirectTarget);
+        }
+      }
+    }
+  }
+
+  return Callees;
+}
+
+std::vector<std::vector<Function*>> llvm::prov::BottomUpSCCs(Module &M)
+{
+  // An iterative version of Tarjan's algorithm, which emits components in
+  // reverse topological order (i.e., callees first).
+  struct Frame {
+    Function *Fn;
+    std::vector<Function*> Callees;
+    size_t Next;
+  };
+
+  DenseMap<Function*, unsigned> Index;
+  DenseMap<Function*, unsigned> LowLink;
+  SmallPtrSet<Function*, 32> OnStack;
+  std::vector<Function*> Stack;
+  std::vector<Frame> CallStack;
+  std::vector<std::vector<Function*>> Components;
+  unsigned NextIndex = 0;
+
+  auto Visit = [&](Function *Fn) {
+    Index[Fn] = LowLink[Fn] = NextIndex++;
+    Stack.push_back(Fn);
+    OnStack.insert(Fn);
+    CallStack.push_back({ Fn, DirectCallees(*Fn), 0 });
+  };
+
+  for (Function &Root : M) {
+    if (Root.isDeclaration() or Index.count(&Root)) {
+      continue;
+    }
+
+    Visit(&Root);
+
+    while (not CallStack.empty()) {
+      Frame &Top = CallStack.back();
+
+      if (Top.Next < Top.Callees.size()) {
+        Function *Callee = Top.Callees[Top.Next++];
+        if (Callee->isDeclaration()) {
+          continue;
+        }
+
+        auto i = Index.find(Callee);
+        if (i == Index.end()) {
+          Visit(Callee);
+        } else if (OnStack.count(Callee)) {
+          LowLink[Top.Fn] = std::min(LowLink[Top.Fn], i->second);
+        }
+
+        continue;
+      }
+
+      Function *Fn = Top.Fn;
+      CallStack.pop_back();
+
+      if (not CallStack.empty()) {
+        Function *Caller = CallStack.back().Fn;
+        LowLink[Caller] = std::min(LowLink[Caller], LowLink[Fn]);
+      }
+
+      if (LowLink[Fn] != Index[Fn]) {
+        continue;
+      }
+
+      std::vector<Function*> Component;
+      Function *Member;
+
+      do {
+        Member = Stack.back();
+        Stack.pop_back();
+        OnStack.erase(Member);
+        Component.push_back(Member);
+      } while (Member != Fn);
+
+      Components.push_back(std::move(Component));
+    }
+  }
+
+  return Components;
+}
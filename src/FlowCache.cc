@@ -0,0 +1,498 @@
+//! @file FlowCache.cc  Definition of @ref llvm::prov::FlowCache.
+/*
+ * Copyright (c) 2017 Jonathan Anderson
+ * All rights reserved.
+ *
+ * This software was developed by BAE Systems, the University of Cambridge
+ * Computer Laboratory, and Memorial University under DARPA/AFRL contract
+ * FA8650-15-C-7558 ("CADETS"), as part of the DARPA Transparent Computing
+ * (TC) research program.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "FlowCache.hh"
+
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/Statistic.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/Metadata.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MD5.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <cstring>
+
+using namespace llvm;
+using namespace llvm::prov;
+
+#define DEBUG_TYPE "prov-flow-cache"
+
+STATISTIC(NumCacheHits, "Number of functions whose flows were cached");
+STATISTIC(NumCacheMisses, "Number of functions whose flows weren't cached");
+STATISTIC(NumCacheRecords, "Number of records appended to the flow cache");
+STATISTIC(NumCorruptRecords, "Number of corrupt flow cache regions skipped");
+
+
+namespace {
+  //! The header of each record in the cache file (followed by its words).
+  struct RecordHeader {
+    uint32_t Magic;
+    uint32_t NumWords;
+    uint64_t KeyHigh;
+    uint64_t KeyLow;
+    uint64_t Checksum;
+  };
+
+  //! "PFC1" in native byte order: files from other hosts are ignored.
+  const uint32_t RecordMagic = 0x31434650;
+}
+
+//! FNV-1a over a record's key and words.
+static uint64_t Checksum(const FlowCache::Key &K, ArrayRef<uint32_t> Words) {
+  uint64_t Hash = 0xcbf29ce484222325ULL;
+
+  auto Add = [&Hash](const void *Data, size_t Len) {
+    auto *Bytes = static_cast<const uint8_t*>(Data);
+    for (size_t i = 0; i < Len; i++) {
+      Hash = (Hash ^ Bytes[i]) * 0x100000001b3ULL;
+    }
+  };
+
+  Add(&K.High, sizeof(K.High));
+  Add(&K.Low, sizeof(K.Low));
+  Add(Words.data(), Words.size() * sizeof(uint32_t));
+
+  return Hash;
+}
+
+
+namespace {
+  /**
+   * Hashes the structure of a function: everything about it that the flows
+   * found within it can depend on, but not the names of its local values.
+   *
+   * Values are numbered rather than printed, so no SlotTracker is ever
+   * built. Things that printed IR only refers to (attribute groups, struct
+   * bodies, metadata nodes, the attributes of callees) are hashed in full.
+   */
+  class StructureHasher {
+  public:
+    StructureHasher(MD5 &Hash) : Hash(Hash) {}
+
+    void AddFunction(const Function&);
+
+  private:
+    void Add(StringRef S) {
+      Hash.update(S);
+      Hash.update(StringRef("\0", 1));
+    }
+
+    void Add(uint64_t N) {
+      uint8_t Bytes[sizeof(N)];
+      std::memcpy(Bytes, &N, sizeof(N));
+      Hash.update(Bytes);
+    }
+
+    void AddAttributes(AttributeList, unsigned NumArgs);
+    void AddInstruction(const Instruction&);
+    void AddOperand(const Value*);
+    void AddMetadata(const Metadata*);
+    void AddType(Type*);
+
+    //! Add the attributes and calling convention of a call or invoke.
+    template<class CallT>
+    void AddCall(const CallT &Call) {
+      Add(Call.getCallingConv());
+      AddAttributes(Call.getAttributes(), Call.getNumArgOperands());
+    }
+
+    MD5 &Hash;
+    DenseMap<const Value*, uint64_t> Locals;
+    DenseMap<const Metadata*, uint64_t> Nodes;
+    DenseMap<Type*, uint64_t> Types;
+  };
+}
+
+void StructureHasher::AddFunction(const Function &Fn)
+{
+  const Module *M = Fn.getParent();
+  if (M) {
+    Add(M->getDataLayoutStr());
+    Add(M->getTargetTriple());
+  }
+
+  AddType(Fn.getFunctionType());
+  Add(Fn.getCallingConv());
+  AddAttributes(Fn.getAttributes(), Fn.arg_size());
+
+  // Number every local value first: phis can refer to values defined later.
+  for (const Argument &A : Fn.args()) {
+    Locals[&A] = Locals.size();
+  }
+
+  for (const BasicBlock &BB : Fn) {
+    Locals[&BB] = Locals.size();
+
+    for (const Instruction &I : BB) {
+      Locals[&I] = Locals.size();
+    }
+  }
+
+  for (const BasicBlock &BB : Fn) {
+    Add("block");
+
+    for (const Instruction &I : BB) {
+      AddInstruction(I);
+    }
+  }
+}
+
+void StructureHasher::AddAttributes(AttributeList Attrs, unsigned NumArgs)
+{
+  Add(Attrs.getAsString(AttributeList::FunctionIndex));
+  Add(Attrs.getAsString(AttributeList::ReturnIndex));
+
+  for (unsigned i = 0; i < NumArgs; i++) {
+    Add(Attrs.getAsString(AttributeList::FirstArgIndex + i));
+  }
+}
+
+void StructureHasher::AddInstruction(const Instruction &I)
+{
+  Add(I.getOpcode());
+  Add(I.getRawSubclassOptionalData());    // nsw, exact, inbounds, etc.
+  AddType(I.getType());
+
+  for (const Value *Operand : I.operand_values()) {
+    AddOperand(Operand);
+  }
+
+  // Details that aren't operands.
+  if (auto *Phi = dyn_cast<PHINode>(&I)) {
+    for (const BasicBlock *BB : Phi->blocks()) {
+      AddOperand(BB);
+    }
+
+  } else if (auto *Cmp = dyn_cast<CmpInst>(&I)) {
+    Add(Cmp->getPredicate());
+
+  } else if (auto *Load = dyn_cast<LoadInst>(&I)) {
+    Add(Load->isVolatile());
+    Add(Load->getAlignment());
+    Add(static_cast<uint64_t>(Load->getOrdering()));
+
+  } else if (auto *Store = dyn_cast<StoreInst>(&I)) {
+    Add(Store->isVolatile());
+    Add(Store->getAlignment());
+    Add(static_cast<uint64_t>(Store->getOrdering()));
+
+  } else if (auto *Alloca = dyn_cast<AllocaInst>(&I)) {
+    AddType(Alloca->getAllocatedType());
+    Add(Alloca->getAlignment());
+
+  } else if (auto *GEP = dyn_cast<GetElementPtrInst>(&I)) {
+    AddType(GEP->getSourceElementType());
+
+  } else if (auto *Call = dyn_cast<CallInst>(&I)) {
+    AddCall(*Call);
+
+  } else if (auto *Invoke = dyn_cast<InvokeInst>(&I)) {
+    AddCall(*Invoke);
+
+  } else if (auto *Extract = dyn_cast<ExtractValueInst>(&I)) {
+    for (unsigned Index : Extract->indices()) {
+      Add(Index);
+    }
+
+  } else if (auto *Insert = dyn_cast<InsertValueInst>(&I)) {
+    for (unsigned Index : Insert->indices()) {
+      Add(Index);
+    }
+
+  } else if (auto *RMW = dyn_cast<AtomicRMWInst>(&I)) {
+    Add(RMW->isVolatile());
+    Add(RMW->getOperation());
+    Add(static_cast<uint64_t>(RMW->getOrdering()));
+
+  } else if (auto *CmpXchg = dyn_cast<AtomicCmpXchgInst>(&I)) {
+    Add(CmpXchg->isVolatile());
+    Add(static_cast<uint64_t>(CmpXchg->getSuccessOrdering()));
+    Add(static_cast<uint64_t>(CmpXchg->getFailureOrdering()));
+
+  } else if (auto *Fence = dyn_cast<FenceInst>(&I)) {
+    Add(static_cast<uint64_t>(Fence->getOrdering()));
+  }
+
+  // Metadata that alias analysis can use (e.g., !tbaa), but not locations.
+  SmallVector<std::pair<unsigned, MDNode*>, 4> MDs;
+  I.getAllMetadataOtherThanDebugLoc(MDs);
+
+  for (auto &MD : MDs) {
+    Add(MD.first);
+    AddMetadata(MD.second);
+  }
+}
+
+void StructureHasher::AddOperand(const Value *V)
+{
+  auto i = Locals.find(V);
+  if (i != Locals.end()) {
+    Add("local");
+    Add(i->second);
+    return;
+  }
+
+  AddType(V->getType());
+
+  if (auto *F = dyn_cast<Function>(V)) {
+    // What a callee is declared to do (e.g., readonly) affects flows.
+    Add("function");
+    Add(F->getName());
+    AddAttributes(F->getAttributes(), F->arg_size());
+
+  } else if (auto *GV = dyn_cast<GlobalVariable>(V)) {
+    Add("global");
+    Add(GV->getName());
+    Add(GV->isConstant());
+
+  } else if (auto *MV = dyn_cast<MetadataAsValue>(V)) {
+    Add("metadata");
+    AddMetadata(MV->getMetadata());
+
+  } else {
+    // Constants print without reference to the module.
+    std::string Text;
+    raw_string_ostream Out(Text);
+    V->printAsOperand(Out, false, static_cast<const Module*>(nullptr));
+    Add(Out.str());
+  }
+}
+
+void StructureHasher::AddMetadata(const Metadata *MD)
+{
+  if (not MD) {
+    Add("null");
+    return;
+  }
+
+  // Nodes can refer to themselves (e.g., loop IDs).
+  auto i = Nodes.find(MD);
+  if (i != Nodes.end()) {
+    Add("node");
+    Add(i->second);
+    return;
+  }
+
+  Nodes[MD] = Nodes.size();
+  Add(MD->getMetadataID());
+
+  if (auto *S = dyn_cast<MDString>(MD)) {
+    Add(S->getString());
+
+  } else if (auto *C = dyn_cast<ValueAsMetadata>(MD)) {
+    AddOperand(C->getValue());
+
+  } else if (auto *N = dyn_cast<MDNode>(MD)) {
+    for (const MDOperand &Op : N->operands()) {
+      AddMetadata(Op.get());
+    }
+  }
+}
+
+void StructureHasher::AddType(Type *T)
+{
+  auto i = Types.find(T);
+  if (i != Types.end()) {
+    Add("type");
+    Add(i->second);
+    return;
+  }
+
+  Types[T] = Types.size();
+
+  // Named structs print as their names, so hash their bodies too
+  // (and those of any types within them).
+  if (auto *ST = dyn_cast<StructType>(T)) {
+    Add(ST->isLiteral() ? StringRef() : ST->getName());
+    Add(ST->isPacked());
+    Add(ST->isOpaque());
+  } else {
+    std::string Text;
+    raw_string_ostream Out(Text);
+    T->print(Out);
+    Add(Out.str());
+  }
+
+  for (Type *Sub : T->subtypes()) {
+    AddType(Sub);
+  }
+}
+
+
+FlowCache::Key FlowCache::KeyFor(const Function &Fn, StringRef Context)
+{
+  MD5 Hash;
+  Hash.update(Context);
+  Hash.update(StringRef("\0", 1));
+
+  StructureHasher(Hash).AddFunction(Fn);
+
+  MD5::MD5Result Result;
+  Hash.final(Result);
+
+  Key K = { 0, 0 };
+  for (int i = 0; i < 8; i++) {
+    K.High = (K.High << 8) | Result[i];
+    K.Low = (K.Low << 8) | Result[i + 8];
+  }
+
+  return K;
+}
+
+FlowCache::FlowCache(StringRef Path, uint64_t MaxBytes)
+  : Path(Path), MaxBytes(MaxBytes), HitCount(0), MissCount(0)
+{
+  Index();
+}
+
+void FlowCache::Index()
+{
+  // The file may be appended to while we have it mapped, but we only ever
+  // look at the records that were complete when we opened it.
+  auto Buffer = MemoryBuffer::getFile(Path, -1, false);
+  if (not Buffer) {
+    return;
+  }
+
+  Mapped = std::move(*Buffer);
+
+  const char *Pos = Mapped->getBufferStart();
+  const char *End = Mapped->getBufferEnd();
+  bool Resyncing = false;
+
+  while (static_cast<size_t>(End - Pos) >= sizeof(RecordHeader)) {
+    RecordHeader H;
+    std::memcpy(&H, Pos, sizeof(H));
+
+    const size_t Remaining = End - Pos - sizeof(H);
+    const Key K = { H.KeyHigh, H.KeyLow };
+
+    if (H.Magic == RecordMagic and H.NumWords <= Remaining / sizeof(uint32_t)) {
+      ArrayRef<uint32_t> Words(
+        reinterpret_cast<const uint32_t*>(Pos + sizeof(H)), H.NumWords);
+
+      if (Checksum(K, Words) == H.Checksum) {
+        Entries.insert({ K, Words });
+        Pos += sizeof(H) + Words.size() * sizeof(uint32_t);
+        Resyncing = false;
+        continue;
+      }
+    }
+
+    // A torn or corrupt record: look for the next one, counting each
+    // corrupt region once rather than once per word that we skip.
+    if (not Resyncing) {
+      ++NumCorruptRecords;
+      Resyncing = true;
+    }
+
+    Pos += sizeof(uint32_t);
+  }
+}
+
+Optional<ArrayRef<uint32_t>> FlowCache::Lookup(const Key &K) const
+{
+  auto i = Entries.find(K);
+  if (i == Entries.end()) {
+    ++MissCount;
+    ++NumCacheMisses;
+    return None;
+  }
+
+  ++HitCount;
+  ++NumCacheHits;
+  return i->second;
+}
+
+void FlowCache::Insert(const Key &K, std::vector<uint32_t> Words)
+{
+  std::lock_guard<std::mutex> Guard(PendingLock);
+  Pending.emplace_back(K, std::move(Words));
+}
+
+void FlowCache::Flush()
+{
+  std::lock_guard<std::mutex> Guard(PendingLock);
+
+  if (Pending.empty()) {
+    return;
+  }
+
+  uint64_t Size;
+  if (MaxBytes and not sys::fs::file_size(Path, Size) and Size >= MaxBytes) {
+    Pending.clear();
+    return;
+  }
+
+  int FD;
+  std::error_code Err = sys::fs::openFileForWrite(Path, FD, sys::fs::F_Append);
+  if (Err) {
+    errs() << "Error opening flow cache '" << Path << "': " << Err.message()
+      << "\n";
+    return;
+  }
+
+  // Each record goes out in a single write(2) to an O_APPEND file, so
+  // records from concurrent writers can't be interleaved.
+  raw_fd_ostream Out(FD, true, true);
+
+  for (auto &P : Pending) {
+    const Key &K = P.first;
+    ArrayRef<uint32_t> Words = P.second;
+
+    RecordHeader H = {
+      RecordMagic,
+      static_cast<uint32_t>(Words.size()),
+      K.High,
+      K.Low,
+      Checksum(K, Words),
+    };
+
+    std::string Record(reinterpret_cast<const char*>(&H), sizeof(H));
+    Record.append(reinterpret_cast<const char*>(Words.data()),
+                  Words.size() * sizeof(uint32_t));
+
+    Out.write(Record.data(), Record.size());
+    ++NumCacheRecords;
+  }
+
+  // A partly-written record will fail its checksum: just report the error.
+  if (Out.has_error()) {
+    errs() << "Error writing flow cache '" << Path << "'\n";
+    Out.clear_error();
+  }
+
+  Pending.clear();
+}
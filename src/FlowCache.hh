@@ -0,0 +1,157 @@
+//! @file FlowCache.hh  Declaration of @ref llvm::prov::FlowCache.
+/*
+ * Copyright (c) 2017 Jonathan Anderson
+ * All rights reserved.
+ *
+ * This software was developed by BAE Systems, the University of Cambridge
+ * Computer Laboratory, and Memorial University under DARPA/AFRL contract
+ * FA8650-15-C-7558 ("CADETS"), as part of the DARPA Transparent Computing
+ * (TC) research program.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef LLVM_PROV_FLOW_CACHE_H
+#define LLVM_PROV_FLOW_CACHE_H
+
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/Optional.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/MemoryBuffer.h>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+
+namespace llvm {
+
+class Function;
+
+namespace prov {
+
+/**
+ * A persistent cache of per-function analysis results.
+ *
+ * Results are opaque sequences of 32-bit words (e.g., source-to-sink flows
+ * as instruction numbers), keyed by a hash of a function's IR and of
+ * whatever else the results depend on. The cache is a single append-only
+ * file of checksummed records:
+ *
+ *  - readers memory-map the file and never lock it: a record that is
+ *    still being written (or was torn by a crash) fails its checksum and
+ *    is skipped, and reading resumes at the next valid record after it
+ *  - writers append each record with a single `write(2)` to a file opened
+ *    with `O_APPEND`, so concurrent builds (e.g., `make -j32`) can share
+ *    one cache without interleaving their records
+ *
+ * If two processes compute the same result, both may append it; the first
+ * record for a key wins.
+ */
+class FlowCache {
+public:
+  //! A 128-bit hash of everything that a cached result depends on.
+  struct Key {
+    uint64_t High;
+    uint64_t Low;
+
+    bool operator == (const Key &K) const {
+      return High == K.High and Low == K.Low;
+    }
+  };
+
+  /**
+   * The key for results about a function.
+   *
+   * This is a hash of the function's structure rather than of its printed
+   * IR: it covers what printed IR only refers to (attribute groups, struct
+   * bodies, metadata), the attributes of the functions that it calls and
+   * the module's data layout and target, but not the names of local values.
+   * Computing it is linear in the size of the function.
+   *
+   * @param   Context    anything other than the function's IR that the
+   *                     results depend on (e.g., @ref CallSemantics::Name)
+   */
+  static Key KeyFor(const Function&, StringRef Context);
+
+  /**
+   * Open (or prepare to create) the cache file at @b Path.
+   *
+   * @param   MaxBytes    don't append to a file that has grown beyond
+   *                      this size (0: no limit)
+   */
+  FlowCache(StringRef Path, uint64_t MaxBytes = 0);
+
+  /**
+   * Look up a cached result.
+   *
+   * @returns   the cached words (which remain valid for the lifetime of
+   *            this object), or None on a miss
+   */
+  Optional<ArrayRef<uint32_t>> Lookup(const Key&) const;
+
+  //! Record a new result, to be appended by @ref Flush (thread-safe).
+  void Insert(const Key&, std::vector<uint32_t> Words);
+
+  //! Append newly-inserted results to the cache file.
+  void Flush();
+
+  //! Number of lookups that found a cached result.
+  size_t Hits() const { return HitCount; }
+
+  //! Number of lookups that didn't.
+  size_t Misses() const { return MissCount; }
+
+private:
+  struct KeyInfo {
+    static Key getEmptyKey() { return { ~0ULL, ~0ULL }; }
+    static Key getTombstoneKey() { return { ~0ULL, ~0ULL - 1 }; }
+    static unsigned getHashValue(const Key &K) { return K.Low; }
+    static bool isEqual(const Key &x, const Key &y) { return x == y; }
+  };
+
+  //! Index the valid records in the mapped file.
+  void Index();
+
+  const std::string Path;
+  const uint64_t MaxBytes;
+
+  //! The cache file, as it was when we opened it.
+  std::unique_ptr<MemoryBuffer> Mapped;
+  DenseMap<Key, ArrayRef<uint32_t>, KeyInfo> Entries;
+
+  //! Results computed in this process, waiting to be appended.
+  std::mutex PendingLock;
+  std::vector<std::pair<Key, std::vector<uint32_t>>> Pending;
+
+  mutable std::atomic<size_t> HitCount;
+  mutable std::atomic<size_t> MissCount;
+};
+
+} // namespace prov
+} // namespace llvm
+
+#endif // LLVM_PROV_FLOW_CACHE_H
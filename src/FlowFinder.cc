@@ -30,103 +30,555 @@
  * SUCH DAMAGE.
  */
 
+#include "BitReachability.hh"
 #include "CallSemantics.hh"
+#include "ClobberCache.hh"
 #include "FlowFinder.hh"
-
+#include "FlowGraphFile.hh"
+#include "FlowSummary.hh"
+
+#include <llvm/ADT/BitVector.h>
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/DenseSet.h>
+#include <llvm/ADT/SmallPtrSet.h>
+#include <llvm/ADT/Statistic.h>
 #include <llvm/ADT/iterator_range.h>
 #include <llvm/Analysis/MemorySSA.h>
 #include <llvm/IR/InstIterator.h>
+#include <llvm/IR/ModuleSlotTracker.h>
 #include <llvm/IR/User.h>
+#include <llvm/Support/CommandLine.h>
 #include <llvm/Support/raw_ostream.h>
 
-#include <unordered_map>
-#include <unordered_set>
+#include <algorithm>
 
 using namespace llvm;
 using namespace llvm::prov;
-using std::unordered_map;
-using std::unordered_set;
 
 
-typedef unordered_set<Value*> ValueSet;
+#define DEBUG_TYPE "prov-flow-finder"
 
-/**
- * Find all memory operations that may have clobbered the location being
- * accessed by an Instruction.
- */
-static ValueSet ClobberersOf(Instruction *, MemorySSA &);
+STATISTIC(NumTrivialFunctions,
+          "Number of functions without both sources and sinks");
+STATISTIC(NumForwardFunctions, "Number of functions searched forward");
+STATISTIC(NumBackwardFunctions, "Number of functions searched backward");
+STATISTIC(NumBackwardExpansions,
+          "Number of values whose in-flows were found on demand");
 
-/**
- * Recursively walk backwards through MemoryPhi operations until we reach
- * MemoryDef operations and real Instruction values that clobber memory.
- */
-static ValueSet PhiClobberers(MemoryPhi *, MemorySSA &, ValueSet &Seen);
+typedef FlowFinder::ValueSet ValueSet;
 
+namespace {
+  enum class SearchEngine {
+    //! Depth-first search from each source in turn
+    DFS,
+
+    //! Bit-parallel propagation from many sources at once
+    Bitset,
+
+    //! Lookups in a cached closure over strongly-connected components
+    SCC,
+  };
+
+  cl::opt<SearchEngine> Engine("flow-engine",
+    cl::desc("engine for finding source-to-sink flows"),
+    cl::init(SearchEngine::SCC),
+    cl::values(
+      clEnumValN(SearchEngine::DFS, "dfs", "depth-first search per source"),
+      clEnumValN(SearchEngine::Bitset, "bitset",
+                 "bit-parallel multi-source propagation"),
+      clEnumValN(SearchEngine::SCC, "scc",
+                 "cached sink closure over strongly-connected components")
+    )
+  );
+
+  enum class SearchDirection {
+    //! Choose a direction based on the numbers of sources and sinks
+    Auto,
+
+    //! Build the whole pairwise graph and search forward from sources
+    Forward,
+
+    //! Search backward from sinks, finding flows into values on demand
+    Backward,
+  };
 
-FlowFinder::FlowSet
+  cl::opt<bool> LazyForward("flow-lazy", cl::init(true),
+    cl::desc("only find pairwise flows reachable from sources when "
+             "searching forward"));
+
+  cl::opt<SearchDirection> Direction("flow-direction",
+    cl::desc("direction in which to search for source-to-sink flows"),
+    cl::init(SearchDirection::Auto),
+    cl::values(
+      clEnumValN(SearchDirection::Auto, "auto",
+                 "backward iff there are no more sinks than sources"),
+      clEnumValN(SearchDirection::Forward, "forward",
+                 "forward from sources over the full pairwise graph"),
+      clEnumValN(SearchDirection::Backward, "backward",
+                 "backward from sinks, on demand")
+    )
+  );
+}
+
+const FlowGraph&
 FlowFinder::FindPairwise(Function &Fn, MemorySSA& MSSA) {
-  FlowFinder::FlowSet Flows;
+  ClobberCache &Clobbers = StartFunction(MSSA);
+  FlowGraph::Builder Flows(Fn);
+
+  for (auto &A : Fn.args()) {
+    Flows.AddNode(&A);
+  }
 
   for (auto &I : instructions(Fn)) {
-    CollectPairwise(&I, MSSA, Flows);
+    Flows.AddNode(&I);
+    CollectPairwise(&I, Clobbers, Flows);
+  }
+
+  return SetPairs(Flows.Build());
+}
+
+const FlowGraph&
+FlowFinder::FindReachable(Function &Fn, MemorySSA &MSSA,
+                          ArrayRef<Value*> Sources) {
+  ClobberCache &Clobbers = StartFunction(MSSA);
+  FlowGraph::Builder Flows(Fn);
+
+  SmallPtrSet<Value*, 32> Seen;
+  SmallVector<Value*, 32> Worklist;
+
+  for (Value *Source : Sources) {
+    Flows.AddNode(Source);
+
+    if (Seen.insert(Source).second) {
+      Worklist.push_back(Source);
+    }
+  }
+
+  while (not Worklist.empty()) {
+    Value *V = Worklist.pop_back_val();
+
+    ForEachFlowFrom(V, Clobbers, [&](Value *Dest, FlowKind Kind) {
+      Flows.AddFlow(V, Dest, Kind);
+
+      if (Seen.insert(Dest).second) {
+        Worklist.push_back(Dest);
+      }
+    });
   }
 
-  return Flows;
+  return SetPairs(Flows.Build());
+}
+
+ClobberCache& FlowFinder::StartFunction(MemorySSA &MSSA) {
+  Clobbers.reset(new ClobberCache(MSSA));
+  return *Clobbers;
+}
+
+const FlowGraph& FlowFinder::SetPairs(FlowGraph &&G) {
+  Handles.clear();
+  Tracking = false;
+
+  Pairs.reset(new FlowGraph(std::move(G)));
+  SeenEpoch.assign(Pairs->NumNodes(), 0);
+  SearchEpoch = 0;
+  HaveSinkNodes = false;
+  Closure.reset();
+
+  return *Pairs;
+}
+
+void FlowFinder::TrackChanges()
+{
+  const FlowGraph &G = Flows();
+
+  Handles.clear();
+  Handles.reserve(G.NumNodes());
+
+  for (FlowGraph::NodeID N = 0; N < G.NumNodes(); N++) {
+    Handles.emplace_back(G.ValueOf(N), *this);
+  }
+
+  Tracking = true;
+}
+
+void FlowFinder::Inserted(Instruction *I)
+{
+  assert(Pairs && "Inserted() called before FindPairwise()");
+
+  Pairs->AddNode(I);
+
+  for (Value *Operand : I->operand_values()) {
+    if (Pairs->Contains(Operand)) {
+      Pairs->AddFlow(Operand, I, FlowKind::Operand);
+    }
+  }
+
+  for (User *U : I->users()) {
+    if (Pairs->Contains(U)) {
+      Pairs->AddFlow(I, U, FlowKind::Operand);
+    }
+  }
+
+  if (Tracking) {
+    Handles.emplace_back(I, *this);
+  }
+
+  Changed();
+}
+
+const FlowGraph& FlowFinder::Flows()
+{
+  assert(Pairs && "Flows() called before FindPairwise()");
+
+  if (Pairs->NeedsCompaction()) {
+    Pairs->Compact();
+    SeenEpoch.assign(Pairs->NumNodes(), 0);
+    SearchEpoch = 0;
+  }
+
+  return *Pairs;
+}
+
+std::unique_ptr<FlowGraph> FlowFinder::ReleaseFlows()
+{
+  Flows();
+
+  Handles.clear();
+  Tracking = false;
+  HaveSinkNodes = false;
+  Closure.reset();
+
+  return std::move(Pairs);
+}
+
+void FlowFinder::Changed()
+{
+  // MemorySSA doesn't see our changes, so its clobber information is stale.
+  Clobbers.reset();
+  HaveSinkNodes = false;
+  Closure.reset();
+}
+
+void FlowFinder::FlowHandle::deleted()
+{
+  FF->Pairs->Erase(getValPtr());
+  FF->Changed();
+  setValPtr(nullptr);
+}
+
+void FlowFinder::FlowHandle::allUsesReplacedWith(Value *New)
+{
+  // If the replacement already has a node, it has a handle of its own.
+  bool Follow = (isa<Argument>(New) or isa<Instruction>(New))
+    and not FF->Pairs->Contains(New);
+
+  FF->Pairs->Replace(getValPtr(), New);
+
+  // The replacement may have operands that the original didn't have
+  // (e.g., an extended call's extra arguments).
+  if (auto *I = dyn_cast<Instruction>(New)) {
+    for (Value *Operand : I->operand_values()) {
+      if (FF->Pairs->Contains(Operand)) {
+        FF->Pairs->AddFlow(Operand, I, FlowKind::Operand);
+      }
+    }
+  }
+
+  FF->Changed();
+  setValPtr(Follow ? New : nullptr);
 }
 
 FlowFinder::ValueSet
-FlowFinder::FindEventual(const FlowSet& Pairs, Value *Source, ValuePredicate F)
+FlowFinder::FindEventual(Value *Source, ValuePredicate F)
+{
+  assert(Pairs && "FindEventual() called before FindPairwise()");
+  Flows();
+
+  std::vector<FlowGraph::NodeID> Sinks;
+
+  if (Pairs->Contains(Source)) {
+    ResetSeen();
+    CollectEventual(Sinks, Pairs->NodeOf(Source), [&](FlowGraph::NodeID N) {
+      return F(Pairs->ValueOf(N));
+    });
+  }
+
+  return ValuesOf(std::move(Sinks));
+}
+
+std::vector<FlowFinder::ValueSet>
+FlowFinder::FindEventual(ArrayRef<Value*> Sources, ValuePredicate F)
 {
-  ValueSet Seen, Sinks;
+  assert(Pairs && "FindEventual() called before FindPairwise()");
+  Flows();
+
+  BitVector Sinks(Pairs->NumNodes());
+  for (FlowGraph::NodeID N = 0; N < Pairs->NumNodes(); N++) {
+    if (F(Pairs->ValueOf(N))) {
+      Sinks.set(N);
+    }
+  }
+
+  return FindEventual(Sources, Sinks);
+}
+
+std::vector<FlowFinder::ValueSet>
+FlowFinder::FindSinks(ArrayRef<Value*> Sources)
+{
+  assert(Pairs && "FindSinks() called before FindPairwise()");
+  Flows();
+
+  if (not HaveSinkNodes) {
+    SinkNodes.reset();
+    SinkNodes.resize(Pairs->NumNodes());
+
+    for (FlowGraph::NodeID N = 0; N < Pairs->NumNodes(); N++) {
+      if (IsSink(Pairs->ValueOf(N))) {
+        SinkNodes.set(N);
+      }
+    }
+
+    HaveSinkNodes = true;
+  }
+
+  return FindEventual(Sources, SinkNodes);
+}
+
+std::vector<FlowFinder::ValueSet>
+FlowFinder::FindEventual(ArrayRef<Value*> Sources, const BitVector &SinkNodes)
+{
+  std::vector<ValueSet> Sinks(Sources.size());
+
+  if (Engine == SearchEngine::DFS) {
+    for (size_t i = 0; i < Sources.size(); i++) {
+      if (not Pairs->Contains(Sources[i])) {
+        continue;
+      }
+
+      std::vector<FlowGraph::NodeID> Nodes;
+
+      ResetSeen();
+      CollectEventual(Nodes, Pairs->NodeOf(Sources[i]),
+                      [&](FlowGraph::NodeID N) { return SinkNodes.test(N); });
+      Sinks[i] = ValuesOf(std::move(Nodes));
+    }
+
+    return Sinks;
+  }
+
+  if (Engine == SearchEngine::SCC) {
+    if (not Closure or Closure->Sinks() != SinkNodes) {
+      Closure.reset(new SinkClosure(*Pairs, SinkNodes));
+    }
+
+    for (size_t i = 0; i < Sources.size(); i++) {
+      if (not Pairs->Contains(Sources[i])) {
+        continue;
+      }
 
-  // Reverse mapping: (Src -> (Sink, Kind)) rather than (Sink -> (Src, Kind))
-  FlowSet SrcToSink;
-  for (auto i : Pairs) {
-    Value *Dest = i.first;
-    Value *Src = i.second.first;
-    FlowKind Kind = i.second.second;
+      FlowGraph::NodeID Source = Pairs->NodeOf(Sources[i]);
+      Sinks[i] = ValuesOf(Closure->SinksFrom(Source));
+    }
+
+    return Sinks;
+  }
 
-    SrcToSink.insert({ Src, { Dest, Kind }});
+  // Sources that aren't in the graph don't flow anywhere.
+  std::vector<FlowGraph::NodeID> Nodes;
+  std::vector<size_t> Indices;
+
+  for (size_t i = 0; i < Sources.size(); i++) {
+    if (Pairs->Contains(Sources[i])) {
+      Nodes.push_back(Pairs->NodeOf(Sources[i]));
+      Indices.push_back(i);
+    }
   }
 
-  CollectEventual(Sinks, Seen, SrcToSink, Source, F);
+  auto Reached = BitReachability(*Pairs, SinkNodes).SinksFrom(Nodes);
+
+  for (size_t i = 0; i < Reached.size(); i++) {
+    Sinks[Indices[i]] = ValuesOf(std::move(Reached[i]));
+  }
 
   return Sinks;
 }
 
-void FlowFinder::CollectEventual(ValueSet &Sinks, ValueSet &Seen,
-                                 const FlowSet &Pairs, Value *Source,
-                                 ValuePredicate F)
+std::vector<FlowFinder::WitnessPath>
+FlowFinder::FindWitnesses(Value *Source, ArrayRef<Value*> Sinks)
 {
-  Seen.insert(Source);
+  assert(Pairs && "FindWitnesses() called before FindPairwise()");
+  Flows();
 
-  auto Range = Pairs.equal_range(Source);
-  for (auto i = Range.first; i != Range.second; i++) {
-    Value *Dest = i->second.first;
-    assert(Dest != Source);
+  std::vector<WitnessPath> Paths(Sinks.size());
+  if (not Pairs->Contains(Source)) {
+    return Paths;
+  }
 
-    if (Seen.find(Dest) != Seen.end()) {
+  DenseSet<FlowGraph::NodeID> Wanted;
+  for (Value *Sink : Sinks) {
+    if (Pairs->Contains(Sink)) {
+      Wanted.insert(Pairs->NodeOf(Sink));
+    }
+  }
+
+  const FlowGraph::NodeID Start = Pairs->NodeOf(Source);
+  Wanted.erase(Start);
+
+  // Parents are only meaningful for nodes seen by this search, so there's
+  // no need to clear them between searches.
+  if (Parents.size() < Pairs->NumNodes()) {
+    Parents.resize(Pairs->NumNodes(), FlowGraph::Edge(0, FlowKind::Operand));
+  }
+
+  size_t Remaining = Wanted.size();
+  std::vector<FlowGraph::NodeID> Queue = { Start };
+
+  ResetSeen();
+  SeenEpoch[Start] = SearchEpoch;
+
+  for (size_t Head = 0; Head < Queue.size() and Remaining > 0; Head++) {
+    FlowGraph::NodeID Current = Queue[Head];
+
+    for (FlowGraph::Edge E : Pairs->Successors(Current)) {
+      FlowGraph::NodeID Dest = E.Node();
+
+      if (SeenEpoch[Dest] == SearchEpoch) {
+        continue;
+      }
+
+      SeenEpoch[Dest] = SearchEpoch;
+      Parents[Dest] = FlowGraph::Edge(Current, E.Kind());
+
+      if (Wanted.count(Dest)) {
+        Remaining--;
+      }
+
+      Queue.push_back(Dest);
+    }
+  }
+
+  for (size_t i = 0; i < Sinks.size(); i++) {
+    if (not Pairs->Contains(Sinks[i])) {
+      continue;
+    }
+
+    FlowGraph::NodeID N = Pairs->NodeOf(Sinks[i]);
+    if (N == Start or SeenEpoch[N] != SearchEpoch) {
       continue;
     }
 
-    if (F(Dest)) {
-      Sinks.emplace(Dest);
+    WitnessPath &Path = Paths[i];
+    for (; N != Start; N = Parents[N].Node()) {
+      Path.push_back({ Parents[N].Kind(), Pairs->ValueOf(N) });
     }
 
-    CollectEventual(Sinks, Seen, Pairs, Dest, F);
+    std::reverse(Path.begin(), Path.end());
   }
+
+  return Paths;
+}
+
+bool FlowFinder::IsSink(const Value *V) const
+{
+  if (auto *Call = dyn_cast<CallInst>(V)) {
+    if (CS.CanSink(Call)) {
+      return true;
+    }
+
+    if (Summaries) {
+      const FlowSummary *S = Summaries->Lookup(Call);
+      return S and S->CanSink();
+    }
+  }
+
+  return false;
+}
+
+bool FlowFinder::FlowsInto(const Value *Operand, const User *Dest) const
+{
+  if (Summaries) {
+    if (auto *Call = dyn_cast<CallInst>(Dest)) {
+      return Summaries->FlowsThrough(Call, Operand);
+    }
+  }
+
+  return true;
+}
+
+void FlowFinder::ResetSeen()
+{
+  // Only clear the marks explicitly when the epoch counter wraps around.
+  if (++SearchEpoch == 0) {
+    std::fill(SeenEpoch.begin(), SeenEpoch.end(), 0);
+    SearchEpoch = 1;
+  }
+}
+
+ValueSet FlowFinder::ValuesOf(std::vector<FlowGraph::NodeID> Nodes) const
+{
+  // Nodes are numbered in function order.
+  std::sort(Nodes.begin(), Nodes.end());
+
+  ValueSet Values;
+  for (FlowGraph::NodeID N : Nodes) {
+    Values.insert(Pairs->ValueOf(N));
+  }
+
+  return Values;
 }
 
 void
-FlowFinder::CollectPairwise(Value *V, MemorySSA &MSSA, FlowSet& Flows) const {
+FlowFinder::CollectEventual(std::vector<FlowGraph::NodeID> &Sinks,
+                            FlowGraph::NodeID Source,
+                            function_ref<bool (FlowGraph::NodeID)> IsSinkNode)
+{
+  // Iterative depth-first search: def-use chains in generated code can be
+  // far too long to recurse along.
+  SmallVector<FlowGraph::NodeID, 32> Stack;
+
+  SeenEpoch[Source] = SearchEpoch;
+  Stack.push_back(Source);
+
+  while (not Stack.empty()) {
+    FlowGraph::NodeID Current = Stack.pop_back_val();
+
+    for (FlowGraph::Edge E : Pairs->Successors(Current)) {
+      FlowGraph::NodeID Dest = E.Node();
+      assert(Dest != Current);
+
+      if (SeenEpoch[Dest] == SearchEpoch) {
+        continue;
+      }
+
+      SeenEpoch[Dest] = SearchEpoch;
+
+      if (IsSinkNode(Dest)) {
+        Sinks.push_back(Dest);
+      }
+
+      Stack.push_back(Dest);
+    }
+  }
+}
+
+void FlowFinder::CollectPairwise(Value *V, ClobberCache &Clobbers,
+                                 FlowGraph::Builder &Flows) const {
+  ForEachFlowInto(V, Clobbers, [&](Value *Src, FlowKind Kind) {
+    Flows.AddFlow(Src, V, Kind);
+  });
+}
+
+void FlowFinder::ForEachFlowInto(Value *V, ClobberCache &Clobbers,
+                                 function_ref<void (Value*, FlowKind)> F)
+  const {
 
   auto *Dest = dyn_cast<User>(V);
   if (not Dest) {
     return;
   }
 
-  // Ignore constants and already-considered nodes.
-  if (isa<Constant>(Dest) or Flows.find(Dest) != Flows.end()) {
+  // Ignore constants.
+  if (isa<Constant>(Dest)) {
     return;
   }
 
@@ -138,7 +590,9 @@ FlowFinder::CollectPairwise(Value *V, MemorySSA &MSSA, FlowSet& Flows) const {
       continue;
     }
 
-    Flows.insert({ Dest, { Operand, FlowKind::Operand }});
+    if (FlowsInto(Operand, Dest)) {
+      F(Operand, FlowKind::Operand);
+    }
   }
 
   // Load instructions have an implicit dependency on instructions that have
@@ -146,15 +600,202 @@ FlowFinder::CollectPairwise(Value *V, MemorySSA &MSSA, FlowSet& Flows) const {
   // an Instruction, and if it has significance to MemorySSA, and if that
   // significance is that it's a MemoryUse, figure out who clobbered the memory.
   if (auto *Inst = dyn_cast<Instruction>(Dest)) {
-    for (Value *V : ClobberersOf(Inst, MSSA)) {
-      Flows.insert({ Dest, { V, FlowKind::Memory }});
+    for (Value *Clobberer : Clobbers.ClobberersOf(Inst)) {
+      F(Clobberer, FlowKind::Memory);
+    }
+  }
+}
+
+void FlowFinder::ForEachFlowFrom(Value *V, ClobberCache &Clobbers,
+                                 function_ref<void (Value*, FlowKind)> F)
+  const {
+
+  MemorySSA &MSSA = Clobbers.getMSSA();
+
+  // Explicit Value-User flows: every (non-constant) user of V.
+  for (User *U : V->users()) {
+    if (isa<Instruction>(U) and FlowsInto(V, U)) {
+      F(U, FlowKind::Operand);
+    }
+  }
+
+  // Only instructions that write to memory can flow into later accesses.
+  auto *I = dyn_cast<Instruction>(V);
+  auto *Def = I ? dyn_cast_or_null<MemoryDef>(MSSA.getMemoryAccess(I))
+                : nullptr;
+
+  if (not Def) {
+    return;
+  }
+
+  // Walk forward from this MemoryDef through MemorySSA uses to find the
+  // accesses that it might clobber, then check each candidate against its
+  // actual clobberers. A MemoryUse's defining access is already its
+  // clobbering access (once MemorySSA has optimized it), so uses that we can
+  // only reach through another MemoryDef need not be checked; other defs
+  // may look past the defs in between, so they're always checked.
+  struct Step {
+    MemoryAccess *Access;
+    bool ThroughDef;
+  };
+
+  SmallVector<Step, 16> Worklist = { { Def, false } };
+  SmallPtrSet<MemoryAccess*, 16> Visited[2];
+  SmallPtrSet<Instruction*, 16> Checked;
+
+  auto Check = [&](Instruction *Candidate) {
+    if (Candidate == I or not Checked.insert(Candidate).second) {
+      return;
+    }
+
+    if (is_contained(Clobbers.ClobberersOf(Candidate), I)) {
+      F(Candidate, FlowKind::Memory);
+    }
+  };
+
+  while (not Worklist.empty()) {
+    Step Current = Worklist.pop_back_val();
+
+    for (User *U : Current.Access->users()) {
+      if (auto *Use = dyn_cast<MemoryUse>(U)) {
+        if (not Current.ThroughDef or not Use->isOptimized()) {
+          Check(Use->getMemoryInst());
+        }
+
+      } else if (auto *NextDef = dyn_cast<MemoryDef>(U)) {
+        Check(NextDef->getMemoryInst());
+
+        if (Visited[true].insert(NextDef).second) {
+          Worklist.push_back({ NextDef, true });
+        }
+
+      } else if (auto *Phi = dyn_cast<MemoryPhi>(U)) {
+        if (Visited[Current.ThroughDef].insert(Phi).second) {
+          Worklist.push_back({ Phi, Current.ThroughDef });
+        }
+      }
+    }
+  }
+}
+
+std::vector<FlowFinder::ValueSet>
+FlowFinder::FindSinks(Function &Fn, MemorySSA &MSSA,
+                      ArrayRef<Value*> Sources)
+{
+  std::vector<Value*> Sinks;
+
+  for (auto &I : instructions(Fn)) {
+    if (IsSink(&I)) {
+      Sinks.push_back(&I);
+    }
+  }
+
+  if (Sources.empty() or Sinks.empty()) {
+    ++NumTrivialFunctions;
+    return std::vector<ValueSet>(Sources.size());
+  }
+
+  bool Backward = false;
+  switch (Direction) {
+  case SearchDirection::Auto:
+    Backward = (Sinks.size() <= Sources.size());
+    break;
+
+  case SearchDirection::Forward:
+    Backward = false;
+    break;
+
+  case SearchDirection::Backward:
+    Backward = true;
+    break;
+  }
+
+  if (Backward) {
+    ++NumBackwardFunctions;
+    return FindSinksBackward(StartFunction(MSSA), Sources, Sinks);
+  }
+
+  ++NumForwardFunctions;
+
+  if (LazyForward) {
+    FindReachable(Fn, MSSA, Sources);
+  } else {
+    FindPairwise(Fn, MSSA);
+  }
+
+  return FindSinks(Sources);
+}
+
+std::vector<FlowFinder::ValueSet>
+FlowFinder::FindSinksBackward(ClobberCache &Clobbers,
+                              ArrayRef<Value*> Sources, ArrayRef<Value*> Sinks)
+{
+  std::vector<ValueSet> Result(Sources.size());
+
+  DenseMap<const Value*, size_t> SourceIndex;
+  for (size_t i = 0; i < Sources.size(); i++) {
+    SourceIndex[Sources[i]] = i;
+  }
+
+  // Flows into each value, computed on demand and shared by all sinks.
+  DenseMap<Value*, SmallVector<Value*, 4>> InFlows;
+
+  DenseSet<Value*> Seen;
+  SmallVector<Value*, 32> Worklist;
+
+  for (Value *Sink : Sinks) {
+    size_t Remaining = SourceIndex.size();
+
+    Seen.clear();
+    Worklist.clear();
+
+    Seen.insert(Sink);
+    Worklist.push_back(Sink);
+
+    // Walk backwards from the sink until we've run out of values that
+    // flow into it or we've found every source.
+    while (not Worklist.empty() and Remaining > 0) {
+      Value *V = Worklist.pop_back_val();
+
+      auto i = InFlows.find(V);
+      if (i == InFlows.end()) {
+        ++NumBackwardExpansions;
+
+        SmallVector<Value*, 4> Preds;
+        ForEachFlowInto(V, Clobbers, [&Preds](Value *Src, FlowKind) {
+          Preds.push_back(Src);
+        });
+
+        i = InFlows.insert({ V, std::move(Preds) }).first;
+      }
+
+      for (Value *Pred : i->second) {
+        if (not Seen.insert(Pred).second) {
+          continue;
+        }
+
+        auto Source = SourceIndex.find(Pred);
+        if (Source != SourceIndex.end()) {
+          Result[Source->second].insert(Sink);
+          Remaining--;
+        }
+
+        Worklist.push_back(Pred);
+      }
     }
   }
+
+  return Result;
 }
 
-static void Describe(const Value *V, llvm::raw_ostream &Out) {
-  std::string Colour = "#eeeeee";
-  std::string Shape = "box";
+/**
+ * Describe a node in a GraphViz graph. Nodes are named by number rather
+ * than by address, so that the same graph is always described the same way.
+ */
+static void Describe(FlowGraph::NodeID N, const Value *V,
+                     ModuleSlotTracker &MST, llvm::raw_ostream &Out) {
+  const char *Colour = "#eeeeee";
+  const char *Shape = "box";
 
   if (isa<AllocaInst>(V)) {
     Colour = "#9999ff";
@@ -176,8 +817,8 @@ static void Describe(const Value *V, llvm::raw_ostream &Out) {
     Shape = "invhouse";
   }
 
-  Out << "\t\t\"" << V << "\" [ style = \"filled\", label = \"";
-  V->print(Out);
+  Out << "\t\tn" << N << " [ style = \"filled\", label = \"";
+  V->print(Out, MST);
   Out
     << "\", fillcolor = \"" << Colour << "99\""
     << ", shape = \"" << Shape << "\""
@@ -185,7 +826,7 @@ static void Describe(const Value *V, llvm::raw_ostream &Out) {
     ;
 }
 
-static std::string LineAttrs(FlowFinder::FlowKind Kind)
+static const char* LineAttrs(FlowFinder::FlowKind Kind)
 {
   switch (Kind) {
   case FlowFinder::FlowKind::Operand:
@@ -199,15 +840,44 @@ static std::string LineAttrs(FlowFinder::FlowKind Kind)
   }
 }
 
-static void Describe(const Value *Source, const Value *Dest,
+static void Describe(FlowGraph::NodeID Source, FlowGraph::NodeID Dest,
                      FlowFinder::FlowKind Kind, llvm::raw_ostream &Out)
 {
-  Out << "\t\"" << Source << "\" -> \"" << Dest << "\" " << LineAttrs(Kind)
+  Out << "\tn" << Source << " -> n" << Dest << " " << LineAttrs(Kind)
     << "\n"
     ;
 }
 
-void FlowFinder::Graph(const FlowSet& Flows, StringRef Label, bool ShowBBs,
+/**
+ * A slot tracker for printing the values in a graph.
+ *
+ * Printing a value on its own numbers every slot in its function; sharing
+ * one slot tracker means that the function is only numbered once per graph.
+ */
+static std::unique_ptr<ModuleSlotTracker>
+SlotTrackerFor(const FlowGraph &Flows)
+{
+  const Function *Fn = nullptr;
+  if (Flows.NumNodes() > 0) {
+    const Value *V = Flows.ValueOf(0);
+    if (auto *A = dyn_cast_or_null<Argument>(V)) {
+      Fn = A->getParent();
+    } else if (auto *I = dyn_cast_or_null<Instruction>(V)) {
+      Fn = I->getFunction();
+    }
+  }
+
+  std::unique_ptr<ModuleSlotTracker> MST(
+    new ModuleSlotTracker(Fn ? Fn->getParent() : nullptr));
+
+  if (Fn) {
+    MST->incorporateFunction(*Fn);
+  }
+
+  return MST;
+}
+
+void FlowFinder::Graph(const FlowGraph& Flows, StringRef Label, bool ShowBBs,
                        raw_ostream &Out) const {
   Out << "digraph {\n"
     << "\tfontname = \"Inconsolata\";\n"
@@ -216,43 +886,41 @@ void FlowFinder::Graph(const FlowSet& Flows, StringRef Label, bool ShowBBs,
     << "\n"
     ;
 
-  unordered_set<const Argument*> Args;
-  unordered_map<const BasicBlock*, unordered_set<const Instruction*>> Blocks;
-
-  auto SaveValue = [&Args, &Blocks](const Value *V) {
-    if (auto *I = dyn_cast<Instruction>(V)) {
-      Blocks[I->getParent()].insert(I);
+  // Only describe values that take part in at least one flow.
+  BitVector Described(Flows.NumNodes());
 
-    } else if (auto *A = dyn_cast<Argument>(V)) {
-      Args.insert(A);
+  for (FlowGraph::NodeID N = 0; N < Flows.NumNodes(); N++) {
+    for (FlowGraph::Edge E : Flows.Successors(N)) {
+      Described.set(N);
+      Described.set(E.Node());
 
-    } else {
-      assert(false && "unreachable");
+      Describe(N, E.Node(), E.Kind(), Out);
     }
-  };
+  }
 
-  for (auto& Flow : Flows) {
-    const Value *Dest = Flow.first;
-    const Value *Src = Flow.second.first;
-    const FlowKind Kind = Flow.second.second;
+  // Nodes are numbered in function order: arguments first, then instructions
+  // grouped contiguously by basic block.
+  const BasicBlock *CurrentBB = nullptr;
+  std::unique_ptr<ModuleSlotTracker> MST = SlotTrackerFor(Flows);
 
-    SaveValue(Src);
-    SaveValue(Dest);
+  for (int N : Described.set_bits()) {
+    const Value *V = Flows.ValueOf(N);
 
-    Describe(Src, Dest, Kind, Out);
-  }
-
-  for (auto *A : Args) {
-    Describe(A, Out);
-  }
+    auto *I = dyn_cast<Instruction>(V);
+    if (not I) {
+      assert(isa<Argument>(V) && "unreachable");
+      Describe(N, V, *MST, Out);
+      continue;
+    }
 
-  for (auto i : Blocks) {
-    const BasicBlock *BB = i.first;
-    auto &Instructions = i.second;
+    if (ShowBBs and I->getParent() != CurrentBB) {
+      if (CurrentBB) {
+        Out << "\t}\n";
+      }
 
-    if (ShowBBs) {
-      Out << "\tsubgraph \"cluster_" << BB->getName() << "\" {\n"
-        << "\t\tlabel = \"" << BB->getName() << "\";\n"
+      CurrentBB = I->getParent();
+      Out << "\tsubgraph \"cluster_" << CurrentBB->getName() << "\" {\n"
+        << "\t\tlabel = \"" << CurrentBB->getName() << "\";\n"
         << "\t\tlabeljust = \"l\";\n"
         << "\t\tstyle = \"filled\";\n"
         << "\t\tstyle = \"filled\";\n"
@@ -260,81 +928,64 @@ void FlowFinder::Graph(const FlowSet& Flows, StringRef Label, bool ShowBBs,
         ;
     }
 
-    for (auto *I : Instructions) {
-      Describe(I, Out);
-    }
+    Describe(N, I, *MST, Out);
+  }
 
-    if (ShowBBs) {
-      Out << "\t}\n";
-    }
+  if (CurrentBB) {
+    Out << "\t}\n";
   }
 
   Out << "}\n";
 }
 
-static ValueSet ClobberersOf(Instruction *I, MemorySSA &MSSA)
+void FlowFinder::Export(const FlowGraph &Flows, StringRef Function,
+                        raw_ostream &Out) const
 {
-  MemoryAccess *MA = MSSA.getMemoryAccess(I);
-  if (not MA) {
-    return {};
-  }
+  FlowGraphFile::Builder Builder(Function);
+  std::unique_ptr<ModuleSlotTracker> MST = SlotTrackerFor(Flows);
+  DenseMap<const BasicBlock*, uint32_t> Blocks;
+  std::string Label;
 
-  ValueSet Clobberers;
-  MemoryAccess *Clobberer = MSSA.getWalker()->getClobberingMemoryAccess(MA);
+  for (FlowGraph::NodeID N = 0; N < Flows.NumNodes(); N++) {
+    const Value *V = Flows.ValueOf(N);
+    uint32_t Block = FlowGraphFile::NoBlock;
+    uint8_t Flags = 0;
 
-  if (auto *Def = dyn_cast<MemoryDef>(Clobberer)) {
-    // The memory was written to by an easily-discernable instruction like
-    // a store that comes earlier in the function.
-    if (not MSSA.isLiveOnEntryDef(Def)) {
-      Clobberers.insert(Def->getMemoryInst());
+    if (auto *I = dyn_cast<Instruction>(V)) {
+      const BasicBlock *BB = I->getParent();
+      auto i = Blocks.find(BB);
+      if (i == Blocks.end()) {
+        i = Blocks.insert({ BB, Builder.AddBlock(BB->getName()) }).first;
+      }
+
+      Block = i->second;
+    } else {
+      Flags |= FlowGraphFile::ArgumentNode;
     }
 
-  } else if (auto *Phi = dyn_cast<MemoryPhi>(Clobberer)) {
-    // Is there a potentially more complex scenario in which multiple stores
-    // can clobber the memory location? If so, we'll need to (recursively)
-    // chase down all of the possible clobbering instructions.
-    ValueSet Seen;
-    for (Value *V : PhiClobberers(Phi, MSSA, Seen)) {
-      if (V != I) {
-        Clobberers.insert(V);
+    if (auto *Call = dyn_cast<CallInst>(V)) {
+      if (CS.IsSource(Call)) {
+        Flags |= FlowGraphFile::SourceNode;
       }
     }
-  }
 
-  return Clobberers;
-}
+    if (IsSink(V)) {
+      Flags |= FlowGraphFile::SinkNode;
+    }
 
+    Label.clear();
+    raw_string_ostream LabelOut(Label);
+    V->print(LabelOut, *MST);
+    LabelOut.flush();
 
-static ValueSet PhiClobberers(MemoryPhi *Phi, MemorySSA &MSSA, ValueSet &Seen)
-{
-  if (Seen.find(Phi) != Seen.end()) {
-    return {};
+    Builder.AddNode(StringRef(Label).ltrim(), Block, Flags);
   }
 
-  Seen.insert(Phi);
-  ValueSet Clobberers;
-
-  for (Use &U : Phi->incoming_values()) {
-    Value *V = U.get();
-
-    if (auto *SubPhi = dyn_cast<MemoryPhi>(V)) {
-      auto Sub = PhiClobberers(SubPhi, MSSA, Seen);
-      Clobberers.insert(Sub.begin(), Sub.end());
-      continue;
+  for (FlowGraph::NodeID N = 0; N < Flows.NumNodes(); N++) {
+    for (FlowGraph::Edge E : Flows.Successors(N)) {
+      Builder.AddFlow(N, E.Node(), E.Kind());
     }
-
-    auto *MD = dyn_cast<MemoryDef>(U.get());
-    assert(MD);
-
-    if (MSSA.isLiveOnEntryDef(MD)) {
-      continue;
-    }
-
-    assert(MD->getMemoryInst());
-    Clobberers.insert(MD->getMemoryInst());
   }
 
-  return Clobberers;
+  Builder.Write(Out);
 }
-
-
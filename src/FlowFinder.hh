@@ -33,17 +33,26 @@
 #ifndef LLVM_PROV_FLOW_FINDER_H
 #define LLVM_PROV_FLOW_FINDER_H
 
+#include "ClobberCache.hh"
+#include "FlowGraph.hh"
+#include "SinkClosure.hh"
+
+#include <llvm/ADT/BitVector.h>
+#include <llvm/ADT/STLExtras.h>
+#include <llvm/ADT/SetVector.h>
 #include <llvm/Analysis/AliasAnalysis.h>
+#include <llvm/IR/ValueHandle.h>
 #include <llvm/Support/raw_ostream.h>
 
 #include <functional>
-#include <map>
-#include <unordered_set>
+#include <memory>
+#include <vector>
 
 
 namespace llvm {
 
 class CallInst;
+class Instruction;
 class MemorySSA;
 class Module;
 class Value;
@@ -51,6 +60,7 @@ class Value;
 namespace prov {
 
 class CallSemantics;
+class FlowSummaries;
 
 /**
  * A type for discovering intraprocedural data flows.
@@ -61,70 +71,269 @@ class CallSemantics;
  */
 class FlowFinder {
 public:
-  FlowFinder(const CallSemantics &CS) : CS(CS) {}
+  /**
+   * Constructor.
+   *
+   * @param   Summaries    summaries to apply at calls to other functions
+   *                       (optional): a value passed to a summarized function
+   *                       only flows through the call if the summary says so,
+   *                       and calls that can pass a value to a sink are sinks
+   */
+  FlowFinder(const CallSemantics &CS,
+             const FlowSummaries *Summaries = nullptr)
+    : CS(CS), Summaries(Summaries)
+  {
+  }
 
   //! Ways that information can flow among Values
-  enum class FlowKind {
-    //! Direct operand relationship, e.g., a + b or gep x
-    Operand,
+  using FlowKind = prov::FlowKind;
 
-    //! Indirect flow through memory, e.g., from a store to a load
-    Memory,
+  /**
+   * Find all pairwise data flows within a function.
+   *
+   * The resulting graph is retained by this FlowFinder and serves as the
+   * flow index for subsequent @ref FindEventual queries, until the next
+   * call to FindPairwise.
+   */
+  const FlowGraph& FindPairwise(Function&, llvm::MemorySSA&);
+
+  /**
+   * A set of values that iterates in function order (arguments, then
+   * instructions), not in pointer order, so that the results of a query
+   * (and anything done with them) don't vary from run to run.
+   */
+  using ValueSet = SetVector<Value*>;
+  using ValuePredicate = std::function<bool (const Value*)>;
 
-    //! Summarization of a [possibly] multi-hop flow
-    Meta,
+  //! One step along a witness path: a flow of some kind into a value.
+  struct Hop {
+    FlowKind Kind;
+    Value *To;
   };
 
   /**
-   * A set of pairwise value-to-value flows.
-   *
-   * Each pairwise flow is an entry in the multimap of the form
-   * (Dest -> (Source, Kind)).
+   * A chain of flows that carries information from a source to a sink.
+   * The source itself isn't included: the first hop flows out of it and
+   * the last hop flows into the sink.
    */
-  using FlowSet = std::multimap<Value*, std::pair<Value*, FlowKind>>;
+  using WitnessPath = std::vector<Hop>;
 
-  //! Find all pairwise data flows within a function.
-  FlowSet FindPairwise(Function&, llvm::MemorySSA&);
-
-  using ValueSet = std::unordered_set<Value*>;
-  using ValuePredicate = std::function<bool (const Value*)>;
+  /**
+   * Find the pairwise data flows within a function that are reachable from
+   * a set of sources, without visiting the rest of the function.
+   *
+   * Flows are discovered forward from the sources: through the users of each
+   * value and, for instructions that write to memory, through MemorySSA uses
+   * to the accesses that they may clobber. Like @ref FindPairwise, the
+   * resulting graph is retained for subsequent @ref FindEventual queries,
+   * which give the same results for these sources as over the full graph.
+   */
+  const FlowGraph& FindReachable(Function&, llvm::MemorySSA&,
+                                 ArrayRef<Value*> Sources);
 
   /**
    * Find macro (not necessarily pairwise) flows within a procedure from a
    * source to the set of eventual sinks that satisfy a predicate.
    *
    * This method computes over the transitive closure of pairwise "flows-to"
-   * relations described in @b Pairs. When a flowed-to Value satisfies the 
-   * ValuePredicate P, it is added to the resulting ValueSet and the transitive
-   * closure operation continues; intermediate sinks are included in the result
-   * alongside final sinks. That is, in the following value chain:
+   * relations found by the most recent call to @ref FindPairwise. When a
+   * flowed-to Value satisfies the ValuePredicate P, it is added to the
+   * resulting ValueSet and the transitive closure operation continues;
+   * intermediate sinks are included in the result alongside final sinks.
+   * That is, in the following value chain:
    *
    * [Source] -> A -> B -> [Sink1] -> C -> D -> [Sink2]
    *
-   * `FindEventual(Pairs, Source, IsSink)` will return both Sink1 and Sink2.
+   * `FindEventual(Source, IsSink)` will return both Sink1 and Sink2.
+   */
+  ValueSet FindEventual(Value *Source, ValuePredicate P);
+
+  /**
+   * Find the eventual sinks of several sources at once.
+   *
+   * This is equivalent to calling @ref FindEventual for each source, but
+   * the predicate is evaluated once per value and all sources are searched
+   * together by the engine selected with `-flow-engine`. With the default
+   * (`scc`) engine, the sinks reachable from every value are computed once
+   * per function and set of sinks, and each query is then a lookup.
+   *
+   * @returns   one ValueSet per source, in the same order as @b Sources
+   */
+  std::vector<ValueSet> FindEventual(ArrayRef<Value*> Sources,
+                                     ValuePredicate P);
+
+  /**
+   * Find the eventual sinks of several sources, where sinks are the calls
+   * that our @ref CallSemantics says can act as sinks.
+   *
+   * The set of sink nodes is computed once per function and shared by
+   * all subsequent queries.
+   */
+  std::vector<ValueSet> FindSinks(ArrayRef<Value*> Sources);
+
+  /**
+   * Find the eventual sinks of a function's sources without necessarily
+   * building the function's full pairwise flow graph.
+   *
+   * Depending on `-flow-direction` and the numbers of sources and sinks in
+   * the function, this either searches forward from the sources over the
+   * graph built by @ref FindReachable (or, with `-flow-lazy=false`,
+   * @ref FindPairwise) or searches backward from each sink,
+   * finding the flows into each value only when the search reaches it and
+   * stopping as soon as every source has been found. Both directions give
+   * the same results as @ref FindSinks(ArrayRef<Value*>).
+   */
+  std::vector<ValueSet> FindSinks(Function&, MemorySSA&,
+                                  ArrayRef<Value*> Sources);
+
+  /**
+   * Explain how information flows from a source to each of a set of sinks.
+   *
+   * This searches breadth-first from the source over the graph built by
+   * the most recent call to @ref FindPairwise or @ref FindReachable,
+   * recording the flow by which each value is first reached. Following
+   * those flows back from a sink gives a shortest path to it, so explaining
+   * any number of sinks costs a single O(V+E) search, which stops as soon as
+   * every sink has been reached.
+   *
+   * @returns   one path per sink, in the same order as @b Sinks
+   *            (empty if the source doesn't flow to that sink)
+   */
+  std::vector<WitnessPath> FindWitnesses(Value *Source,
+                                         ArrayRef<Value*> Sinks);
+
+  /**
+   * Keep the current flow graph up to date as the IR is rewritten.
+   *
+   * Once tracking, a value in the graph that is replaced (e.g., by
+   * `replaceAllUsesWith` when instrumentation extends a call) hands its
+   * node over to its replacement, and a value that is deleted leaves behind
+   * the flows that passed through it. Together with @ref Inserted, this lets
+   * instrumented IR be queried without re-running the pairwise analysis.
    */
-  ValueSet FindEventual(const FlowSet& Pairs, Value *Source, ValuePredicate P);
+  void TrackChanges();
+
+  /**
+   * Add an instruction that has been inserted into the function, along with
+   * the operand flows into and out of it.
+   *
+   * MemorySSA is not updated when instrumentation inserts instructions,
+   * so flows through memory are not found for inserted instructions.
+   */
+  void Inserted(Instruction*);
+
+  //! The current flow graph, with any updates from tracked changes applied.
+  const FlowGraph& Flows();
+
+  //! Give up ownership of the current flow graph.
+  std::unique_ptr<FlowGraph> ReleaseFlows();
+
+  //! Is this value a call that can act as an information sink?
+  bool IsSink(const Value*) const;
 
   /**
    * Output a GraphViz dot representation of a set of pairwise flows.
    *
    * @param     ShowBBs      show basic blocks in the output graph structure
    */
-  void Graph(const FlowSet&, llvm::StringRef Label, bool ShowBBs,
+  void Graph(const FlowGraph&, llvm::StringRef Label, bool ShowBBs,
              llvm::raw_ostream&) const;
 
+  /**
+   * Output a set of pairwise flows in the binary @ref FlowGraphFile format,
+   * marking the sources and sinks that our @ref CallSemantics describe.
+   */
+  void Export(const FlowGraph&, llvm::StringRef Function,
+              llvm::raw_ostream&) const;
+
 private:
+  //! Updates the flow graph when a Value in it is replaced or deleted.
+  class FlowHandle final : public CallbackVH {
+  public:
+    FlowHandle(Value *V, FlowFinder &FF) : CallbackVH(V), FF(&FF) {}
+
+    void deleted() override;
+    void allUsesReplacedWith(Value*) override;
+
+  private:
+    FlowFinder *FF;
+  };
+
+  //! Discard anything computed from the flow graph before it changed.
+  void Changed();
+
   //! Collect pairwise information flows to @ref V.
-  void CollectPairwise(Value *V, MemorySSA&, FlowSet&) const;
+  void CollectPairwise(Value *V, ClobberCache&, FlowGraph::Builder&) const;
+
+  //! Call @b F with the source and kind of every pairwise flow into @b V.
+  void ForEachFlowInto(Value *V, ClobberCache&,
+                       function_ref<void (Value*, FlowKind)> F) const;
+
+  //! Call @b F with the destination and kind of every flow out of @b V.
+  void ForEachFlowFrom(Value *V, ClobberCache&,
+                       function_ref<void (Value*, FlowKind)> F) const;
+
+  //! Start analysing a new function: discard cached clobber information.
+  ClobberCache& StartFunction(MemorySSA&);
+
+  //! Make @b G the flow index for subsequent queries.
+  const FlowGraph& SetPairs(FlowGraph &&G);
+
+  //! Search backward from @b Sinks to find which of them @b Sources reach.
+  std::vector<ValueSet> FindSinksBackward(ClobberCache&,
+                                          ArrayRef<Value*> Sources,
+                                          ArrayRef<Value*> Sinks);
 
   /**
-   * Find all final sinks of information flows from @b Source that satisfy
-   * the predicate @b F.
+   * Find all final sinks of information flows from @b Source: nodes that
+   * satisfy the predicate @b IsSinkNode.
    */
-  void CollectEventual(ValueSet &Sinks, ValueSet &Seen, const FlowSet &Pairs,
-                       Value *Source, ValuePredicate F);
+  void CollectEventual(std::vector<FlowGraph::NodeID> &Sinks,
+                       FlowGraph::NodeID Source,
+                       function_ref<bool (FlowGraph::NodeID)> IsSinkNode);
+
+  //! The values of nodes in @ref Pairs, in function order.
+  ValueSet ValuesOf(std::vector<FlowGraph::NodeID> Nodes) const;
+
+  //! Find the eventual sinks of several sources, given a sink bitmap.
+  std::vector<ValueSet> FindEventual(ArrayRef<Value*> Sources,
+                                     const BitVector &SinkNodes);
 
   const CallSemantics &CS;
+  const FlowSummaries *Summaries;
+
+  //! Does information flow from @b Operand into @b Dest?
+  bool FlowsInto(const Value *Operand, const User *Dest) const;
+
+  //! Clobber information for the function currently being analysed.
+  std::unique_ptr<ClobberCache> Clobbers;
+
+  //! Pairwise flows within the function currently being analysed.
+  std::unique_ptr<FlowGraph> Pairs;
+
+  //! Nodes in @ref Pairs that @ref IsSink (computed on first use).
+  BitVector SinkNodes;
+  bool HaveSinkNodes = false;
+
+  //! Sinks reachable from every node in @ref Pairs (computed on first use).
+  std::unique_ptr<SinkClosure> Closure;
+
+  //! Handles on the values in @ref Pairs (see @ref TrackChanges).
+  std::vector<FlowHandle> Handles;
+  bool Tracking = false;
+
+  /**
+   * Search marks: a node has been seen by the current search iff its entry
+   * is equal to @ref SearchEpoch. Bumping the epoch clears all marks at once.
+   */
+  std::vector<uint32_t> SeenEpoch;
+  uint32_t SearchEpoch = 0;
+
+  //! The flow by which @ref FindWitnesses first reached each seen node.
+  std::vector<FlowGraph::Edge> Parents;
+
+  //! Start a new search over @ref Pairs, clearing all previous marks.
+  void ResetSeen();
 };
 
 } // namespace prov
@@ -0,0 +1,374 @@
+//! @file FlowGraph.cc  Definition of @ref llvm::prov::FlowGraph.
+/*
+ * Copyright (c) 2017 Jonathan Anderson
+ * All rights reserved.
+ *
+ * This software was developed by BAE Systems, the University of Cambridge
+ * Computer Laboratory, and Memorial University under DARPA/AFRL contract
+ * FA8650-15-C-7558 ("CADETS"), as part of the DARPA Transparent Computing
+ * (TC) research program.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "FlowGraph.hh"
+
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/Statistic.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/InstIterator.h>
+
+#include <algorithm>
+
+using namespace llvm;
+using namespace llvm::prov;
+
+#define DEBUG_TYPE "prov-flow-graph"
+
+STATISTIC(NumGraphs, "Number of flow graphs built");
+STATISTIC(NumGraphNodes, "Number of values in flow graphs");
+STATISTIC(NumGraphEdges, "Number of distinct pairwise flows");
+STATISTIC(NumDuplicates, "Number of duplicate pairwise flows discarded");
+STATISTIC(GraphBytes, "Bytes of memory used by flow graphs");
+STATISTIC(NumCompactions, "Number of in-place flow graph updates");
+STATISTIC(MultimapBytes,
+          "Bytes that std::multimap-based flow sets would have used");
+
+using NodeID = FlowGraph::NodeID;
+using Edge = FlowGraph::Edge;
+
+
+/**
+ * Pack (Src, Dest, Kind) into a single word that sorts by source node,
+ * then by destination node, then by kind.
+ */
+static uint64_t PackFlow(NodeID Src, Edge E) {
+  return (static_cast<uint64_t>(Src) << 32) | E.Raw();
+}
+
+static NodeID FlowSource(uint64_t Flow) { return Flow >> 32; }
+
+static Edge FlowDest(uint64_t Flow) {
+  uint32_t Raw = Flow & UINT32_MAX;
+  return Edge(Raw >> Edge::KindBits,
+              static_cast<FlowKind>(Raw & Edge::KindMask));
+}
+
+
+FlowGraph::Builder::Builder(const FlowGraph &G)
+  : Fn(G.getFunction())
+{
+  for (NodeID N = 0; N < G.NumNodes(); N++) {
+    Value *V = G.ValueOf(N);
+    Nodes.insert(V);
+
+    for (Edge E : G.Successors(N)) {
+      Flows.push_back({ V, G.ValueOf(E.Node()), E.Kind() });
+    }
+  }
+}
+
+void FlowGraph::Builder::AddNode(Value *V) {
+  assert((isa<Argument>(V) or isa<Instruction>(V)) && "not a local value");
+  Nodes.insert(V);
+}
+
+void FlowGraph::Builder::AddFlow(Value *Src, Value *Dest, FlowKind Kind) {
+  AddNode(Src);
+  AddNode(Dest);
+  Flows.push_back({ Src, Dest, Kind });
+}
+
+FlowGraph FlowGraph::Builder::Build() {
+  FlowGraph G(Fn);
+
+  // Number nodes densely, in function order.
+  G.Values.reserve(Nodes.size());
+  G.Index.reserve(Nodes.size());
+
+  auto Number = [&G, this](const Value &V) {
+    if (Nodes.count(&V) == 0) {
+      return;
+    }
+
+    G.Index[&V] = G.Values.size();
+    G.Values.push_back(const_cast<Value*>(&V));
+  };
+
+  for (const Argument &A : Fn.args()) {
+    Number(A);
+  }
+
+  for (const Instruction &I : instructions(Fn)) {
+    Number(I);
+  }
+
+  assert(G.Values.size() == Nodes.size() && "value not in function");
+
+  // Sort and de-duplicate the flows, then lay them out in CSR form.
+  std::vector<uint64_t> Packed;
+  Packed.reserve(Flows.size());
+
+  for (const PendingFlow &F : Flows) {
+    Packed.push_back(PackFlow(G.NodeOf(F.Src), Edge(G.NodeOf(F.Dest), F.Kind)));
+  }
+
+  G.Layout(Packed);
+
+  ++NumGraphs;
+  NumGraphNodes += G.NumNodes();
+  NumGraphEdges += G.NumEdges();
+  NumDuplicates += Flows.size() - G.NumEdges();
+  GraphBytes += G.MemoryUsage();
+
+  // Each std::multimap entry is a red-black tree node: three pointers and
+  // a colour alongside the (Dest, (Src, Kind)) payload.
+  MultimapBytes += Flows.size()
+    * (4 * sizeof(void*) + sizeof(std::pair<Value*, std::pair<Value*, int>>));
+
+  return G;
+}
+
+
+FlowGraph::NodeID FlowGraph::NodeOf(const Value *V) const {
+  auto i = Index.find(V);
+  assert(i != Index.end() && "value not in flow graph");
+  return i->second;
+}
+
+size_t FlowGraph::MemoryUsage() const {
+  return Values.capacity() * sizeof(Value*)
+    + Index.getMemorySize()
+    + (ForwardOffsets.capacity() + ReverseOffsets.capacity())
+      * sizeof(uint32_t)
+    + (Forward.capacity() + Reverse.capacity()) * sizeof(Edge)
+    ;
+}
+
+void FlowGraph::Replace(const Value *Old, Value *New) {
+  auto i = Index.find(Old);
+  if (i == Index.end()) {
+    return;
+  }
+
+  // Replacement with a constant leaves nothing for the flows to go through.
+  if (not isa<Argument>(New) and not isa<Instruction>(New)) {
+    Erase(Old);
+    return;
+  }
+
+  const NodeID N = i->second;
+  Index.erase(i);
+  Values[N] = nullptr;
+
+  // New may be elsewhere in the function, so renumber in any case.
+  auto j = Index.find(New);
+  if (j == Index.end()) {
+    Index[New] = N;
+    Values[N] = New;
+  } else {
+    Merged[N] = j->second;
+  }
+
+  Dirty = true;
+}
+
+void FlowGraph::Erase(const Value *V) {
+  auto i = Index.find(V);
+  if (i == Index.end()) {
+    return;
+  }
+
+  Values[i->second] = nullptr;
+  Index.erase(i);
+  Dirty = true;
+}
+
+void FlowGraph::AddNode(Value *V) {
+  assert((isa<Argument>(V) or isa<Instruction>(V)) && "not a local value");
+
+  if (Contains(V)) {
+    return;
+  }
+
+  Index[V] = Values.size();
+  Values.push_back(V);
+  Dirty = true;
+}
+
+void FlowGraph::AddFlow(Value *Src, Value *Dest, FlowKind Kind) {
+  AddNode(Src);
+  AddNode(Dest);
+  Added.push_back(PackFlow(NodeOf(Src), Edge(NodeOf(Dest), Kind)));
+  Dirty = true;
+}
+
+void FlowGraph::Compact() {
+  if (not Dirty) {
+    return;
+  }
+
+  // Gather the existing flows (in CSR form) and the added ones.
+  std::vector<uint64_t> Packed;
+  Packed.swap(Added);
+  Packed.reserve(Packed.size() + Forward.size());
+
+  for (NodeID N = 0; N + 1 < ForwardOffsets.size(); N++) {
+    for (Edge E : Row(Forward, ForwardOffsets, N)) {
+      Packed.push_back(PackFlow(N, E));
+    }
+  }
+
+  // Move the flows of merged nodes to the nodes that they were merged into.
+  if (not Merged.empty()) {
+    auto Resolve = [this](NodeID N) {
+      for (auto i = Merged.find(N); i != Merged.end(); i = Merged.find(N)) {
+        N = i->second;
+      }
+      return N;
+    };
+
+    for (uint64_t &F : Packed) {
+      Edge Dest = FlowDest(F);
+      F = PackFlow(Resolve(FlowSource(F)),
+                   Edge(Resolve(Dest.Node()), Dest.Kind()));
+    }
+  }
+
+  // Route flows around erased nodes. Erasure is rare (values that are
+  // replaced have already been handed over to their replacements), so
+  // a scan of all flows per erased node is acceptable.
+  for (NodeID D = 0; D < Values.size(); D++) {
+    if (Values[D] or Merged.count(D)) {
+      continue;
+    }
+
+    SmallVector<NodeID, 8> Preds;
+    SmallVector<NodeID, 8> Succs;
+    std::vector<uint64_t> Kept;
+    Kept.reserve(Packed.size());
+
+    for (uint64_t F : Packed) {
+      NodeID Src = FlowSource(F);
+      NodeID Dest = FlowDest(F).Node();
+
+      if (Src == D and Dest != D) {
+        Succs.push_back(Dest);
+      } else if (Dest == D and Src != D) {
+        Preds.push_back(Src);
+      } else if (Src != D) {
+        Kept.push_back(F);
+      }
+    }
+
+    for (NodeID P : Preds) {
+      for (NodeID S : Succs) {
+        if (P != S) {
+          Kept.push_back(PackFlow(P, Edge(S, FlowKind::Meta)));
+        }
+      }
+    }
+
+    Packed.swap(Kept);
+  }
+
+  // Renumber the remaining nodes in function order. Values that aren't (yet)
+  // in the function keep their relative order at the end.
+  std::vector<NodeID> Renumbered(Values.size(), Edge::MaxNode + 1);
+  std::vector<Value*> Live;
+  Live.reserve(Index.size());
+
+  auto Number = [&](NodeID Old) {
+    Renumbered[Old] = Live.size();
+    Live.push_back(Values[Old]);
+    Index[Values[Old]] = Renumbered[Old];
+  };
+
+  auto NumberValue = [&](const Value &V) {
+    auto i = Index.find(&V);
+    if (i != Index.end()) {
+      Number(i->second);
+    }
+  };
+
+  for (const Argument &A : Fn->args()) {
+    NumberValue(A);
+  }
+
+  for (const Instruction &I : instructions(*Fn)) {
+    NumberValue(I);
+  }
+
+  for (NodeID N = 0; N < Values.size(); N++) {
+    if (Values[N] and Renumbered[N] > Edge::MaxNode) {
+      Number(N);
+    }
+  }
+
+  for (uint64_t &F : Packed) {
+    Edge Dest = FlowDest(F);
+    F = PackFlow(Renumbered[FlowSource(F)],
+                 Edge(Renumbered[Dest.Node()], Dest.Kind()));
+  }
+
+  Values.swap(Live);
+  Merged.clear();
+  Layout(Packed);
+  Dirty = false;
+
+  ++NumCompactions;
+}
+
+void FlowGraph::Layout(std::vector<uint64_t> &Packed) {
+  std::sort(Packed.begin(), Packed.end());
+  Packed.erase(std::unique(Packed.begin(), Packed.end()), Packed.end());
+
+  const size_t NumValues = Values.size();
+  ForwardOffsets.assign(NumValues + 1, 0);
+  ReverseOffsets.assign(NumValues + 1, 0);
+
+  for (uint64_t F : Packed) {
+    ForwardOffsets[FlowSource(F) + 1]++;
+    ReverseOffsets[FlowDest(F).Node() + 1]++;
+  }
+
+  for (size_t i = 0; i < NumValues; i++) {
+    ForwardOffsets[i + 1] += ForwardOffsets[i];
+    ReverseOffsets[i + 1] += ReverseOffsets[i];
+  }
+
+  // Flows are sorted by source, so the forward edges can be copied straight
+  // across; reverse edges are scattered into place (and end up sorted by
+  // source within each row).
+  Forward.clear();
+  Forward.reserve(Packed.size());
+  Reverse.assign(Packed.size(), Edge(0, FlowKind::Operand));
+  std::vector<uint32_t> Fill(ReverseOffsets.begin(), ReverseOffsets.end());
+
+  for (uint64_t F : Packed) {
+    NodeID Src = FlowSource(F);
+    Edge Dest = FlowDest(F);
+
+    Forward.push_back(Dest);
+    Reverse[Fill[Dest.Node()]++] = Edge(Src, Dest.Kind());
+  }
+}
@@ -0,0 +1,249 @@
+//! @file FlowGraph.hh  Declaration of @ref llvm::prov::FlowGraph.
+/*
+ * Copyright (c) 2017 Jonathan Anderson
+ * All rights reserved.
+ *
+ * This software was developed by BAE Systems, the University of Cambridge
+ * Computer Laboratory, and Memorial University under DARPA/AFRL contract
+ * FA8650-15-C-7558 ("CADETS"), as part of the DARPA Transparent Computing
+ * (TC) research program.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef LLVM_PROV_FLOW_GRAPH_H
+#define LLVM_PROV_FLOW_GRAPH_H
+
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/DenseSet.h>
+
+#include <cstdint>
+#include <vector>
+
+
+namespace llvm {
+
+class Function;
+class Value;
+
+namespace prov {
+
+//! Ways that information can flow among Values
+enum class FlowKind : uint8_t {
+  //! Direct operand relationship, e.g., a + b or gep x
+  Operand,
+
+  //! Indirect flow through memory, e.g., from a store to a load
+  Memory,
+
+  //! Summarization of a [possibly] multi-hop flow
+  Meta,
+};
+
+
+/**
+ * A compact graph of the pairwise data flows within a function.
+ *
+ * Every Value in the graph is given a dense node number in function order
+ * (arguments first, then instructions in the order they appear). Flows are
+ * stored in compressed sparse row (CSR) form in both directions, so walking
+ * the flows out of or into a node is a scan over a contiguous array.
+ * Each edge packs the node at its far end together with its @ref FlowKind
+ * into a single 32-bit word, and duplicate edges are discarded when the graph
+ * is built.
+ *
+ * Use a @ref FlowGraph::Builder to construct a graph (possibly seeded from
+ * another graph). Once built, a graph can be kept up to date as the IR that
+ * it describes is rewritten (see @ref Replace, @ref Erase and @ref AddFlow)
+ * without having to re-discover any flows.
+ */
+class FlowGraph {
+public:
+  //! Dense, per-function identifier for a Value in the graph.
+  using NodeID = uint32_t;
+
+  //! One end of a pairwise flow: the node at the far end and the flow kind.
+  class Edge {
+  public:
+    Edge(NodeID N, FlowKind K)
+      : Bits((N << KindBits) | static_cast<uint32_t>(K))
+    {
+      assert(N <= MaxNode && "too many nodes in flow graph");
+    }
+
+    NodeID Node() const { return Bits >> KindBits; }
+    FlowKind Kind() const { return static_cast<FlowKind>(Bits & KindMask); }
+
+    //! The packed representation of this edge (node and kind).
+    uint32_t Raw() const { return Bits; }
+
+    bool operator == (const Edge &Other) const { return Bits == Other.Bits; }
+    bool operator < (const Edge &Other) const { return Bits < Other.Bits; }
+
+    static const unsigned KindBits = 2;
+    static const uint32_t KindMask = (1 << KindBits) - 1;
+    static const NodeID MaxNode = UINT32_MAX >> KindBits;
+
+  private:
+    uint32_t Bits;
+  };
+
+  /**
+   * Accumulates nodes and (possibly duplicated) flows and then packs them
+   * into an immutable @ref FlowGraph.
+   */
+  class Builder {
+  public:
+    Builder(const Function &F) : Fn(F) {}
+
+    //! Start with all of the nodes and flows in an existing graph.
+    explicit Builder(const FlowGraph&);
+
+    //! Add a Value (an Argument or Instruction in the function) to the graph.
+    void AddNode(Value*);
+
+    //! Add a flow from @b Src to @b Dest (adding nodes as required).
+    void AddFlow(Value *Src, Value *Dest, FlowKind);
+
+    //! Number the nodes in function order and pack the flows into a graph.
+    FlowGraph Build();
+
+  private:
+    struct PendingFlow {
+      Value *Src;
+      Value *Dest;
+      FlowKind Kind;
+    };
+
+    const Function &Fn;
+    DenseSet<const Value*> Nodes;
+    std::vector<PendingFlow> Flows;
+  };
+
+  FlowGraph(FlowGraph&&) = default;
+  FlowGraph& operator = (FlowGraph&&) = default;
+
+  //! The function that this graph describes.
+  const Function& getFunction() const { return *Fn; }
+
+  //! The number of nodes (Values) in the graph.
+  size_t NumNodes() const { return Values.size(); }
+
+  //! The number of distinct pairwise flows in the graph.
+  size_t NumEdges() const { return Forward.size(); }
+
+  //! Is this Value a node in the graph?
+  bool Contains(const Value *V) const { return Index.count(V) != 0; }
+
+  //! The node number of a Value (which must be in the graph).
+  NodeID NodeOf(const Value*) const;
+
+  //! The Value that a node represents.
+  Value* ValueOf(NodeID N) const { return Values[N]; }
+
+  //! Flows out of a node, i.e., nodes that @b N flows to.
+  ArrayRef<Edge> Successors(NodeID N) const {
+    assert(not Dirty && "flow graph has pending updates");
+    return Row(Forward, ForwardOffsets, N);
+  }
+
+  //! Flows into a node, i.e., nodes that flow to @b N.
+  ArrayRef<Edge> Predecessors(NodeID N) const {
+    assert(not Dirty && "flow graph has pending updates");
+    return Row(Reverse, ReverseOffsets, N);
+  }
+
+  //! Approximate number of bytes of heap memory used by this graph.
+  size_t MemoryUsage() const;
+
+  /**
+   * @b Old has been replaced by @b New (e.g., by `replaceAllUsesWith`):
+   * New takes over Old's node or, if it already has a node of its own,
+   * Old's flows are merged into it.
+   */
+  void Replace(const Value *Old, Value *New);
+
+  /**
+   * @b V is being deleted. Its node is removed by @ref Compact, but flows
+   * that passed through it are kept as @ref FlowKind::Meta flows from its
+   * predecessors to its successors.
+   */
+  void Erase(const Value *V);
+
+  //! Add a node for a Value that has been inserted into the function.
+  void AddNode(Value*);
+
+  //! Add a flow from @b Src to @b Dest (adding nodes as required).
+  void AddFlow(Value *Src, Value *Dest, FlowKind);
+
+  //! Are there updates that @ref Compact has yet to apply?
+  bool NeedsCompaction() const { return Dirty; }
+
+  /**
+   * Apply pending updates: drop erased nodes, renumber the remaining nodes
+   * in function order and re-pack the flows. This must be done before
+   * the graph's flows are next examined.
+   */
+  void Compact();
+
+private:
+  FlowGraph(const Function &F) : Fn(&F) {}
+
+  //! Sort and de-duplicate packed flows and lay them out in CSR form.
+  void Layout(std::vector<uint64_t> &Packed);
+
+  static ArrayRef<Edge> Row(const std::vector<Edge> &Edges,
+                            const std::vector<uint32_t> &Offsets, NodeID N) {
+    assert(N + 1 < Offsets.size());
+    return makeArrayRef(Edges.data() + Offsets[N], Edges.data() + Offsets[N+1]);
+  }
+
+  const Function *Fn;
+
+  //! Node number -> Value
+  std::vector<Value*> Values;
+
+  //! Value -> node number
+  DenseMap<const Value*, NodeID> Index;
+
+  //! CSR adjacency: Src -> (Dest, Kind)
+  std::vector<uint32_t> ForwardOffsets;
+  std::vector<Edge> Forward;
+
+  //! CSR adjacency: Dest -> (Src, Kind)
+  std::vector<uint32_t> ReverseOffsets;
+  std::vector<Edge> Reverse;
+
+  //! Packed flows added since the graph was last compacted.
+  std::vector<uint64_t> Added;
+
+  //! Nodes whose flows are to be merged into another node's.
+  DenseMap<NodeID, NodeID> Merged;
+
+  bool Dirty = false;
+};
+
+} // namespace prov
+} // namespace llvm
+
+#endif // LLVM_PROV_FLOW_GRAPH_H
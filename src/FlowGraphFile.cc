@@ -0,0 +1,421 @@
+//! @file FlowGraphFile.cc  Definition of @ref llvm::prov::FlowGraphFile.
+/*
+ * Copyright (c) 2017 Jonathan Anderson
+ * All rights reserved.
+ *
+ * This software was developed by BAE Systems, the University of Cambridge
+ * Computer Laboratory, and Memorial University under DARPA/AFRL contract
+ * FA8650-15-C-7558 ("CADETS"), as part of the DARPA Transparent Computing
+ * (TC) research program.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "FlowGraphFile.hh"
+
+#include <llvm/Support/MathExtras.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <algorithm>
+#include <cstring>
+
+using namespace llvm;
+using namespace llvm::prov;
+using std::string;
+
+
+namespace {
+  //! The header of a graph file.
+  struct GraphHeader {
+    uint32_t Magic;
+    uint32_t Version;
+    uint32_t NumNodes;
+    uint32_t NumEdges;
+    uint32_t NumBlocks;
+    uint32_t NumSources;
+    uint32_t NumSinks;
+    uint32_t NameOffset;      //!< in the string table
+    uint32_t NameLength;
+    uint32_t StringsOffset;   //!< from the start of the file
+    uint32_t StringsSize;
+  };
+
+  struct GraphNode {
+    uint32_t LabelOffset;
+    uint32_t LabelLength;
+    uint32_t Block;
+    uint32_t Flags;
+  };
+
+  struct GraphBlock {
+    uint32_t NameOffset;
+    uint32_t NameLength;
+  };
+
+  //! "PFLG" in native byte order: graphs are written for the host.
+  const uint32_t GraphMagic = 0x474c4650;
+  const uint32_t GraphVersion = 1;
+
+  /**
+   * The layout of a graph file: the header, then nodes, blocks, edge offsets
+   * (one per node plus one), edges, sources, sinks and finally strings.
+   */
+  struct Layout {
+    const GraphHeader *Header;
+    const GraphNode *Nodes;
+    const GraphBlock *Blocks;
+    const uint32_t *EdgeOffsets;
+    const FlowGraph::Edge *Edges;
+    const uint32_t *Sources;
+    const uint32_t *Sinks;
+    const char *Strings;
+
+    Layout(StringRef Data)
+      : Header(reinterpret_cast<const GraphHeader*>(Data.data())),
+        Nodes(reinterpret_cast<const GraphNode*>(Header + 1)),
+        Blocks(reinterpret_cast<const GraphBlock*>(
+          Nodes + Header->NumNodes)),
+        EdgeOffsets(reinterpret_cast<const uint32_t*>(
+          Blocks + Header->NumBlocks)),
+        Edges(reinterpret_cast<const FlowGraph::Edge*>(
+          EdgeOffsets + Header->NumNodes + 1)),
+        Sources(reinterpret_cast<const uint32_t*>(Edges + Header->NumEdges)),
+        Sinks(Sources + Header->NumSources),
+        Strings(Data.data() + Header->StringsOffset)
+    {
+    }
+
+    //! The size of everything before the string table.
+    static uint64_t StringsOffset(const GraphHeader &H) {
+      return sizeof(GraphHeader)
+        + uint64_t(H.NumNodes) * sizeof(GraphNode)
+        + uint64_t(H.NumBlocks) * sizeof(GraphBlock)
+        + (uint64_t(H.NumNodes) + 1) * sizeof(uint32_t)
+        + uint64_t(H.NumEdges) * sizeof(uint32_t)
+        + uint64_t(H.NumSources) * sizeof(uint32_t)
+        + uint64_t(H.NumSinks) * sizeof(uint32_t)
+        ;
+    }
+  };
+
+  static_assert(sizeof(FlowGraph::Edge) == sizeof(uint32_t),
+                "edges must be stored as packed 32-bit words");
+}
+
+
+const uint32_t FlowGraphFile::NoBlock;
+
+uint32_t FlowGraphFile::Builder::AddString(StringRef S)
+{
+  uint32_t Offset = Strings.size();
+  Strings += S;
+  return Offset;
+}
+
+uint32_t FlowGraphFile::Builder::AddBlock(StringRef Name)
+{
+  Blocks.emplace_back(AddString(Name), Name.size());
+  return Blocks.size() - 1;
+}
+
+FlowGraphFile::NodeID FlowGraphFile::Builder::AddNode(StringRef Label,
+                                                      uint32_t Block,
+                                                      uint8_t Flags)
+{
+  assert((Block == NoBlock or Block < Blocks.size()) && "invalid block");
+
+  Node N;
+  N.Label = AddString(Label);
+  N.LabelLength = Label.size();
+  N.Block = Block;
+  N.Flags = Flags;
+  Nodes.push_back(N);
+
+  return Nodes.size() - 1;
+}
+
+void FlowGraphFile::Builder::AddFlow(NodeID Src, NodeID Dest, FlowKind Kind)
+{
+  assert(Src < Nodes.size() and Dest < Nodes.size() && "invalid node");
+  Flows.emplace_back(Src, Edge(Dest, Kind));
+}
+
+void FlowGraphFile::Builder::Write(raw_ostream &Out) const
+{
+  // Pack flows into rows by source, discarding duplicates.
+  auto Sorted = Flows;
+  std::sort(Sorted.begin(), Sorted.end());
+  Sorted.erase(std::unique(Sorted.begin(), Sorted.end()), Sorted.end());
+
+  std::vector<uint32_t> Offsets(Nodes.size() + 1);
+  for (auto &F : Sorted) {
+    Offsets[F.first + 1]++;
+  }
+
+  for (size_t i = 1; i < Offsets.size(); i++) {
+    Offsets[i] += Offsets[i - 1];
+  }
+
+  std::vector<uint32_t> Sources, Sinks;
+  for (NodeID N = 0; N < Nodes.size(); N++) {
+    if (Nodes[N].Flags & SourceNode) {
+      Sources.push_back(N);
+    }
+
+    if (Nodes[N].Flags & SinkNode) {
+      Sinks.push_back(N);
+    }
+  }
+
+  string Strings = this->Strings;
+  const uint32_t NameOffset = Strings.size();
+  Strings += Function;
+
+  GraphHeader Header;
+  std::memset(&Header, 0, sizeof(Header));
+  Header.Magic = GraphMagic;
+  Header.Version = GraphVersion;
+  Header.NumNodes = Nodes.size();
+  Header.NumEdges = Sorted.size();
+  Header.NumBlocks = Blocks.size();
+  Header.NumSources = Sources.size();
+  Header.NumSinks = Sinks.size();
+  Header.NameOffset = NameOffset;
+  Header.NameLength = Function.size();
+  Header.StringsOffset = Layout::StringsOffset(Header);
+  Header.StringsSize = Strings.size();
+
+  auto Emit = [&Out](const void *Data, size_t Size) {
+    Out.write(static_cast<const char*>(Data), Size);
+  };
+
+  Emit(&Header, sizeof(Header));
+
+  for (const Node &N : Nodes) {
+    GraphNode GN = { N.Label, N.LabelLength, N.Block, N.Flags };
+    Emit(&GN, sizeof(GN));
+  }
+
+  for (auto &B : Blocks) {
+    GraphBlock GB = { B.first, B.second };
+    Emit(&GB, sizeof(GB));
+  }
+
+  Emit(Offsets.data(), Offsets.size() * sizeof(uint32_t));
+
+  for (auto &F : Sorted) {
+    uint32_t Raw = F.second.Raw();
+    Emit(&Raw, sizeof(Raw));
+  }
+
+  Emit(Sources.data(), Sources.size() * sizeof(uint32_t));
+  Emit(Sinks.data(), Sinks.size() * sizeof(uint32_t));
+  Out << Strings;
+}
+
+
+std::unique_ptr<FlowGraphFile> FlowGraphFile::Open(StringRef Data,
+                                                   string &Err)
+{
+  if (Data.size() < sizeof(GraphHeader)) {
+    Err = "graph is truncated";
+    return nullptr;
+  }
+
+  if (reinterpret_cast<uintptr_t>(Data.data()) % alignof(GraphHeader)) {
+    Err = "graph is misaligned";
+    return nullptr;
+  }
+
+  const GraphHeader &H = *reinterpret_cast<const GraphHeader*>(Data.data());
+
+  if (H.Magic != GraphMagic) {
+    Err = (H.Magic == ByteSwap_32(GraphMagic))
+      ? "graph was written on a host with a different byte order"
+      : "not a flow graph";
+    return nullptr;
+  }
+
+  if (H.Version != GraphVersion) {
+    Err = "unsupported graph version " + std::to_string(H.Version);
+    return nullptr;
+  }
+
+  const uint64_t StringsOffset = Layout::StringsOffset(H);
+
+  if (H.NumNodes > Edge::MaxNode or H.StringsOffset != StringsOffset
+      or StringsOffset + H.StringsSize > Data.size()) {
+    Err = "graph is truncated or corrupt";
+    return nullptr;
+  }
+
+  // Check all offsets and node numbers, so that queries needn't.
+  Layout L(Data);
+  auto InStrings = [&H](uint32_t Offset, uint32_t Length) {
+    return uint64_t(Offset) + Length <= H.StringsSize;
+  };
+  auto IsNode = [&H](uint32_t N) { return N < H.NumNodes; };
+
+  bool Valid = InStrings(H.NameOffset, H.NameLength)
+    and L.EdgeOffsets[0] == 0 and L.EdgeOffsets[H.NumNodes] == H.NumEdges;
+
+  for (uint32_t i = 0; Valid and i < H.NumNodes; i++) {
+    const GraphNode &N = L.Nodes[i];
+    Valid = InStrings(N.LabelOffset, N.LabelLength)
+      and (N.Block == NoBlock or N.Block < H.NumBlocks)
+      and L.EdgeOffsets[i] <= L.EdgeOffsets[i + 1];
+  }
+
+  for (uint32_t i = 0; Valid and i < H.NumBlocks; i++) {
+    Valid = InStrings(L.Blocks[i].NameOffset, L.Blocks[i].NameLength);
+  }
+
+  for (uint32_t i = 0; Valid and i < H.NumEdges; i++) {
+    Valid = IsNode(L.Edges[i].Node());
+  }
+
+  Valid = Valid
+    and std::all_of(L.Sources, L.Sources + H.NumSources, IsNode)
+    and std::all_of(L.Sinks, L.Sinks + H.NumSinks, IsNode);
+
+  if (not Valid) {
+    Err = "graph is corrupt";
+    return nullptr;
+  }
+
+  return std::unique_ptr<FlowGraphFile>(new FlowGraphFile(Data));
+}
+
+std::vector<std::unique_ptr<FlowGraphFile>>
+FlowGraphFile::LoadAll(StringRef Path, string &Err)
+{
+  std::vector<std::unique_ptr<FlowGraphFile>> Graphs;
+
+  auto Buffer = MemoryBuffer::getFile(Path, -1, false);
+  if (std::error_code EC = Buffer.getError()) {
+    Err = EC.message();
+    return Graphs;
+  }
+
+  std::shared_ptr<MemoryBuffer> Shared(std::move(*Buffer));
+  StringRef Data = Shared->getBuffer();
+
+  for (uint64_t Pos = 0; Pos < Data.size(); ) {
+    std::unique_ptr<FlowGraphFile> Graph = Open(Data.substr(Pos), Err);
+    if (not Graph) {
+      Err = "graph at offset " + std::to_string(Pos) + ": " + Err;
+      Graphs.clear();
+      return Graphs;
+    }
+
+    Graph->Buffer = Shared;
+    Pos += alignTo(Graph->Size(), 4);
+    Graphs.push_back(std::move(Graph));
+  }
+
+  return Graphs;
+}
+
+FlowGraphFile::FlowGraphFile(StringRef Data,
+                             std::shared_ptr<MemoryBuffer> Buffer)
+  : Data(Data), Buffer(std::move(Buffer))
+{
+}
+
+uint64_t FlowGraphFile::Size() const
+{
+  const GraphHeader &H = *Layout(Data).Header;
+  return uint64_t(H.StringsOffset) + H.StringsSize;
+}
+
+FlowGraphFile::~FlowGraphFile()
+{
+}
+
+StringRef FlowGraphFile::Function() const
+{
+  Layout L(Data);
+  return StringRef(L.Strings + L.Header->NameOffset, L.Header->NameLength);
+}
+
+size_t FlowGraphFile::NumNodes() const
+{
+  return Layout(Data).Header->NumNodes;
+}
+
+size_t FlowGraphFile::NumEdges() const
+{
+  return Layout(Data).Header->NumEdges;
+}
+
+StringRef FlowGraphFile::Label(NodeID N) const
+{
+  Layout L(Data);
+  assert(N < L.Header->NumNodes);
+
+  const GraphNode &Node = L.Nodes[N];
+  return StringRef(L.Strings + Node.LabelOffset, Node.LabelLength);
+}
+
+StringRef FlowGraphFile::Block(NodeID N) const
+{
+  Layout L(Data);
+  assert(N < L.Header->NumNodes);
+
+  uint32_t B = L.Nodes[N].Block;
+  if (B == NoBlock) {
+    return "";
+  }
+
+  return StringRef(L.Strings + L.Blocks[B].NameOffset,
+                   L.Blocks[B].NameLength);
+}
+
+uint8_t FlowGraphFile::Flags(NodeID N) const
+{
+  Layout L(Data);
+  assert(N < L.Header->NumNodes);
+
+  return L.Nodes[N].Flags;
+}
+
+ArrayRef<FlowGraphFile::Edge> FlowGraphFile::Successors(NodeID N) const
+{
+  Layout L(Data);
+  assert(N < L.Header->NumNodes);
+
+  return makeArrayRef(L.Edges + L.EdgeOffsets[N],
+                      L.Edges + L.EdgeOffsets[N + 1]);
+}
+
+ArrayRef<FlowGraphFile::NodeID> FlowGraphFile::Sources() const
+{
+  Layout L(Data);
+  return makeArrayRef(L.Sources, L.Header->NumSources);
+}
+
+ArrayRef<FlowGraphFile::NodeID> FlowGraphFile::Sinks() const
+{
+  Layout L(Data);
+  return makeArrayRef(L.Sinks, L.Header->NumSinks);
+}
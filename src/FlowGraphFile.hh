@@ -0,0 +1,173 @@
+//! @file FlowGraphFile.hh  Declaration of @ref llvm::prov::FlowGraphFile.
+/*
+ * Copyright (c) 2017 Jonathan Anderson
+ * All rights reserved.
+ *
+ * This software was developed by BAE Systems, the University of Cambridge
+ * Computer Laboratory, and Memorial University under DARPA/AFRL contract
+ * FA8650-15-C-7558 ("CADETS"), as part of the DARPA Transparent Computing
+ * (TC) research program.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef LLVM_PROV_FLOW_GRAPH_FILE_H
+#define LLVM_PROV_FLOW_GRAPH_FILE_H
+
+#include "FlowGraph.hh"
+
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/StringRef.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+
+namespace llvm {
+
+class MemoryBuffer;
+class raw_ostream;
+
+namespace prov {
+
+/**
+ * A function's data flow graph in a binary format that can be queried in
+ * place, without LLVM IR.
+ *
+ * A file holds the function's name, a label for every node (the printed
+ * Value) and the basic block that it belongs to, the flows out of each node
+ * in compressed sparse row form (with the same packed edges as a
+ * @ref FlowGraph) and the nodes that are information sources and sinks.
+ * All of these are fixed-size records or offsets into a string table, so
+ * a mapped file can be used without any parsing or copying.
+ */
+class FlowGraphFile {
+public:
+  using NodeID = FlowGraph::NodeID;
+  using Edge = FlowGraph::Edge;
+
+  //! Properties of a node.
+  enum NodeFlags : uint8_t {
+    ArgumentNode = 1,
+    SourceNode = 2,
+    SinkNode = 4,
+  };
+
+  //! The block of a node that isn't in any basic block (an argument).
+  static const uint32_t NoBlock = UINT32_MAX;
+
+  //! Accumulates a graph's nodes and flows and then writes them out.
+  class Builder {
+  public:
+    Builder(StringRef Function) : Function(Function) {}
+
+    //! Add a basic block, returning its index.
+    uint32_t AddBlock(StringRef Name);
+
+    //! Add a node (nodes are numbered in the order that they are added).
+    NodeID AddNode(StringRef Label, uint32_t Block, uint8_t Flags);
+
+    //! Add a flow between two nodes that have already been added.
+    void AddFlow(NodeID Src, NodeID Dest, FlowKind);
+
+    //! Write the graph in binary form.
+    void Write(raw_ostream&) const;
+
+  private:
+    struct Node {
+      uint32_t Label;
+      uint32_t LabelLength;
+      uint32_t Block;
+      uint8_t Flags;
+    };
+
+    uint32_t AddString(StringRef);
+
+    std::string Function;
+    std::string Strings;
+    std::vector<std::pair<uint32_t, uint32_t>> Blocks;
+    std::vector<Node> Nodes;
+    std::vector<std::pair<NodeID, Edge>> Flows;
+  };
+
+  /**
+   * Use a graph in place.
+   *
+   * The data must be 4-byte aligned and must outlive the graph. Every offset
+   * and node number in the graph is checked here, so queries needn't be.
+   *
+   * @returns the graph, or null (with a description in @b Err) if invalid
+   */
+  static std::unique_ptr<FlowGraphFile> Open(StringRef Data, std::string &Err);
+
+  /**
+   * Map a file of graphs (e.g., all of a module's graphs, one after another,
+   * each padded to a multiple of four bytes) into memory and use them
+   * in place.
+   *
+   * @returns the graphs, or none (with a description in @b Err) if any
+   *          graph in the file is invalid
+   */
+  static std::vector<std::unique_ptr<FlowGraphFile>>
+  LoadAll(StringRef Path, std::string &Err);
+
+  ~FlowGraphFile();
+
+  //! The name of the function that this graph describes.
+  StringRef Function() const;
+
+  size_t NumNodes() const;
+  size_t NumEdges() const;
+
+  //! A node's label: the Value that it represents, as printed in the IR.
+  StringRef Label(NodeID) const;
+
+  //! The name of a node's basic block (empty for arguments).
+  StringRef Block(NodeID) const;
+
+  //! A node's @ref NodeFlags.
+  uint8_t Flags(NodeID) const;
+
+  //! Flows out of a node.
+  ArrayRef<Edge> Successors(NodeID) const;
+
+  //! Nodes that are information sources, in node order.
+  ArrayRef<NodeID> Sources() const;
+
+  //! Nodes that are information sinks, in node order.
+  ArrayRef<NodeID> Sinks() const;
+
+private:
+  FlowGraphFile(StringRef Data, std::shared_ptr<MemoryBuffer> = nullptr);
+
+  //! The size of this graph's data (not including any padding).
+  uint64_t Size() const;
+
+  StringRef Data;
+  std::shared_ptr<MemoryBuffer> Buffer;
+};
+
+} // namespace prov
+} // namespace llvm
+
+#endif // LLVM_PROV_FLOW_GRAPH_FILE_H
@@ -0,0 +1,568 @@
+//! @file FlowSummary.cc  Definition of @ref llvm::prov::FlowSummary.
+/*
+ * Copyright (c) 2017 Jonathan Anderson
+ * All rights reserved.
+ *
+ * This software was developed by BAE Systems, the University of Cambridge
+ * Computer Laboratory, and Memorial University under DARPA/AFRL contract
+ * FA8650-15-C-7558 ("CADETS"), as part of the DARPA Transparent Computing
+ * (TC) research program.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "CallSemantics.hh"
+#include "DirectCalls.hh"
+#include "FlowFinder.hh"
+#include "FlowGraph.hh"
+#include "FlowSummary.hh"
+#include "SummaryIndex.hh"
+
+#include <llvm/ADT/Statistic.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/Metadata.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/ThreadPool.h>
+#include <llvm/Support/raw_ostream.h>
+
+using namespace llvm;
+using namespace llvm::prov;
+
+#define DEBUG_TYPE "prov-flow-summary"
+
+STATISTIC(NumSummaries, "Number of functions summarized");
+STATISTIC(NumSummaryRounds, "Number of rounds of (re-)summarizing functions");
+STATISTIC(NumSummaryLevels, "Number of levels of independent call graph SCCs");
+
+using NodeID = FlowGraph::NodeID;
+
+
+bool FlowSummary::ArgFlowsOut(unsigned i) const {
+  // Variadic arguments aren't summarized.
+  if (i >= ArgToReturn.size()) {
+    return true;
+  }
+
+  return ArgToReturn.test(i) or ArgToMemory.test(i) or ArgToSink.test(i);
+}
+
+bool FlowSummary::operator == (const FlowSummary &S) const {
+  return ArgToReturn == S.ArgToReturn
+    and ArgToMemory == S.ArgToMemory
+    and ArgToSink == S.ArgToSink
+    and SourceToArg == S.SourceToArg
+    and SourceToReturn == S.SourceToReturn
+    and External == S.External
+    ;
+}
+
+void FlowSummary::print(raw_ostream &Out) const {
+  for (unsigned i = 0; i < ArgToReturn.size(); i++) {
+    if (not ArgFlowsOut(i)) {
+      continue;
+    }
+
+    Out << "  arg " << i << " ->";
+
+    if (ArgToReturn.test(i)) {
+      Out << " return";
+    }
+
+    if (ArgToMemory.test(i)) {
+      Out << " memory";
+    }
+
+    if (ArgToSink.test(i)) {
+      Out << " sink";
+    }
+
+    Out << "\n";
+  }
+
+  if (IsSource()) {
+    Out << "  source ->";
+
+    if (SourceToReturn) {
+      Out << " return";
+    }
+
+    for (int i : SourceToArg.set_bits()) {
+      Out << " arg " << i;
+    }
+
+    Out << "\n";
+  }
+
+  for (const ExternalFlow &E : External) {
+    Out << "  ";
+
+    if (E.From == ExternalFlow::FromSource) {
+      Out << "source";
+    } else {
+      Out << "arg " << E.From;
+    }
+
+    Out << " -> external " << E.Callee << " arg " << E.Arg << "\n";
+  }
+}
+
+
+/**
+ * Could a write through this pointer be seen after the function returns?
+ * Writes to the function's own stack allocations can't be.
+ */
+static bool Escapes(const Value *Ptr) {
+  return not isa<AllocaInst>(Ptr->stripInBoundsOffsets());
+}
+
+namespace {
+  //! Everything that a walk over a function's flows can reach.
+  struct Reached {
+    explicit Reached(size_t NumNodes) : Nodes(NumNodes) {}
+
+    //! Nodes that the walk has been through.
+    BitVector Nodes;
+
+    bool Return = false;
+    bool Sink = false;
+    bool Memory = false;
+
+    //! Pointers through which reached values are written to memory.
+    SmallVector<const Value*, 4> Writes;
+
+    /**
+     * Arguments of functions defined elsewhere that reached values enter,
+     * here or in summarized callees (names are only valid while the
+     * callees' summaries are).
+     */
+    SmallVector<std::pair<StringRef, unsigned>, 4> External;
+  };
+}
+
+/**
+ * Walk the flows out of @b Starts, applying callee summaries at call sites:
+ * a value only flows through a call to a summarized function if the
+ * summary says that it can.
+ */
+static Reached Walk(const FlowGraph &G, ArrayRef<NodeID> Starts,
+                    const CallSemantics &CS, const FlowSummaries &Summaries)
+{
+  Reached R(G.NumNodes());
+  SmallVector<NodeID, 32> Worklist;
+
+  for (NodeID N : Starts) {
+    if (not R.Nodes.test(N)) {
+      R.Nodes.set(N);
+      Worklist.push_back(N);
+    }
+  }
+
+  // Record writes through any of a call's pointer operands that escape.
+  auto WritesThrough = [&R](const CallInst *Call) {
+    for (const Value *Arg : Call->arg_operands()) {
+      if (Arg->getType()->isPointerTy() and Escapes(Arg)) {
+        R.Memory = true;
+        R.Writes.push_back(Arg);
+      }
+    }
+  };
+
+  // Record the arguments of a call to a function that is defined elsewhere
+  // (and so can only be followed once its summary is known) that a value
+  // enters: the operands equal to the value or, if the value reaches the
+  // call through memory, any pointer that the callee might read it through.
+  auto ExternalArgs = [&R](const CallInst *Call, const Value *V,
+                           bool ByOperand) {
+    const Function *Callee = Call->getCalledFunction();
+    if (not Callee or not Callee->isDeclaration() or Callee->isIntrinsic()) {
+      return;
+    }
+
+    for (unsigned i = 0; i < Call->getNumArgOperands(); i++) {
+      const Value *Arg = Call->getArgOperand(i);
+
+      if (ByOperand ? (Arg == V) : Arg->getType()->isPointerTy()) {
+        R.External.emplace_back(Callee->getName(), i);
+      }
+    }
+  };
+
+  // Record the external flows of a summarized callee out of the arguments
+  // that a value enters (chosen as in ExternalArgs), in terms of the caller:
+  // flows into functions defined elsewhere may be several calls deep.
+  auto CalleeExternal = [&R](const CallInst *Call, const FlowSummary &S,
+                             const Value *V, bool ByOperand) {
+    for (const FlowSummary::ExternalFlow &E : S.External) {
+      if (E.From == FlowSummary::ExternalFlow::FromSource
+          or unsigned(E.From) >= Call->getNumArgOperands()) {
+        continue;
+      }
+
+      const Value *Arg = Call->getArgOperand(E.From);
+      if (ByOperand ? (Arg == V) : Arg->getType()->isPointerTy()) {
+        R.External.emplace_back(E.Callee, E.Arg);
+      }
+    }
+  };
+
+  while (not Worklist.empty()) {
+    NodeID N = Worklist.pop_back_val();
+    const Value *Src = G.ValueOf(N);
+
+    for (FlowGraph::Edge E : G.Successors(N)) {
+      const Value *Dest = G.ValueOf(E.Node());
+      const bool ByOperand = (E.Kind() == FlowKind::Operand);
+      bool Continue = true;
+
+      if (isa<ReturnInst>(Dest)) {
+        R.Return = true;
+
+      } else if (auto *Store = dyn_cast<StoreInst>(Dest)) {
+        const Value *Ptr = Store->getPointerOperand();
+
+        if (ByOperand and Store->getValueOperand() == Src and Escapes(Ptr)) {
+          R.Memory = true;
+          R.Writes.push_back(Ptr);
+        }
+
+      } else if (auto *Call = dyn_cast<CallInst>(Dest)) {
+        if (const FlowSummary *S = Summaries.Lookup(Call)) {
+          CalleeExternal(Call, *S, Src, ByOperand);
+
+          if (not ByOperand) {
+            // The callee reads memory that we have written to.
+            R.Sink |= S->CanSink();
+
+          } else {
+            bool Out = false, Stored = false;
+
+            for (unsigned i = 0; i < Call->getNumArgOperands(); i++) {
+              if (Call->getArgOperand(i) != Src) {
+                continue;
+              }
+
+              Out |= S->ArgFlowsOut(i);
+
+              if (i < S->ArgToSink.size()) {
+                R.Sink |= S->ArgToSink.test(i);
+                Stored |= S->ArgToMemory.test(i);
+              }
+            }
+
+            if (Stored) {
+              WritesThrough(Call);
+            }
+
+            Continue = Out;
+          }
+
+        } else if (CS.CanSink(Call)) {
+          R.Sink = true;
+
+        } else {
+          ExternalArgs(Call, Src, ByOperand);
+
+          if (ByOperand and not Call->onlyReadsMemory()) {
+            WritesThrough(Call);
+          }
+        }
+      }
+
+      if (Continue and not R.Nodes.test(E.Node())) {
+        R.Nodes.set(E.Node());
+        Worklist.push_back(E.Node());
+      }
+    }
+  }
+
+  return R;
+}
+
+
+void FlowSummaries::Compute(Module &M, MemorySSAGetter GetMSSA,
+                            unsigned Threads)
+{
+  // Build every function's flow graph up front: MemorySSA comes from the
+  // pass manager, which can only be used serially. Summarizing only needs
+  // the (immutable) graphs and IR, so it can be done in parallel.
+  DenseMap<const Function*, std::unique_ptr<FlowGraph>> Graphs;
+  FlowFinder FF(CS);
+
+  for (Function &Fn : M) {
+    if (Fn.isDeclaration()) {
+      continue;
+    }
+
+    FF.FindPairwise(Fn, GetMSSA(Fn));
+    Graphs[&Fn] = FF.ReleaseFlows();
+    Summaries[&Fn] = FlowSummary(Fn.arg_size());
+  }
+
+  // Group the call graph's components into levels that only call into
+  // lower levels. Components within a level are independent of each other.
+  std::vector<std::vector<Function*>> Components = BottomUpSCCs(M);
+  std::vector<std::vector<size_t>> Levels;
+  DenseMap<const Function*, unsigned> LevelOf;
+
+  for (size_t i = 0; i < Components.size(); i++) {
+    unsigned Level = 0;
+
+    for (Function *Fn : Components[i]) {
+      for (Function *Callee : DirectCallees(*Fn)) {
+        auto j = LevelOf.find(Callee);
+        if (j != LevelOf.end()) {
+          Level = std::max(Level, j->second + 1);
+        }
+      }
+    }
+
+    for (Function *Fn : Components[i]) {
+      LevelOf[Fn] = Level;
+    }
+
+    if (Level >= Levels.size()) {
+      Levels.resize(Level + 1);
+    }
+
+    Levels[Level].push_back(i);
+  }
+
+  NumSummaryLevels += Levels.size();
+
+  // Every summary already has an entry, so summarizing never modifies the
+  // structure of the Summaries map, only the entries of the component being
+  // summarized (which no other component in the same level can see).
+  std::unique_ptr<ThreadPool> Pool(
+    Threads ? new ThreadPool(Threads) : new ThreadPool());
+
+  for (const std::vector<size_t> &Level : Levels) {
+    for (size_t i : Level) {
+      Pool->async([this, &Components, &Graphs, i]() {
+        Summarize(Components[i], Graphs);
+      });
+    }
+
+    Pool->wait();
+  }
+}
+
+void FlowSummaries::Summarize(ArrayRef<Function*> Component,
+                              const DenseMap<const Function*,
+                                             std::unique_ptr<FlowGraph>>
+                                &Graphs)
+{
+  // Summaries only grow as the summaries of recursive callees grow, so
+  // iterating until nothing changes reaches a fixed point.
+  bool Changed;
+
+  do {
+    Changed = false;
+    ++NumSummaryRounds;
+
+    for (Function *Fn : Component) {
+      FlowSummary New = Summarize(*Graphs.find(Fn)->second);
+      FlowSummary &Old = Summaries.find(Fn)->second;
+
+      if (New != Old) {
+        Old = std::move(New);
+        Changed = true;
+      }
+    }
+  } while (Changed);
+
+  NumSummaries += Component.size();
+}
+
+//! Put a summary's external flows in order, without duplicates.
+static void SortExternal(FlowSummary &S)
+{
+  std::sort(S.External.begin(), S.External.end());
+  S.External.erase(std::unique(S.External.begin(), S.External.end()),
+                   S.External.end());
+}
+
+FlowSummary FlowSummaries::Summarize(const FlowGraph &G) const
+{
+  const Function &Fn = G.getFunction();
+  FlowSummary S(Fn.arg_size());
+
+  // Where can each argument's value flow to?
+  std::vector<BitVector> FromArg;
+
+  for (const Argument &A : Fn.args()) {
+    const unsigned i = A.getArgNo();
+
+    if (not G.Contains(&A)) {
+      FromArg.emplace_back(G.NumNodes());
+      continue;
+    }
+
+    Reached R = Walk(G, G.NodeOf(&A), CS, *this);
+    S.ArgToReturn[i] = R.Return;
+    S.ArgToMemory[i] = R.Memory;
+    S.ArgToSink[i] = R.Sink;
+    FromArg.push_back(std::move(R.Nodes));
+
+    for (auto &E : R.External) {
+      S.External.push_back({ E.first.str(), E.second, int(i) });
+    }
+  }
+
+  // Where can the output of sources (including calls to functions that are
+  // themselves sources) flow to?
+  std::vector<NodeID> Sources;
+  SmallVector<const Value*, 4> Writes;
+
+  for (NodeID N = 0; N < G.NumNodes(); N++) {
+    auto *Call = dyn_cast<CallInst>(G.ValueOf(N));
+    if (not Call) {
+      continue;
+    }
+
+    if (CS.IsSource(Call)) {
+      Sources.push_back(N);
+
+      for (const Value *Output : CS.CallOutputs(Call)) {
+        if (Output != Call and Escapes(Output)) {
+          Writes.push_back(Output);
+        }
+      }
+
+    } else if (const FlowSummary *Callee = Lookup(Call)) {
+      if (not Callee->IsSource()) {
+        continue;
+      }
+
+      Sources.push_back(N);
+
+      // The callee's own sources flow into functions defined elsewhere.
+      for (const FlowSummary::ExternalFlow &E : Callee->External) {
+        if (E.From == FlowSummary::ExternalFlow::FromSource) {
+          S.External.push_back(E);
+        }
+      }
+
+      for (int i : Callee->SourceToArg.set_bits()) {
+        const Value *Output = Call->getArgOperand(i);
+        if (Escapes(Output)) {
+          Writes.push_back(Output);
+        }
+      }
+    }
+  }
+
+  if (Sources.empty()) {
+    SortExternal(S);
+    return S;
+  }
+
+  Reached R = Walk(G, Sources, CS, *this);
+  S.SourceToReturn = R.Return;
+  Writes.append(R.Writes.begin(), R.Writes.end());
+
+  for (auto &E : R.External) {
+    S.External.push_back({ E.first.str(), E.second,
+                           FlowSummary::ExternalFlow::FromSource });
+  }
+
+  SortExternal(S);
+
+  // Attribute each write to the arguments that the pointer comes from.
+  for (const Value *Ptr : Writes) {
+    for (const Argument &A : Fn.args()) {
+      const unsigned i = A.getArgNo();
+
+      if (Ptr == &A or
+          (G.Contains(Ptr) and FromArg[i].test(G.NodeOf(Ptr)))) {
+        S.SourceToArg.set(i);
+      }
+    }
+  }
+
+  return S;
+}
+
+const FlowSummary* FlowSummaries::Lookup(const Function *Fn) const {
+  auto i = Summaries.find(Fn);
+  return (i == Summaries.end()) ? nullptr : &i->second;
+}
+
+const FlowSummary* FlowSummaries::Lookup(const CallInst *Call) const {
+  const Function *Target = Call->getCalledFunction();
+  return Target ? Lookup(Target) : nullptr;
+}
+
+bool FlowSummaries::FlowsThrough(const CallInst *Call,
+                                 const Value *Operand) const {
+  const FlowSummary *S = Lookup(Call);
+  if (not S) {
+    return true;
+  }
+
+  for (unsigned i = 0; i < Call->getNumArgOperands(); i++) {
+    if (Call->getArgOperand(i) == Operand and S->ArgFlowsOut(i)) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void FlowSummaries::print(raw_ostream &Out, const Module &M) const {
+  for (const Function &Fn : M) {
+    if (const FlowSummary *S = Lookup(&Fn)) {
+      Out << "Flow summary for '" << Fn.getName() << "':\n";
+      S->print(Out);
+    }
+  }
+}
+
+void FlowSummaries::Import(const Module &M, const SummaryIndex &Index) {
+  for (const Function &Fn : M) {
+    if (not Fn.isDeclaration() or Fn.isIntrinsic()) {
+      continue;
+    }
+
+    if (const FlowSummary *S = Index.Lookup(Fn.getName())) {
+      Summaries[&Fn] = *S;
+    }
+  }
+}
+
+void FlowSummaries::Export(Module &M) const {
+  LLVMContext &Ctx = M.getContext();
+  NamedMDNode *Node = M.getOrInsertNamedMetadata(SummaryIndex::MetadataName);
+  Node->clearOperands();
+
+  for (const Function &Fn : M) {
+    if (Fn.isDeclaration() or Fn.hasLocalLinkage()) {
+      continue;
+    }
+
+    if (const FlowSummary *S = Lookup(&Fn)) {
+      Node->addOperand(MDTuple::get(Ctx, {
+        MDString::get(Ctx, Fn.getName()),
+        MDString::get(Ctx, EncodeSummary(*S)),
+      }));
+    }
+  }
+}
@@ -0,0 +1,201 @@
+//! @file FlowSummary.hh  Declaration of @ref llvm::prov::FlowSummary.
+/*
+ * Copyright (c) 2017 Jonathan Anderson
+ * All rights reserved.
+ *
+ * This software was developed by BAE Systems, the University of Cambridge
+ * Computer Laboratory, and Memorial University under DARPA/AFRL contract
+ * FA8650-15-C-7558 ("CADETS"), as part of the DARPA Transparent Computing
+ * (TC) research program.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef LLVM_PROV_FLOW_SUMMARY_H
+#define LLVM_PROV_FLOW_SUMMARY_H
+
+#include <llvm/ADT/BitVector.h>
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/STLExtras.h>
+
+#include <memory>
+#include <string>
+#include <tuple>
+#include <vector>
+
+
+namespace llvm {
+
+class CallInst;
+class Function;
+class MemorySSA;
+class Module;
+class Value;
+class raw_ostream;
+
+namespace prov {
+
+class CallSemantics;
+class FlowGraph;
+class SummaryIndex;
+
+/**
+ * A summary of the information flows through a function that matter to
+ * the function's callers.
+ *
+ * A summary can be applied at a call site in place of the callee's body:
+ * a caller needs to know which arguments flow out of the call (and where),
+ * but not how.
+ */
+struct FlowSummary {
+  FlowSummary(unsigned NumArgs = 0)
+    : ArgToReturn(NumArgs), ArgToMemory(NumArgs), ArgToSink(NumArgs),
+      SourceToArg(NumArgs)
+  {
+  }
+
+  //! Arguments whose values may flow to the return value.
+  BitVector ArgToReturn;
+
+  //! Arguments whose values may be stored to memory that outlives the call.
+  BitVector ArgToMemory;
+
+  //! Arguments whose values may reach a sink (here or in a callee).
+  BitVector ArgToSink;
+
+  //! Pointer arguments through which the output of a source may be written.
+  BitVector SourceToArg;
+
+  //! May the output of a source be returned?
+  bool SourceToReturn = false;
+
+  //! A flow into an argument of a function that is defined elsewhere.
+  struct ExternalFlow {
+    //! Where the flow comes from: an argument number or a source.
+    enum : int { FromSource = -1 };
+
+    std::string Callee;
+    unsigned Arg;
+    int From;
+
+    bool operator < (const ExternalFlow &E) const {
+      return std::tie(Callee, Arg, From) < std::tie(E.Callee, E.Arg, E.From);
+    }
+
+    bool operator == (const ExternalFlow &E) const {
+      return Callee == E.Callee and Arg == E.Arg and From == E.From;
+    }
+  };
+
+  /**
+   * Flows into the arguments of functions that are only declared in this
+   * module, here or in the functions that we call, sorted: these can't be
+   * followed until the callees' summaries are known (see @ref SummaryIndex).
+   */
+  std::vector<ExternalFlow> External;
+
+  //! Can a value passed as argument @b i flow out of the call?
+  bool ArgFlowsOut(unsigned i) const;
+
+  //! Can a call to this function act as an information sink?
+  bool CanSink() const { return ArgToSink.any(); }
+
+  //! Can a call to this function act as an information source?
+  bool IsSource() const { return SourceToReturn or SourceToArg.any(); }
+
+  bool operator == (const FlowSummary&) const;
+  bool operator != (const FlowSummary &S) const { return not (*this == S); }
+
+  void print(raw_ostream&) const;
+};
+
+/**
+ * Flow summaries for all of the functions defined in a module.
+ *
+ * Summaries are computed bottom-up over the strongly-connected components of
+ * the direct call graph, so each function is summarized once using the
+ * summaries of the functions that it calls (iterating to a fixed point
+ * within recursive components). Components that don't call each other are
+ * summarized in parallel.
+ */
+class FlowSummaries {
+public:
+  using MemorySSAGetter = function_ref<MemorySSA& (Function&)>;
+
+  FlowSummaries(const CallSemantics &CS) : CS(CS) {}
+
+  /**
+   * Summarize every function defined in a module.
+   *
+   * @param   GetMSSA    MemorySSA for a function (only called serially,
+   *                     and only used until the next call)
+   * @param   Threads    number of threads to summarize with (0: one per core)
+   */
+  void Compute(Module&, MemorySSAGetter GetMSSA, unsigned Threads = 0);
+
+  //! The summary of a function, or nullptr if it has no summary.
+  const FlowSummary* Lookup(const Function*) const;
+
+  //! The summary of a call's target, or nullptr for unsummarized calls.
+  const FlowSummary* Lookup(const CallInst*) const;
+
+  /**
+   * Can @b Operand (an argument of @b Call) flow out of the call?
+   *
+   * This is only false if the call's target has a summary that says
+   * the operand goes nowhere that its caller can see.
+   */
+  bool FlowsThrough(const CallInst *Call, const Value *Operand) const;
+
+  void print(raw_ostream&, const Module&) const;
+
+  /**
+   * Use summaries from other modules for the functions that a module
+   * declares (e.g., from a combined @ref SummaryIndex).
+   *
+   * This must be done before @ref Compute.
+   */
+  void Import(const Module&, const SummaryIndex&);
+
+  /**
+   * Embed the summaries of the functions that a module exports in the
+   * module's metadata, for link-time combination.
+   */
+  void Export(Module&) const;
+
+private:
+  //! Summarize a function using the current summaries of its callees.
+  FlowSummary Summarize(const FlowGraph&) const;
+
+  //! Summarize a strongly-connected component of the call graph.
+  void Summarize(ArrayRef<Function*> Component,
+                 const DenseMap<const Function*,
+                                std::unique_ptr<FlowGraph>> &Graphs);
+
+  const CallSemantics &CS;
+  DenseMap<const Function*, FlowSummary> Summaries;
+};
+
+} // namespace prov
+} // namespace llvm
+
+#endif // LLVM_PROV_FLOW_SUMMARY_H
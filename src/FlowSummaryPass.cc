@@ -0,0 +1,117 @@
+//! @file FlowSummaryPass.cc  @b opt pass to summarize flows between functions
+/*
+ * Copyright (c) 2017 Jonathan Anderson
+ * All rights reserved.
+ *
+ * This software was developed by BAE Systems, the University of Cambridge
+ * Computer Laboratory, and Memorial University under DARPA/AFRL contract
+ * FA8650-15-C-7558 ("CADETS"), as part of the DARPA Transparent Computing
+ * (TC) research program.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "CallSemantics.hh"
+#include "FlowSummary.hh"
+#include "SummaryIndex.hh"
+
+#include <llvm/Pass.h>
+#include <llvm/Analysis/MemorySSA.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/raw_ostream.h>
+
+using namespace llvm;
+using namespace llvm::prov;
+
+
+namespace llvm {
+  struct FlowSummaryPass : public ModulePass {
+    static char ID;
+    FlowSummaryPass() : ModulePass(ID) {}
+
+    bool runOnModule(Module&) override;
+    void print(raw_ostream&, const Module*) const override;
+
+    void getAnalysisUsage(AnalysisUsage &AU) const override {
+      AU.setPreservesAll();
+      AU.addRequired<MemorySSAWrapperPass>();
+    }
+
+    std::unique_ptr<CallSemantics> Resolved;
+    std::unique_ptr<FlowSummaries> Summaries;
+  };
+}
+
+namespace {
+  cl::opt<unsigned> SummaryThreads("flow-summary-threads", cl::init(0),
+    cl::desc("number of threads to compute flow summaries with "
+             "(default: one per core)"),
+    cl::value_desc("N"));
+
+  cl::opt<std::string> SummaryIndexFile("flow-summary-index",
+    cl::desc("combined summaries of functions defined in other modules "
+             "(from prov-summaries)"),
+    cl::value_desc("file"));
+}
+
+
+bool FlowSummaryPass::runOnModule(Module &M)
+{
+  Resolved = CallSemantics::Default().Resolve(M);
+  Summaries.reset(new FlowSummaries(*Resolved));
+
+  if (not SummaryIndexFile.empty()) {
+    auto Buffer = MemoryBuffer::getFile(SummaryIndexFile);
+    SummaryIndex Index;
+    std::string Err;
+
+    if (std::error_code EC = Buffer.getError()) {
+      errs() << "Error reading '" << SummaryIndexFile << "': "
+        << EC.message() << "\n";
+    } else if (not Index.Read((*Buffer)->getBuffer(), Err)) {
+      errs() << "Error reading '" << SummaryIndexFile << "': " << Err << "\n";
+    } else {
+      Summaries->Import(M, Index);
+    }
+  }
+
+  Summaries->Compute(M, [this](Function &Fn) -> MemorySSA& {
+    return getAnalysis<MemorySSAWrapperPass>(Fn).getMSSA();
+  }, SummaryThreads);
+
+  return false;
+}
+
+void FlowSummaryPass::print(raw_ostream &Out, const Module *M) const
+{
+  if (Summaries and M) {
+    Summaries->print(Out, *M);
+  }
+}
+
+char FlowSummaryPass::ID = 0;
+
+static RegisterPass<FlowSummaryPass> X("flow-summaries",
+                                       "Interprocedural flow summaries",
+                                       false, true);
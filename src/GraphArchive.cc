@@ -0,0 +1,322 @@
+//! @file GraphArchive.cc  Definition of @ref llvm::prov::GraphArchive.
+/*
+ * Copyright (c) 2017 Jonathan Anderson
+ * All rights reserved.
+ *
+ * This software was developed by BAE Systems, the University of Cambridge
+ * Computer Laboratory, and Memorial University under DARPA/AFRL contract
+ * FA8650-15-C-7558 ("CADETS"), as part of the DARPA Transparent Computing
+ * (TC) research program.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#include "GraphArchive.hh"
+
+#include <llvm/ADT/SmallString.h>
+#include <llvm/ADT/Statistic.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MD5.h>
+#include <llvm/Support/Path.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#if defined(LLVM_PROV_HAVE_ZSTD)
+#include <zstd.h>
+#endif
+
+using namespace llvm;
+using namespace llvm::prov;
+using std::string;
+
+#define DEBUG_TYPE "prov-graph-archive"
+
+STATISTIC(NumArchivedFiles, "Number of files written to graph archives");
+STATISTIC(NumArchivedBytes, "Number of (uncompressed) bytes archived");
+STATISTIC(NumWriterStalls, "Number of times we waited for the archive writer");
+
+
+namespace {
+  //! Size of a tar block: headers and contents are padded to this size.
+  const size_t BlockSize = 512;
+
+  //! The most data to queue before waiting for the writer to catch up.
+  const size_t MaxQueuedBytes = 64 << 20;
+}
+
+#if defined(LLVM_PROV_HAVE_ZSTD)
+struct GraphArchive::Compressor {
+  Compressor() : Stream(ZSTD_createCStream()), Buffer(ZSTD_CStreamOutSize())
+  {
+    ZSTD_initCStream(Stream, 3);
+  }
+
+  ~Compressor() { ZSTD_freeCStream(Stream); }
+
+  ZSTD_CStream *Stream;
+  std::vector<char> Buffer;
+};
+
+bool GraphArchive::CanCompress() { return true; }
+#else
+struct GraphArchive::Compressor {};
+
+bool GraphArchive::CanCompress() { return false; }
+#endif
+
+/**
+ * Create a ustar header block.
+ *
+ * Names that don't fit in the header are truncated: callers should precede
+ * such headers with a pax extended header that gives the full name.
+ */
+static string TarHeader(StringRef Name, uint64_t Size, char Type)
+{
+  char H[BlockSize];
+  std::memset(H, 0, sizeof(H));
+
+  // Timestamps and owners are left as zero to keep archives reproducible.
+  std::memcpy(H, Name.data(), std::min<size_t>(Name.size(), 100));
+  std::snprintf(H + 100, 8, "%07o", 0644);
+  std::snprintf(H + 108, 8, "%07o", 0);
+  std::snprintf(H + 116, 8, "%07o", 0);
+  std::snprintf(H + 124, 12, "%011llo", static_cast<unsigned long long>(Size));
+  std::snprintf(H + 136, 12, "%011o", 0);
+  H[156] = Type;
+  std::memcpy(H + 257, "ustar", 6);
+  std::memcpy(H + 263, "00", 2);
+
+  // The checksum is calculated with the checksum field full of spaces.
+  std::memset(H + 148, ' ', 8);
+
+  unsigned Checksum = 0;
+  for (unsigned char C : H) {
+    Checksum += C;
+  }
+
+  std::snprintf(H + 148, 8, "%06o", Checksum);
+  H[155] = ' ';
+
+  return string(H, sizeof(H));
+}
+
+//! A pax extended header record: "<length> <key>=<value>\n".
+static string PaxRecord(StringRef Key, StringRef Value)
+{
+  const size_t Base = Key.size() + Value.size() + 3;
+
+  // The length includes its own digits.
+  size_t Length = Base + 1;
+  while (Length != Base + std::to_string(Length).size()) {
+    Length = Base + std::to_string(Length).size();
+  }
+
+  return std::to_string(Length) + " " + Key.str() + "=" + Value.str() + "\n";
+}
+
+
+string GraphArchive::NameFor(const Module &M)
+{
+  StringRef ID = M.getModuleIdentifier();
+
+  MD5 Hash;
+  Hash.update(ID);
+  MD5::MD5Result Result;
+  Hash.final(Result);
+
+  SmallString<32> Digest;
+  MD5::stringifyResult(Result, Digest);
+
+  return (sys::path::filename(ID) + "-" + Digest.substr(0, 8)).str();
+}
+
+std::unique_ptr<GraphArchive> GraphArchive::Create(StringRef Path,
+                                                   Compression C,
+                                                   std::error_code &Err,
+                                                   Format F)
+{
+  int FD;
+  Err = sys::fs::openFileForWrite(Path, FD, sys::fs::F_None);
+  if (Err) {
+    return nullptr;
+  }
+
+  return std::unique_ptr<GraphArchive>(new GraphArchive(Path, FD, C, F));
+}
+
+GraphArchive::GraphArchive(StringRef Path, int FD, Compression C, Format F)
+  : Path(Path), Out(FD, true), Compress(C), Packing(F)
+{
+  if (Compress == Compression::Zstd) {
+    Zstd.reset(new Compressor);
+  }
+
+  Writer = std::thread(&GraphArchive::WriteQueued, this);
+}
+
+GraphArchive::~GraphArchive()
+{
+  {
+    std::lock_guard<std::mutex> Guard(Lock);
+    Closing = true;
+  }
+
+  Changed.notify_all();
+  Writer.join();
+
+  Out.flush();
+
+  if (Out.has_error()) {
+    errs() << "Error writing graph archive '" << Path << "'\n";
+    Out.clear_error();
+  }
+}
+
+void GraphArchive::Add(string Name, string Contents)
+{
+  std::unique_lock<std::mutex> Guard(Lock);
+
+  if (QueuedBytes > MaxQueuedBytes) {
+    ++NumWriterStalls;
+    Changed.wait(Guard, [this]() { return QueuedBytes <= MaxQueuedBytes; });
+  }
+
+  QueuedBytes += Contents.size();
+  Queue.emplace_back(std::move(Name), std::move(Contents));
+
+  Guard.unlock();
+  Changed.notify_all();
+}
+
+void GraphArchive::WriteQueued()
+{
+  while (true) {
+    std::unique_lock<std::mutex> Guard(Lock);
+    Changed.wait(Guard, [this]() { return Closing or not Queue.empty(); });
+
+    if (Queue.empty()) {
+      break;
+    }
+
+    std::pair<string, string> File = std::move(Queue.front());
+    Queue.pop_front();
+    Guard.unlock();
+
+    WriteFile(File.first, File.second);
+
+    Guard.lock();
+    QueuedBytes -= File.second.size();
+    Guard.unlock();
+    Changed.notify_all();
+  }
+
+  // A tar archive ends with two empty blocks.
+  if (Packing == Format::Tar) {
+    Emit(string(2 * BlockSize, '\0'));
+  }
+
+  FinishCompression();
+}
+
+void GraphArchive::WriteFile(StringRef Name, StringRef Contents)
+{
+  ++NumArchivedFiles;
+  NumArchivedBytes += Contents.size();
+
+  if (Packing == Format::Concatenated) {
+    Emit(Contents);
+    if (size_t Remainder = Contents.size() % 4) {
+      Emit(string(4 - Remainder, '\0'));
+    }
+
+    return;
+  }
+
+  auto Pad = [this](size_t Size) {
+    if (size_t Remainder = Size % BlockSize) {
+      Emit(string(BlockSize - Remainder, '\0'));
+    }
+  };
+
+  if (Name.size() > 100) {
+    string Pax = PaxRecord("path", Name);
+    Emit(TarHeader("././@PaxHeader", Pax.size(), 'x'));
+    Emit(Pax);
+    Pad(Pax.size());
+  }
+
+  Emit(TarHeader(Name, Contents.size(), '0'));
+  Emit(Contents);
+  Pad(Contents.size());
+}
+
+void GraphArchive::Emit(StringRef Bytes)
+{
+#if defined(LLVM_PROV_HAVE_ZSTD)
+  if (Zstd) {
+    ZSTD_inBuffer In = { Bytes.data(), Bytes.size(), 0 };
+
+    while (In.pos < In.size) {
+      ZSTD_outBuffer Chunk = { Zstd->Buffer.data(), Zstd->Buffer.size(), 0 };
+      size_t Result = ZSTD_compressStream(Zstd->Stream, &Chunk, &In);
+      if (ZSTD_isError(Result)) {
+        errs() << "Error compressing graph archive '" << Path << "': "
+          << ZSTD_getErrorName(Result) << "\n";
+        return;
+      }
+
+      Out.write(Zstd->Buffer.data(), Chunk.pos);
+    }
+
+    return;
+  }
+#endif
+
+  Out << Bytes;
+}
+
+void GraphArchive::FinishCompression()
+{
+#if defined(LLVM_PROV_HAVE_ZSTD)
+  if (not Zstd) {
+    return;
+  }
+
+  size_t Remaining;
+  do {
+    ZSTD_outBuffer Chunk = { Zstd->Buffer.data(), Zstd->Buffer.size(), 0 };
+    Remaining = ZSTD_endStream(Zstd->Stream, &Chunk);
+    if (ZSTD_isError(Remaining)) {
+      errs() << "Error compressing graph archive '" << Path << "': "
+        << ZSTD_getErrorName(Remaining) << "\n";
+      return;
+    }
+
+    Out.write(Zstd->Buffer.data(), Chunk.pos);
+  } while (Remaining > 0);
+#endif
+}
@@ -0,0 +1,138 @@
+//! @file GraphArchive.hh  Declaration of @ref llvm::prov::GraphArchive.
+/*
+ * Copyright (c) 2017 Jonathan Anderson
+ * All rights reserved.
+ *
+ * This software was developed by BAE Systems, the University of Cambridge
+ * Computer Laboratory, and Memorial University under DARPA/AFRL contract
+ * FA8650-15-C-7558 ("CADETS"), as part of the DARPA Transparent Computing
+ * (TC) research program.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef LLVM_PROV_GRAPH_ARCHIVE_H
+#define LLVM_PROV_GRAPH_ARCHIVE_H
+
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <utility>
+
+
+namespace llvm {
+
+class Module;
+
+namespace prov {
+
+/**
+ * A streaming archive of files (e.g., one module's data flow graphs).
+ *
+ * Archives are POSIX (pax) tar files or, for files that describe themselves
+ * (e.g., binary flow graphs), simple concatenations of files. Either can be
+ * compressed with zstd. Archives are written by a background thread: adding
+ * a file only queues it, so the caller can get on with producing the next one.
+ * Memory use is bounded: adding a file waits for the writer if too much data
+ * is already queued.
+ */
+class GraphArchive {
+public:
+  enum class Compression { None, Zstd };
+
+  /**
+   * How files are packed: as tar entries, or one after another without
+   * names, each padded to a multiple of four bytes (so that it can be used
+   * in place when the archive is mapped into memory).
+   */
+  enum class Format { Tar, Concatenated };
+
+  //! Was this plugin built with zstd compression support?
+  static bool CanCompress();
+
+  /**
+   * A name for a module's graphs: the module's file name and a hash of its
+   * full identifier, so that modules with the same file name in different
+   * directories (and their identically-named functions) don't collide.
+   */
+  static std::string NameFor(const Module&);
+
+  /**
+   * Create an archive, replacing any existing file.
+   *
+   * @returns the archive, or null (with an error in @b Err) on failure
+   */
+  static std::unique_ptr<GraphArchive> Create(StringRef Path, Compression,
+                                              std::error_code &Err,
+                                              Format = Format::Tar);
+
+  //! Write everything that has been added and finish the archive.
+  ~GraphArchive();
+
+  //! Queue a file to be written to the archive.
+  void Add(std::string Name, std::string Contents);
+
+private:
+  GraphArchive(StringRef Path, int FD, Compression, Format);
+
+  //! Write queued files until the archive is closed (in the background).
+  void WriteQueued();
+
+  //! Write one file's tar header(s), contents and padding.
+  void WriteFile(StringRef Name, StringRef Contents);
+
+  //! Write (compressed) bytes to the file.
+  void Emit(StringRef);
+
+  //! Finish the compressed stream, if any.
+  void FinishCompression();
+
+  const std::string Path;
+  raw_fd_ostream Out;
+  const Compression Compress;
+  const Format Packing;
+
+  //! Compression state (if compressing).
+  struct Compressor;
+  std::unique_ptr<Compressor> Zstd;
+
+  std::mutex Lock;
+  std::condition_variable Changed;
+  std::deque<std::pair<std::string, std::string>> Queue;
+  size_t QueuedBytes = 0;
+  bool Closing = false;
+
+  std::thread Writer;
+};
+
+} // namespace prov
+} // namespace llvm
+
+#endif // LLVM_PROV_GRAPH_ARCHIVE_H
@@ -32,7 +32,8 @@
 
 #include "CallSemantics.hh"
 #include "FlowFinder.hh"
-#include "PosixCallSemantics.hh"
+#include "GraphArchive.hh"
+#include "Passes.hh"
 
 #include "loom/Instrumenter.hh"
 
@@ -57,7 +58,10 @@ namespace llvm {
     static char ID;
     GraphFlowsPass() : FunctionPass(ID) {}
 
+    bool doInitialization(Module&) override;
     bool runOnFunction(Function&) override;
+    bool doFinalization(Module&) override;
+
     void getAnalysisUsage(AnalysisUsage &AU) const override {
       // Our instrumentation injects instructions and may extend system calls,
       // but it doesn't modify the control-flow graph of *our* code (i.e.,
@@ -69,9 +73,16 @@ namespace llvm {
       AU.addPreserved<AAResultsWrapperPass>();
       AU.addRequiredTransitive<MemorySSAWrapperPass>();
     }
+
+    //! The archive that we are writing the current module's graphs to.
+    std::unique_ptr<prov::GraphArchive> Archive;
   };
 }
 
+namespace {
+  enum class GraphOutput { Dot, Binary, Archive, CompressedArchive };
+}
+
 
 cl::opt<string> OutputDirectory("flow-dir", cl::init("data-flow-graphs"),
     cl::desc("Directory for data flow graphs"), cl::value_desc("dir"));
@@ -79,54 +90,174 @@ cl::opt<string> OutputDirectory("flow-dir", cl::init("data-flow-graphs"),
 cl::opt<bool> ShowBasicBlocks("show-bbs", cl::init(true),
     cl::desc("Show basic blocks in data flow graphs"));
 
+cl::opt<GraphOutput> OutputFormat("flow-output",
+    cl::init(GraphOutput::Archive),
+    cl::desc("How to write data flow graphs"),
+    cl::values(
+      clEnumValN(GraphOutput::Dot, "dot", "one GraphViz file per function"),
+      clEnumValN(GraphOutput::Binary, "binary",
+                 "one file of binary graphs per module (for prov-flows)"),
+      clEnumValN(GraphOutput::Archive, "tar",
+                 "one tar archive of GraphViz files per module"),
+      clEnumValN(GraphOutput::CompressedArchive, "tar.zst",
+                 "one zstd-compressed tar archive per module")
+    )
+);
+
+static std::unique_ptr<GraphArchive> OpenOutput(const Module&);
+static void GraphFlows(Function&, MemorySSA&, GraphArchive*);
+
+
+bool GraphFlowsPass::doInitialization(Module &M)
+{
+  Archive = OpenOutput(M);
+  return false;
+}
+
 bool GraphFlowsPass::runOnFunction(Function &Fn)
 {
-  // Create output directory (if it doesn't exist); open output file.
-  std::error_code Err = sys::fs::create_directory(OutputDirectory);
+  GraphFlows(Fn, getAnalysis<MemorySSAWrapperPass>().getMSSA(),
+             Archive.get());
+  return false;
+}
+
+bool GraphFlowsPass::doFinalization(Module&)
+{
+  Archive.reset();
+  return false;
+}
+
+PreservedAnalyses GraphFlowsPrinterPass::run(Function &Fn,
+                                             FunctionAnalysisManager &AM)
+{
+  if (Fn.getParent() != OutputModule) {
+    OutputModule = Fn.getParent();
+    Archive = OpenOutput(*OutputModule);
+  }
+
+  GraphFlows(Fn, AM.getResult<MemorySSAAnalysis>(Fn).getMSSA(),
+             Archive.get());
+
+  return PreservedAnalyses::all();
+}
+
+/**
+ * Prepare to write a module's data flow graphs: create the output directory
+ * and, unless we are writing one file per function, the module's archive
+ * (or its file of binary graphs).
+ *
+ * Archives are named after modules (with a hash of the full module
+ * identifier), so that identically-named functions in different modules
+ * don't overwrite each other.
+ */
+static std::unique_ptr<GraphArchive> OpenOutput(const Module &M)
+{
+  std::error_code Err = sys::fs::create_directories(OutputDirectory);
   if (Err) {
     errs() << "Error creating output directory '" << OutputDirectory << "': "
       << Err.message() << "\n";
-    return false;
+    return nullptr;
   }
 
-  std::string Filename = (OutputDirectory + "/" + Fn.getName() + ".dot").str();
-  auto Flags = sys::fs::OpenFlags::F_RW | sys::fs::OpenFlags::F_Text;
+  if (OutputFormat == GraphOutput::Dot) {
+    return nullptr;
+  }
 
-  raw_fd_ostream FlowGraph(Filename, Err, Flags);
+  auto Compression = GraphArchive::Compression::None;
+  auto Format = GraphArchive::Format::Tar;
+  string Extension = ".tar";
 
-  if (Err) {
-    errs() << "Error opening graph file: " << Err.message() << "\n";
-    return false;
+  if (OutputFormat == GraphOutput::Binary) {
+    Format = GraphArchive::Format::Concatenated;
+    Extension = ".pfg";
   }
 
-  PosixCallSemantics CS;
-  FlowFinder FF(CS);
-
-  auto IsSink = [&CS](const Value *V) {
-    if (auto *Call = dyn_cast<CallInst>(V)) {
-        return CS.CanSink(Call);
+  if (OutputFormat == GraphOutput::CompressedArchive) {
+    if (GraphArchive::CanCompress()) {
+      Compression = GraphArchive::Compression::Zstd;
+      Extension += ".zst";
+    } else {
+      errs() << "Warning: zstd support not built; writing uncompressed "
+        << "graph archives\n";
     }
+  }
 
-    return false;
-  };
+  string Filename =
+    OutputDirectory + "/" + GraphArchive::NameFor(M) + Extension;
 
-  MemorySSA &MSSA = getAnalysis<MemorySSAWrapperPass>().getMSSA();
-  FlowFinder::FlowSet Flows = FF.FindPairwise(Fn, MSSA);
-  FF.Graph(Flows, Fn.getName(), ShowBasicBlocks, FlowGraph);
+  auto Archive = GraphArchive::Create(Filename, Compression, Err, Format);
+  if (not Archive) {
+    errs() << "Error opening graph archive '" << Filename << "': "
+      << Err.message() << "\n";
+  }
+
+  return Archive;
+}
+
+static void GraphFlows(Function &Fn, MemorySSA &MSSA, GraphArchive *Archive)
+{
+  const CallSemantics &CS = CallSemantics::Default();
+  FlowFinder FF(CS);
+
+  const FlowGraph &Flows = FF.FindPairwise(Fn, MSSA);
+
+  std::vector<Value*> Sources;
 
   for (auto& I : instructions(Fn)) {
     if (CallInst* Source = dyn_cast<CallInst>(&I)) {
-      if (not CS.IsSource(Source)) {
-        continue;
+      if (CS.IsSource(Source)) {
+        Sources.push_back(Source);
       }
+    }
+  }
 
-      for (Value *Sink : FF.FindEventual(Flows, Source, IsSink)) {
-        Flows.insert({ Sink, { Source, FlowFinder::FlowKind::Meta }});
-      }
+  // Summarize source-to-sink flows alongside the pairwise ones.
+  FlowGraph::Builder WithMeta(Flows);
+  std::vector<FlowFinder::ValueSet> Sinks = FF.FindSinks(Sources);
+
+  for (size_t i = 0; i < Sources.size(); i++) {
+    for (Value *Sink : Sinks[i]) {
+      WithMeta.AddFlow(Sources[i], Sink, FlowKind::Meta);
     }
   }
 
-  return false;
+  FlowGraph Graph = WithMeta.Build();
+
+  // Format graphs here, while the IR is guaranteed not to change, but leave
+  // archiving (and compression) to the archive's writer thread.
+  if (Archive) {
+    const bool Binary = (OutputFormat == GraphOutput::Binary);
+
+    string Text;
+    raw_string_ostream Out(Text);
+    if (Binary) {
+      FF.Export(Graph, Fn.getName(), Out);
+    } else {
+      FF.Graph(Graph, Fn.getName(), ShowBasicBlocks, Out);
+    }
+    Out.flush();
+
+    Archive->Add((Fn.getName() + (Binary ? ".pfg" : ".dot")).str(),
+                 std::move(Text));
+    return;
+  }
+
+  if (OutputFormat != GraphOutput::Dot) {
+    return;   // we couldn't open the module's archive
+  }
+
+  std::error_code Err;
+  std::string Filename = (OutputDirectory + "/" + Fn.getName() + ".dot").str();
+  auto Flags = sys::fs::OpenFlags::F_RW | sys::fs::OpenFlags::F_Text;
+
+  raw_fd_ostream GraphFile(Filename, Err, Flags);
+
+  if (Err) {
+    errs() << "Error opening graph file: " << Err.message() << "\n";
+    return;
+  }
+
+  FF.Graph(Graph, Fn.getName(), ShowBasicBlocks, GraphFile);
 }
 
 char GraphFlowsPass::ID = 0;
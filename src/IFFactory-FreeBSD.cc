@@ -30,9 +30,10 @@
  * SUCH DAMAGE.
  */
 
+#include "CallSemantics.hh"
 #include "IFFactory.hh"
-#include "PosixCallSemantics.hh"
 
+#include <llvm/ADT/Statistic.h>
 #include <llvm/IR/DerivedTypes.h>
 #include <llvm/IR/Function.h>
 #include <llvm/IR/Instructions.h>
@@ -40,15 +41,23 @@
 #include <llvm/IR/LLVMContext.h>
 #include <llvm/IR/Module.h>
 
+#include <chrono>
+
 using namespace llvm;
 using namespace llvm::prov;
 
+#define DEBUG_TYPE "prov-metaio"
+
+STATISTIC(NumInstrumenters, "Number of metaio instrumenters created");
+STATISTIC(SetupMicroseconds,
+          "Time spent setting up metaio instrumentation (microseconds)");
+
 
 namespace {
 
 class MetaIO : public IFFactory {
 public:
-  MetaIO(InstrPtr);
+  MetaIO(Module&, InstrFactory);
 
   const class CallSemantics& CallSemantics() const override { return CS; }
 
@@ -56,39 +65,76 @@ public:
   bool TranslateSink(CallInst*, const Source&) override;
 
 private:
+  //! The module's Instrumenter (created on first use).
+  loom::Instrumenter& Instr();
+
   //! Find or construct the `struct metaio` type.
   StructType* MetadataType();
 
   //! Find or construct the `struct uuid` type.
   StructType* UUIDType();
 
-  InstrPtr Instr;
   Module& Mod;
   LLVMContext& Ctx;
-  PosixCallSemantics CS;
+  const class CallSemantics &CS;
   IntegerType *i32, *i64;
+
+  InstrFactory CreateInstr;
+  InstrPtr Instrumenter;
+
+  StructType *MetaIOTy = nullptr;
+  StructType *UUIDTy = nullptr;
 };
 
 } // anonymous namespace
 
+//! The function that instrumented calls to a named function should call.
+static std::string WrapperName(StringRef Name, const CallSemantics::Roles &R) {
+  return R.Wrapper.empty() ? ("metaio_" + Name).str() : R.Wrapper.str();
+}
+
 
-std::unique_ptr<IFFactory> IFFactory::FreeBSDMetaIO(InstrPtr Instr) {
-  return std::unique_ptr<IFFactory>(new MetaIO(std::move(Instr)));
+std::unique_ptr<IFFactory>
+IFFactory::FreeBSDMetaIO(Module &M, InstrFactory CreateInstr) {
+  return std::unique_ptr<IFFactory>(new MetaIO(M, std::move(CreateInstr)));
 }
 
 
-MetaIO::MetaIO(InstrPtr I)
-  : Instr(std::move(I)), Mod(this->Instr->getModule()), Ctx(Mod.getContext()),
-    i32(IntegerType::get(Ctx, 32)), i64(IntegerType::get(Ctx, 64))
+MetaIO::MetaIO(Module &M, InstrFactory CreateInstr)
+  : Mod(M), Ctx(Mod.getContext()), CS(CallSemantics::Default()),
+    i32(IntegerType::get(Ctx, 32)), i64(IntegerType::get(Ctx, 64)),
+    CreateInstr(std::move(CreateInstr))
 {
 }
 
 
+loom::Instrumenter& MetaIO::Instr() {
+  if (Instrumenter) {
+    return *Instrumenter;
+  }
+
+  auto Start = std::chrono::steady_clock::now();
+
+  Instrumenter = CreateInstr();
+  assert(Instrumenter and &Instrumenter->getModule() == &Mod);
+  MetadataType();
+
+  auto Elapsed = std::chrono::steady_clock::now() - Start;
+  SetupMicroseconds +=
+    std::chrono::duration_cast<std::chrono::microseconds>(Elapsed).count();
+  ++NumInstrumenters;
+
+  return *Instrumenter;
+}
+
+
 Source MetaIO::TranslateSource(CallInst *Call) {
   // Identify the function being called
   Function *Target = Call->getCalledFunction();
   assert(Target and Target->hasName());
   StringRef Name = Target->getName();
+  CallSemantics::Roles Roles = CS.RolesOf(*Target);
+  assert(Roles.Source);
 
   // Allocate a `struct metaio` on the stack
   Function *F = Call->getParent()->getParent();
@@ -97,40 +143,22 @@ Source MetaIO::TranslateSource(CallInst *Call) {
   Value *MetaIOPtr =
     IRBuilder<>(&First).CreateAlloca(MetadataType(), nullptr, "metaio");
 
-  Call = Instr->Extend(Call, ("metaio_" + Name).str(), { MetaIOPtr },
+  Call = Instr().Extend(Call, WrapperName(Name, Roles), { MetaIOPtr },
                        loom::Instrumenter::ParamPosition::End);
 
-  // Determine which value(s) constitute outputs from this IF source.
+  // Determine which value(s) constitute outputs from this IF source, e.g.,
+  // the buffer passed to read(2) or the memory returned by mmap(2).
   //
   // We have to do this after replacing the original CallInst, since the return
   // value might be the output value in question (so we need the replaced call).
   SmallVector<const Value*, 4> OutputValues;
 
-  if (Name.find("mmap") != StringRef::npos) {
-    // The "output" of mmap(2) is the memory being mapped (the return value):
+  if (Roles.Data == CallSemantics::Roles::ReturnValue) {
     OutputValues.push_back(Call);
 
-  } else if (Name.find("read") != StringRef::npos) {
-    //
-    // The "output" of all four read(2)-derived syscalls is the first parameter:
-    //
-    // read:   fd, buf, nbytes
-    // pread:  fd, buf, nbytes, offset
-    // readv:  fd, iov, iovcnt
-    // preadv: fd, iov, iovcnt, offset
-    //
-    OutputValues.push_back(Call->getArgOperand(1));
-
-  } else if (Name.find("recv") != StringRef::npos) {
-    //
-    // The "output" of all four recv(2)-derived syscalls is the first parameter:
-    //
-    // recv:      s, buf, len, flags
-    // recvfrom:  s, buf, len, flags, from, fromlen
-    // recvmsg:   s, msg, flags
-    // recvmmsg:  s, msgvec, vlen, flags, timeout
-    //
-    OutputValues.push_back(Call->getArgOperand(1));
+  } else if (Roles.Data >= 0 and
+             static_cast<unsigned>(Roles.Data) < Call->getNumArgOperands()) {
+    OutputValues.push_back(Call->getArgOperand(Roles.Data));
 
   } else {
     assert(false && "unhandled source function");
@@ -152,7 +180,7 @@ bool MetaIO::TranslateSink(CallInst *Call, const Source &S) {
   // TODO: handle flow combinations, i.e., multiple sources to one sink
   assert(Name.find("metaio") == StringRef::npos && "multi-source sink");
 
-  Instr->Extend(Call, ("metaio_" + Name).str(), { MetaIOPtr },
+  Instr().Extend(Call, WrapperName(Name, CS.RolesOf(*F)), { MetaIOPtr },
                 loom::Instrumenter::ParamPosition::End);
 
   return false;
@@ -160,8 +188,12 @@ bool MetaIO::TranslateSink(CallInst *Call, const Source &S) {
 
 
 StructType* MetaIO::MetadataType() {
-  if (StructType *T = Mod.getTypeByName("struct.metaio")) {
-    return T;
+  if (MetaIOTy) {
+    return MetaIOTy;
+  }
+
+  if ((MetaIOTy = Mod.getTypeByName("struct.metaio"))) {
+    return MetaIOTy;
   }
 
   IntegerType *lwpidTy = i32;
@@ -176,12 +208,17 @@ StructType* MetaIO::MetadataType() {
     UUIDType(), // mio_uuid
   };
 
-  return StructType::create(FieldTypes, "struct.metaio");
+  MetaIOTy = StructType::create(FieldTypes, "struct.metaio");
+  return MetaIOTy;
 }
 
 StructType* MetaIO::UUIDType() {
-  if (StructType *T = Mod.getTypeByName("struct.uuid")) {
-    return T;
+  if (UUIDTy) {
+    return UUIDTy;
+  }
+
+  if ((UUIDTy = Mod.getTypeByName("struct.uuid"))) {
+    return UUIDTy;
   }
 
   IntegerType *i8 = IntegerType::get(Ctx, 8);
@@ -197,5 +234,6 @@ StructType* MetaIO::UUIDType() {
     nodeTy,     // node[_UUID_NODE_LEN]
   };
 
-  return StructType::create(FieldTypes, "struct.uuid");
+  UUIDTy = StructType::create(FieldTypes, "struct.uuid");
+  return UUIDTy;
 }
@@ -37,6 +37,7 @@
 
 #include <loom/Instrumenter.hh>
 
+#include <functional>
 #include <memory>
 
 
@@ -58,11 +59,18 @@ class IFFactory
 {
   public:
   typedef std::unique_ptr<loom::Instrumenter> InstrPtr;
+  typedef std::function<InstrPtr ()> InstrFactory;
 
   virtual ~IFFactory();
 
-  //! Create a new FreeBSD-specific @ref IFFactory using metaio.
-  static std::unique_ptr<IFFactory> FreeBSDMetaIO(InstrPtr);
+  /**
+   * Create a new FreeBSD-specific @ref IFFactory using metaio.
+   *
+   * The factory lives for a whole module, but it doesn't create its
+   * Instrumenter (or the types that it instruments with) until the first
+   * source is translated, so modules without sources cost (almost) nothing.
+   */
+  static std::unique_ptr<IFFactory> FreeBSDMetaIO(Module&, InstrFactory);
 
   /**
    * What are the call semantics (e.g., which parameters are outputs)
@@ -0,0 +1,93 @@
+//! @file PassPlugin.cc  Registration of our passes with the new pass manager.
+/*
+ * Copyright (c) 2017 Jonathan Anderson
+ * All rights reserved.
+ *
+ * This software was developed by BAE Systems, the University of Cambridge
+ * Computer Laboratory, and Memorial University under DARPA/AFRL contract
+ * FA8650-15-C-7558 ("CADETS"), as part of the DARPA Transparent Computing
+ * (TC) research program.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#include "Passes.hh"
+
+#include <llvm/Config/llvm-config.h>
+
+#if LLVM_VERSION_MAJOR >= 7
+#include <llvm/Passes/PassBuilder.h>
+#include <llvm/Passes/PassPlugin.h>
+
+using namespace llvm;
+using namespace llvm::prov;
+
+
+/**
+ * Make our passes available to explicit pipelines (e.g., `opt -passes=prov`).
+ *
+ * They aren't added to default pipelines through extension points: that
+ * needs LLVM 11 or later, which the rest of this tree doesn't build against.
+ */
+static void RegisterPasses(PassBuilder &PB)
+{
+  PB.registerPipelineParsingCallback(
+    [](StringRef Name, ModulePassManager &MPM,
+       ArrayRef<PassBuilder::PipelineElement>) {
+      if (Name == "prov") {
+        MPM.addPass(ProvenancePass());
+        return true;
+      }
+
+      if (Name == "save-bitcode") {
+        MPM.addPass(SaveBitcodePass());
+        return true;
+      }
+
+      if (Name == "callgraph") {
+        MPM.addPass(CallGraphPrinterPass());
+        return true;
+      }
+
+      return false;
+    });
+
+  PB.registerPipelineParsingCallback(
+    [](StringRef Name, FunctionPassManager &FPM,
+       ArrayRef<PassBuilder::PipelineElement>) {
+      if (Name == "graph-flows") {
+        FPM.addPass(GraphFlowsPrinterPass());
+        return true;
+      }
+
+      return false;
+    });
+}
+
+extern "C" LLVM_ATTRIBUTE_WEAK PassPluginLibraryInfo llvmGetPassPluginInfo()
+{
+  return { LLVM_PLUGIN_API_VERSION, "LLVMProv", LLVM_VERSION_STRING,
+           RegisterPasses };
+}
+
+#endif // LLVM_VERSION_MAJOR >= 7
@@ -0,0 +1,87 @@
+//! @file Passes.hh  Declarations of new-pass-manager provenance passes.
+/*
+ * Copyright (c) 2017 Jonathan Anderson
+ * All rights reserved.
+ *
+ * This software was developed by BAE Systems, the University of Cambridge
+ * Computer Laboratory, and Memorial University under DARPA/AFRL contract
+ * FA8650-15-C-7558 ("CADETS"), as part of the DARPA Transparent Computing
+ * (TC) research program.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef LLVM_PROV_PASSES_H
+#define LLVM_PROV_PASSES_H
+
+#include <llvm/IR/PassManager.h>
+
+#include <memory>
+
+
+namespace llvm {
+namespace prov {
+
+class GraphArchive;
+
+/**
+ * Instrument the flows from information sources to information sinks within
+ * a module's functions (see `-prov` for the legacy pass manager).
+ *
+ * Functions' MemorySSA is taken from the FunctionAnalysisManager, so it is
+ * shared with (and not recomputed for) other passes in the same pipeline.
+ */
+struct ProvenancePass : public PassInfoMixin<ProvenancePass> {
+  PreservedAnalyses run(Module&, ModuleAnalysisManager&);
+};
+
+//! Write each function's data flow graph to a GraphViz file.
+struct GraphFlowsPrinterPass : public PassInfoMixin<GraphFlowsPrinterPass> {
+  PreservedAnalyses run(Function&, FunctionAnalysisManager&);
+
+private:
+  //! The module whose graphs we are writing (and its archive, if any).
+  const Module *OutputModule = nullptr;
+  std::shared_ptr<GraphArchive> Archive;
+};
+
+//! Write a module's direct call graph to a file.
+struct CallGraphPrinterPass : public PassInfoMixin<CallGraphPrinterPass> {
+  PreservedAnalyses run(Module&, ModuleAnalysisManager&);
+};
+
+/**
+ * Write a module's bitcode to the file named by `-prov-save-bitcode`
+ * (see `-save-bitcode` for the legacy pass manager).
+ */
+struct SaveBitcodePass : public PassInfoMixin<SaveBitcodePass> {
+  PreservedAnalyses run(Module&, ModuleAnalysisManager&);
+
+  //! Has a file been named with `-prov-save-bitcode`?
+  static bool Enabled();
+};
+
+} // namespace prov
+} // namespace llvm
+
+#endif // LLVM_PROV_PASSES_H
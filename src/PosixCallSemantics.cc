@@ -32,15 +32,14 @@
 
 #include "PosixCallSemantics.hh"
 
-#include <llvm/ADT/StringSet.h>
-#include <llvm/Support/raw_ostream.h>
-
 using namespace llvm;
 using namespace llvm::prov;
 
-#if defined(__DARWIN_ALIAS)
-#define DARWIN_SYMBOL_NAME(name) "\01_" name __DARWIN_SUF_UNIX03
-#endif
+// The compiled form of semantics/posix.sem (generated by prov-semc).
+#include "PosixSemantics.inc"
+
+static std::unique_ptr<SemanticsTable> BuiltinTable();
+
 
 std::unique_ptr<CallSemantics> CallSemantics::Posix() {
   return std::unique_ptr<CallSemantics>(new PosixCallSemantics());
@@ -48,91 +47,17 @@ std::unique_ptr<CallSemantics> CallSemantics::Posix() {
 
 
 PosixCallSemantics::PosixCallSemantics()
-  : ArgNumbers({
-    { "read", 1 },
-    { "pread", 1 },
-    { "readv", 1 },
-    { "preadv", 1 },
-    { "recv", 1 },
-    { "recvfrom", 1 },
-    { "recvmsg", 1 },
-    { "recvmmsg", 1 },
-    { "mmap", 0 },
-#if defined(DARWIN_SYMBOL_NAME)
-    { DARWIN_SYMBOL_NAME("read"), 1 },
-    { DARWIN_SYMBOL_NAME("pread"), 1 },
-    { DARWIN_SYMBOL_NAME("readv"), 1 },
-    { DARWIN_SYMBOL_NAME("recv"), 1 },
-    { DARWIN_SYMBOL_NAME("recvfrom"), 1 },
-    { DARWIN_SYMBOL_NAME("recvmsg"), 1 },
-    { DARWIN_SYMBOL_NAME("mmap"), 0 },
-#endif
-  })
+  : TableCallSemantics(BuiltinTable())
 {
 }
 
-SmallVector<Value*, 2>
-PosixCallSemantics::CallOutputs(CallInst *Call) const {
-  SmallVector<Value*, 2> Outputs = { Call };
-
-  Function *Target = Call->getCalledFunction();
-  if (not Target or not Target->hasName()) {
-    return Outputs;
-  }
-
-  StringRef FnName = Target->getName();
-  auto i = ArgNumbers.find(FnName);
-  if (i == ArgNumbers.end()) {
-    return Outputs;
-  }
-
-  const size_t ArgNum = i->second;
-  if (ArgNum >= Call->getNumArgOperands()) {
-    errs()
-      << "ERROR: " << FnName << " has only "
-      << Call->getNumArgOperands() << " params, expected at least "
-      << (ArgNum + 1)
-      ;
-
-    return {};
-  }
-
-  Outputs.push_back(Call->getArgOperand(ArgNum));
-
-  return Outputs;
-}
-
-
-bool PosixCallSemantics::IsSource(const CallInst *Call) const {
-  Function *F = Call->getCalledFunction();
-  if (not (F and F->hasName())) {
-    return false;
-  }
-
-  return (ArgNumbers.find(F->getName()) != ArgNumbers.end());
-}
-
-bool PosixCallSemantics::CanSink(const CallInst *Call) const {
-  Function *F = Call->getCalledFunction();
-  if (not (F and F->hasName())) {
-    return false;
-  }
-
-  StringRef Name = F->getName();
+static std::unique_ptr<SemanticsTable> BuiltinTable() {
+  StringRef Data(reinterpret_cast<const char*>(PosixSemanticsTable),
+                 sizeof(PosixSemanticsTable));
 
-  static llvm::StringSet<> SinkNames({
-    /* "mmap", */ // information actually flows when we write into the memory
-    "pwrite", "pwritev",
-    "sendmsg", "sendto",
-    "write", "writev",
-#if defined(DARWIN_SYMBOL_NAME)
-    DARWIN_SYMBOL_NAME("pwrite"),
-    DARWIN_SYMBOL_NAME("sendmsg"),
-    DARWIN_SYMBOL_NAME("sendto"),
-    DARWIN_SYMBOL_NAME("write"),
-    DARWIN_SYMBOL_NAME("writev"),
-#endif
-  });
+  std::string Err;
+  std::unique_ptr<SemanticsTable> Table = SemanticsTable::Open(Data, Err);
+  assert(Table && "invalid built-in POSIX semantics table");
 
-  return (SinkNames.find(Name) != SinkNames.end());
+  return Table;
 }
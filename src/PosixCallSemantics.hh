@@ -33,30 +33,21 @@
 #ifndef LLVM_PROV_POSIX_CALL_SEMANTICS_H
 #define LLVM_PROV_POSIX_CALL_SEMANTICS_H
 
-#include "CallSemantics.hh"
-
-#include <llvm/Support/raw_ostream.h>
-
-#include <map>
-#include <string>
+#include "TableCallSemantics.hh"
 
 namespace llvm {
 namespace prov {
 
 /**
  * CallSemantics implementation for POSIX functions.
+ *
+ * These semantics are described by `semantics/posix.sem`, which is compiled
+ * into the plugin as a @ref SemanticsTable when it is built.
  */
-class PosixCallSemantics : public CallSemantics
+class PosixCallSemantics : public TableCallSemantics
 {
   public:
   PosixCallSemantics();
-
-  SmallVector<Value*, 2> CallOutputs(CallInst*) const override;
-  bool IsSource(const CallInst*) const override;
-  bool CanSink(const CallInst*) const override;
-
-  private:
-  const std::multimap<std::string, int> ArgNumbers;
 };
 
 } // namespace prov
@@ -31,19 +31,40 @@
  */
 
 #include "CallSemantics.hh"
+#include "FlowCache.hh"
 #include "FlowFinder.hh"
+#include "FlowSummary.hh"
+#include "GraphArchive.hh"
 #include "IFFactory.hh"
+#include "Passes.hh"
 
 #include "loom/Instrumenter.hh"
 
 #include <llvm/Pass.h>
+#include <llvm/ADT/Statistic.h>
+#include <llvm/Analysis/AssumptionCache.h>
+#include <llvm/Analysis/BasicAliasAnalysis.h>
 #include <llvm/Analysis/MemorySSA.h>
+#include <llvm/Analysis/ScopedNoAliasAA.h>
+#include <llvm/Analysis/TargetLibraryInfo.h>
+#include <llvm/Analysis/TypeBasedAliasAnalysis.h>
+#include <llvm/Config/llvm-config.h>
+#include <llvm/IR/Dominators.h>
 #include <llvm/IR/Module.h>
+#include <llvm/IR/ModuleSlotTracker.h>
 #include <llvm/IR/InstIterator.h>
+#if LLVM_VERSION_MAJOR >= 6
+#include <llvm/Analysis/OptimizationRemarkEmitter.h>
+#else
+#include <llvm/Analysis/OptimizationDiagnosticInfo.h>
+#endif
 #include <llvm/Support/Error.h>
 #include <llvm/Support/FileSystem.h>
+#include <llvm/Support/ThreadPool.h>
 #include <llvm/Support/raw_ostream.h>
 
+#include <algorithm>
+#include <numeric>
 #include <sstream>
 
 using namespace llvm;
@@ -51,77 +72,780 @@ using namespace llvm::prov;
 using namespace loom;
 using std::string;
 
+#define DEBUG_TYPE "prov"
+
+STATISTIC(NumFunctions, "Number of functions analysed for provenance");
+STATISTIC(NumSources, "Number of information sources instrumented");
+STATISTIC(NumSinks, "Number of information sinks instrumented");
+STATISTIC(NumFlows, "Number of source-to-sink flows found");
+
 
 namespace llvm {
-  struct Provenance : public FunctionPass {
+  struct Provenance : public ModulePass {
     static char ID;
-    Provenance() : FunctionPass(ID) {}
+    Provenance() : ModulePass(ID) {}
+
+    bool runOnModule(Module&) override;
+    void getAnalysisUsage(AnalysisUsage &AU) const override;
+  };
+}
 
-    bool runOnFunction(Function&) override;
-    void getAnalysisUsage(AnalysisUsage &AU) const override {
-      // Our instrumentation injects instructions and may extend system calls,
-      // but it doesn't modify the control-flow graph of *our* code (i.e.,
-      // it doesn't add/remove BasicBlocks or modify our own branches/returns).
-      AU.setPreservesCFG();
+namespace {
+  //! The source-to-sink flows found in a function, ready to be instrumented.
+  struct FunctionFlows {
+    FunctionFlows(Function &Fn) : Fn(&Fn) {}
 
-      // We need analysis of which loads depend on which stores.
-      AU.addRequiredTransitive<MemorySSAWrapperPass>();
-    }
+    Function *Fn;
+
+    //! What we need to compute the function's MemorySSA (see FindFlows).
+    const TargetLibraryInfo *TLI = nullptr;
+    AssumptionCache *AC = nullptr;
+    std::unique_ptr<AssumptionCache> OwnedAC;
+
+    //! Retained to keep the flow graph up to date through instrumentation.
+    std::unique_ptr<FlowFinder> FF;
+
+    //! Sources and their sinks, all in instruction order.
+    std::vector<std::pair<CallInst*, std::vector<CallInst*>>> Flows;
+
+    /**
+     * With `-prov-witness`, how each source's information reaches each of
+     * its sinks (in the same order as @ref Flows).
+     */
+    std::vector<std::vector<FlowFinder::WitnessPath>> Witnesses;
+  };
+
+  /**
+   * A function's MemorySSA, over the alias analyses that we find flows with
+   * (see @ref AliasAnalyses).
+   */
+  struct FunctionMemorySSA {
+    FunctionMemorySSA(Function&, const TargetLibraryInfo&, AssumptionCache&);
+
+    DominatorTree DT;
+    BasicAAResult BasicAA;
+    ScopedNoAliasAAResult ScopedNoAliasAA;
+    TypeBasedAAResult TypeBasedAA;
+    AAResults AA;
+    std::unique_ptr<MemorySSA> MSSA;
   };
 }
 
+cl::opt<string> InstrumentedGraphDir("prov-graph-dir", cl::init(""),
+    cl::desc("Directory for post-instrumentation data flow graphs"),
+    cl::value_desc("dir"));
+
+cl::opt<unsigned> AnalysisThreads("prov-threads", cl::init(1),
+    cl::desc("Number of threads to find flows with (0: one per core)"),
+    cl::value_desc("N"));
+
+cl::opt<string> CachePath("prov-cache", cl::init(""),
+    cl::desc("File to cache functions' flows in across runs"),
+    cl::value_desc("file"));
+
+cl::opt<unsigned> CacheMaxSize("prov-cache-max-size", cl::init(1024),
+    cl::desc("Stop adding to the flow cache beyond this size (0: no limit)"),
+    cl::value_desc("MiB"));
+
+cl::opt<bool> CacheReport("prov-cache-report", cl::init(false),
+    cl::desc("Report flow cache hit rates"));
+
+cl::opt<bool> ReportOnly("prov-report-only", cl::init(false),
+    cl::desc("Find source-to-sink flows and report them as optimization "
+             "remarks (e.g., with -pass-remarks-output) without "
+             "instrumenting them"));
+
+cl::opt<bool> Witness("prov-witness", cl::init(false),
+    cl::desc("Include a shortest chain of values through which information "
+             "flows from source to sink in each flow's remark"));
+
+cl::opt<bool> ExportSummaries("prov-export-summaries", cl::init(false),
+    cl::desc("Embed exported functions' flow summaries in the module "
+             "(for prov-summaries)"));
+
+cl::opt<bool> UseSummaries("prov-use-summaries", cl::init(false),
+    cl::desc("Apply the flow summaries of the module's functions at calls "
+             "to them: values don't flow into calls that they can't flow "
+             "out of and, with -prov-report-only, calls to functions that "
+             "pass information to sinks are reported as sinks"));
+
+/**
+ * The version of the flows that we cache: this must change whenever
+ * the flows found for the same IR and CallSemantics might change.
+ */
+static const char CacheVersion[] = "prov-flows-2";
+
+/**
+ * The alias analyses that we find flows with (see FindFlows), which are part
+ * of the flow cache's key: different alias analyses find different flows.
+ */
+static const char AliasAnalyses[] = "basic-aa,scoped-noalias-aa,tbaa";
 
 static string JoinVec(const std::vector<string>&);
+static size_t InstructionCount(const Function&);
+static DenseMap<const Value*, uint32_t> Number(Function&);
+static std::unique_ptr<IFFactory> Factory(Module&);
+static bool Instrument(Module&, IFFactory&, const CallSemantics&,
+                       const FlowSummaries*, std::vector<FunctionFlows>&);
+static void Analyse(FunctionFlows&, const CallSemantics&,
+                    const FlowSummaries*, FlowCache*);
+static void FindFlows(FunctionFlows&, const CallSemantics&,
+                      const FlowSummaries*);
+static std::vector<uint32_t> EncodeFlows(const FunctionFlows&);
+static bool DecodeFlows(FunctionFlows&, ArrayRef<uint32_t>);
+static void WriteGraph(FlowFinder&, const Function&);
+static void Remark(OptimizationRemarkEmitter&, CallInst *Source,
+                   CallInst *Sink, const FlowFinder::WitnessPath*,
+                   ModuleSlotTracker*);
+static std::unique_ptr<FlowSummaries> Summarize(Module&, const CallSemantics&,
+                                                std::vector<FunctionFlows>&);
+
+
+void Provenance::getAnalysisUsage(AnalysisUsage &AU) const
+{
+  // Our instrumentation injects instructions and may extend system calls,
+  // but it doesn't modify the control-flow graph of *our* code (i.e.,
+  // it doesn't add/remove BasicBlocks or modify our own branches/returns).
+  AU.setPreservesCFG();
 
+  // We build our own MemorySSA for each function (see FindFlows), which
+  // needs to know about library functions.
+  AU.addRequired<TargetLibraryInfoWrapperPass>();
+}
 
-bool Provenance::runOnFunction(Function &Fn)
+bool Provenance::runOnModule(Module &M)
 {
-  auto S = InstrStrategy::Create(loom::InstrStrategy::Kind::Inline, false);
+  auto IF = Factory(M);
+
+  // Look up each function's roles once rather than at every call.
+  std::unique_ptr<CallSemantics> CS = IF->CallSemantics().Resolve(M);
 
-  auto IF = IFFactory::FreeBSDMetaIO(
-    Instrumenter::Create(*Fn.getParent(), JoinVec, std::move(S)));
-  const CallSemantics& CS = IF->CallSemantics();
+  const TargetLibraryInfo &TLI =
+    getAnalysis<TargetLibraryInfoWrapperPass>().getTLI();
 
-  auto IsSink = [&CS](const Value *V) {
-    if (auto *Call = dyn_cast<CallInst>(V)) {
-        return CS.CanSink(Call);
+  std::vector<FunctionFlows> Functions;
+
+  for (Function &Fn : M) {
+    if (Fn.isDeclaration()) {
+      continue;
     }
 
-    return false;
-  };
+    // Scanning for assumptions registers value handles, which can't be done
+    // concurrently, so do it up front.
+    Functions.emplace_back(Fn);
+    FunctionFlows &F = Functions.back();
+    F.TLI = &TLI;
+    F.OwnedAC.reset(new AssumptionCache(Fn));
+    F.AC = F.OwnedAC.get();
+    F.AC->assumptions();
+  }
+
+  auto Summaries = Summarize(M, *CS, Functions);
+
+  // Exporting summaries modifies the module (by adding metadata) even if
+  // there is nothing to instrument.
+  const bool Instrumented =
+    Instrument(M, *IF, *CS, Summaries.get(), Functions);
+  return Instrumented or ExportSummaries;
+}
+
+PreservedAnalyses ProvenancePass::run(Module &M, ModuleAnalysisManager &AM)
+{
+  FunctionAnalysisManager &FAM =
+    AM.getResult<FunctionAnalysisManagerModuleProxy>(M).getManager();
+
+  auto IF = Factory(M);
+  std::unique_ptr<CallSemantics> CS = IF->CallSemantics().Resolve(M);
 
-  FlowFinder FF(CS);
+  std::vector<FunctionFlows> Functions;
 
-  auto &MSSA = getAnalysis<MemorySSAWrapperPass>().getMSSA();
-  FlowFinder::FlowSet PairwiseFlows = FF.FindPairwise(Fn, MSSA);
+  for (Function &Fn : M) {
+    if (Fn.isDeclaration()) {
+      continue;
+    }
+
+    // Analysis managers can't be used concurrently, so get everything that
+    // we need from them up front. We don't use the manager's MemorySSA,
+    // whose alias analyses depend on the pipeline: flows must be the same
+    // with either pass manager, with or without a flow cache.
+    Functions.emplace_back(Fn);
+    FunctionFlows &F = Functions.back();
+    F.TLI = &FAM.getResult<TargetLibraryAnalysis>(Fn);
+    F.AC = &FAM.getResult<AssumptionAnalysis>(Fn);
+    F.AC->assumptions();
+  }
+
+  auto Summaries = Summarize(M, *CS, Functions);
+
+  const bool Instrumented =
+    Instrument(M, *IF, *CS, Summaries.get(), Functions);
+  if (not Instrumented and not ExportSummaries) {
+    return PreservedAnalyses::all();
+  }
+
+  // Instrumentation adds instructions (and summaries add metadata),
+  // but not control flow.
+  PreservedAnalyses PA;
+  PA.preserveSet<CFGAnalyses>();
+  return PA;
+}
 
-  std::map<Value*, std::vector<Value*>> DataFlows;
+/**
+ * Create the information flow mechanism that we instrument a module with.
+ *
+ * This is cheap: the factory doesn't touch the module until it is first
+ * asked to translate a source.
+ */
+static std::unique_ptr<IFFactory> Factory(Module &M)
+{
+  return IFFactory::FreeBSDMetaIO(M, [&M]() {
+    auto S = InstrStrategy::Create(loom::InstrStrategy::Kind::Inline, false);
+    return Instrumenter::Create(M, JoinVec, std::move(S));
+  });
+}
+
+/**
+ * Find and instrument the source-to-sink flows within a module's functions.
+ *
+ * @param   CS          the semantics of @a IF, resolved for this module
+ * @param   Summaries   summaries of the module's functions to apply at calls
+ *                      to them (optional)
+ *
+ * @returns   whether or not the module was modified
+ */
+static bool Instrument(Module &M, IFFactory &IF, const CallSemantics &CS,
+                       const FlowSummaries *Summaries,
+                       std::vector<FunctionFlows> &Functions)
+{
+  // Flows found with -prov-graph-dir or -prov-witness need a flow graph,
+  // and flows found with summaries depend on other functions' bodies,
+  // so can't be cached.
+  std::unique_ptr<FlowCache> Cache;
+  if (not CachePath.empty() and InstrumentedGraphDir.empty()
+      and not Witness and not Summaries) {
+    Cache.reset(new FlowCache(CachePath, uint64_t(CacheMaxSize) << 20));
+  }
+
+  // Finding flows doesn't modify the IR, so it can be done for all functions
+  // at once. Start with the largest functions so that the smaller ones can
+  // fill in around them at the end.
+  if (AnalysisThreads == 1) {
+    for (FunctionFlows &F : Functions) {
+      Analyse(F, CS, Summaries, Cache.get());
+    }
+
+  } else {
+    std::vector<size_t> Sizes;
+    std::vector<size_t> Order(Functions.size());
+
+    for (FunctionFlows &F : Functions) {
+      Sizes.push_back(InstructionCount(*F.Fn));
+    }
+
+    std::iota(Order.begin(), Order.end(), 0);
+    std::stable_sort(Order.begin(), Order.end(), [&Sizes](size_t x, size_t y) {
+      return Sizes[x] > Sizes[y];
+    });
+
+    std::unique_ptr<ThreadPool> Pool(AnalysisThreads
+      ? new ThreadPool(AnalysisThreads) : new ThreadPool());
+
+    for (size_t i : Order) {
+      Pool->async([&Functions, &CS, Summaries, &Cache, i]() {
+        Analyse(Functions[i], CS, Summaries, Cache.get());
+      });
+    }
+
+    Pool->wait();
+  }
+
+  if (Cache) {
+    Cache->Flush();
+
+    if (CacheReport) {
+      const size_t Lookups = Cache->Hits() + Cache->Misses();
+      errs() << M.getName() << ": flow cache: " << Cache->Hits() << " hits, "
+        << Cache->Misses() << " misses";
+
+      if (Lookups > 0) {
+        errs() << " (" << (100 * Cache->Hits() / Lookups) << "% hit rate)";
+      }
+
+      errs() << "\n";
+    }
+  }
+
+  // Rewrite the IR serially, in module order, so that the output doesn't
+  // depend on how the analysis was scheduled.
+  bool ModifiedIR = false;
+
+  for (FunctionFlows &F : Functions) {
+    // Remarks must describe the flows before the calls are rewritten.
+    if (not F.Flows.empty()) {
+      OptimizationRemarkEmitter ORE(F.Fn);
+
+      // Number the function's values once for all of its witness paths.
+      std::unique_ptr<ModuleSlotTracker> MST;
+      if (not F.Witnesses.empty()) {
+        MST.reset(new ModuleSlotTracker(F.Fn->getParent()));
+        MST->incorporateFunction(*F.Fn);
+      }
+
+      for (size_t i = 0; i < F.Flows.size(); i++) {
+        auto &Flow = F.Flows[i];
+
+        for (size_t j = 0; j < Flow.second.size(); j++) {
+          Remark(ORE, Flow.first, Flow.second[j],
+                 MST ? &F.Witnesses[i][j] : nullptr, MST.get());
+          ++NumFlows;
+        }
+      }
+    }
+
+    if (ReportOnly) {
+      if (F.FF) {
+        WriteGraph(*F.FF, *F.Fn);
+      }
+
+      continue;
+    }
+
+    if (F.FF) {
+      F.FF->TrackChanges();
+    }
+
+    for (auto &Flow : F.Flows) {
+      Source Source = IF.TranslateSource(Flow.first);
+      ++NumSources;
+
+      if (F.FF) {
+        F.FF->Inserted(cast<Instruction>(Source.Metadata()));
+      }
+
+      for (CallInst *SinkCall : Flow.second) {
+        IF.TranslateSink(SinkCall, Source);
+        ++NumSinks;
+      }
+
+      ModifiedIR = true;
+    }
+
+    if (F.FF) {
+      WriteGraph(*F.FF, *F.Fn);
+    }
+  }
+
+  return ModifiedIR;
+}
+
+//! The name of the function that a call calls (for remarks).
+static StringRef CalleeName(const CallInst *Call)
+{
+  const Function *Callee = Call->getCalledFunction();
+  return Callee ? Callee->getName() : "(indirect call)";
+}
+
+//! The name of a kind of flow (for remarks).
+static StringRef KindName(FlowKind Kind)
+{
+  switch (Kind) {
+  case FlowKind::Operand:
+    return "operand";
+
+  case FlowKind::Memory:
+    return "memory";
+
+  case FlowKind::Meta:
+    return "meta";
+  }
+
+  llvm_unreachable("unknown FlowKind");
+}
+
+/**
+ * Name a value along a witness path, at its location in the source.
+ *
+ * Values are named as operands (e.g., `%add`), except for instructions
+ * without results (e.g., stores), which are named by their opcodes.
+ */
+static ore::NV PathValue(const Value *V, ModuleSlotTracker &MST)
+{
+  std::string Name;
+  raw_string_ostream OS(Name);
+
+  auto *I = dyn_cast<Instruction>(V);
+  if (I and I->getType()->isVoidTy()) {
+    OS << I->getOpcodeName();
+  } else {
+    V->printAsOperand(OS, false, MST);
+  }
+
+  ore::NV Arg("Via", OS.str());
+  if (I) {
+    Arg.Loc = I->getDebugLoc();
+  }
+
+  return Arg;
+}
+
+/**
+ * Append a witness path to a remark: the source's value, then each flow
+ * along the path and the value that it flows into, e.g.,
+ * `%call -memory-> %0 -operand-> %add ...`.
+ */
+static void DescribePath(DiagnosticInfoOptimizationBase &R,
+                         const CallInst *Source,
+                         const FlowFinder::WitnessPath &Path,
+                         ModuleSlotTracker &MST)
+{
+  R << "; path: " << PathValue(Source, MST);
+
+  for (const FlowFinder::Hop &H : Path) {
+    R << " -" << ore::NV("Flow", KindName(H.Kind)) << "-> "
+      << PathValue(H.To, MST);
+  }
+}
+
+/**
+ * Describe a source-to-sink flow as an optimization remark at the sink,
+ * along with the path that the flow takes if we have one.
+ *
+ * Flows that we instrument are reported as passed optimizations; with
+ * `-prov-report-only`, they are reported as analysis results.
+ */
+static void Remark(OptimizationRemarkEmitter &ORE, CallInst *Source,
+                   CallInst *Sink, const FlowFinder::WitnessPath *Path,
+                   ModuleSlotTracker *MST)
+{
+  using ore::NV;
+
+  if (ReportOnly) {
+    OptimizationRemarkAnalysis R(DEBUG_TYPE, "Flow", Sink);
+    R << "information from " << NV("Source", CalleeName(Source))
+      << " (" << NV("SourceLoc", Source->getDebugLoc()) << ")"
+      << " flows to " << NV("Sink", CalleeName(Sink));
+
+    if (Path) {
+      DescribePath(R, Source, *Path, *MST);
+    }
+
+    ORE.emit(R);
+  } else {
+    OptimizationRemark R(DEBUG_TYPE, "InstrumentedFlow", Sink);
+    R << "instrumented flow from " << NV("Source", CalleeName(Source))
+      << " (" << NV("SourceLoc", Source->getDebugLoc()) << ")"
+      << " to " << NV("Sink", CalleeName(Sink));
+
+    if (Path) {
+      DescribePath(R, Source, *Path, *MST);
+    }
+
+    ORE.emit(R);
+  }
+}
+
+/**
+ * Summarize a module's functions, before any instrumentation, if we need
+ * their summaries (to use them or to embed the exported functions' summaries
+ * for link-time combination).
+ *
+ * Summaries must use the same call semantics and alias analyses as our
+ * instrumentation, or they will describe different flows than the ones that
+ * we instrument.
+ *
+ * @returns   the summaries, or nullptr if we don't need them
+ */
+static std::unique_ptr<FlowSummaries>
+Summarize(Module &M, const CallSemantics &CS,
+          std::vector<FunctionFlows> &Functions)
+{
+  if (not ExportSummaries and not UseSummaries) {
+    return nullptr;
+  }
+
+  DenseMap<const Function*, const FunctionFlows*> ByFunction;
+  for (const FunctionFlows &F : Functions) {
+    ByFunction[F.Fn] = &F;
+  }
+
+  // Each function's MemorySSA is only needed until the next is asked for.
+  std::unique_ptr<FunctionMemorySSA> Current;
+  std::unique_ptr<FlowSummaries> Summaries(new FlowSummaries(CS));
+
+  Summaries->Compute(M, [&](Function &Fn) -> MemorySSA& {
+    const FunctionFlows &F = *ByFunction.lookup(&Fn);
+    Current.reset(new FunctionMemorySSA(Fn, *F.TLI, *F.AC));
+    return *Current->MSSA;
+  }, AnalysisThreads);
+
+  if (ExportSummaries) {
+    Summaries->Export(M);
+  }
+
+  if (not UseSummaries) {
+    return nullptr;
+  }
+
+  return Summaries;
+}
+
+/**
+ * Find the source-to-sink flows within a function, or look them up in
+ * the flow cache if we have already found them for identical IR.
+ *
+ * This may run concurrently with the analysis of other functions.
+ */
+static void Analyse(FunctionFlows &Result, const CallSemantics &CS,
+                    const FlowSummaries *Summaries, FlowCache *Cache)
+{
+  if (not Cache) {
+    FindFlows(Result, CS, Summaries);
+    return;
+  }
+
+  FlowCache::Key Key =
+    FlowCache::KeyFor(*Result.Fn, (CS.Name() + "/" + AliasAnalyses + "/"
+                                   + CacheVersion).str());
+
+  if (auto Words = Cache->Lookup(Key)) {
+    if (DecodeFlows(Result, *Words)) {
+      return;
+    }
+
+    Result.Flows.clear();
+  }
+
+  FindFlows(Result, CS, Summaries);
+  Cache->Insert(Key, EncodeFlows(Result));
+}
+
+/**
+ * Find the source-to-sink flows within a function.
+ *
+ * This builds the function's MemorySSA itself, both because the pass manager
+ * can't be asked for it from multiple threads and so that the same flows are
+ * found whichever pass manager runs us (and whatever alias analyses it has
+ * been told to use). Our MemorySSA uses the function-local alias analyses of
+ * the pass manager's default stack (see @ref AliasAnalyses), so that TBAA and
+ * `restrict` metadata rule out flows just as they would in an optimizing
+ * pipeline.
+ *
+ * With @a Summaries, calls to summarized functions that can pass information
+ * to sinks are sinks too, but they are only reported (we can only instrument
+ * calls to the sinks themselves).
+ */
+static void FindFlows(FunctionFlows &Result, const CallSemantics &CS,
+                      const FlowSummaries *Summaries)
+{
+  Function &Fn = *Result.Fn;
+
+  assert(Result.TLI and Result.AC);
+  FunctionMemorySSA Memory(Fn, *Result.TLI, *Result.AC);
+  MemorySSA &MSSA = *Memory.MSSA;
+
+  std::vector<Value*> Sources;
 
   for (auto& I : instructions(Fn)) {
     if (CallInst* Call = dyn_cast<CallInst>(&I)) {
-      if (not CS.IsSource(Call)) {
-        continue;
+      if (CS.IsSource(Call)) {
+        Sources.push_back(Call);
       }
+    }
+  }
+
+  std::unique_ptr<FlowFinder> FF(new FlowFinder(CS, Summaries));
+  std::vector<FlowFinder::ValueSet> Sinks;
+
+  if (not InstrumentedGraphDir.empty()) {
+    // Build the full graph up front and keep it up to date as we instrument,
+    // rather than re-analysing the instrumented function afterwards.
+    FF->FindPairwise(Fn, MSSA);
+    Sinks = FF->FindSinks(Sources);
+  } else if (Witness) {
+    // Witness paths are found over the forward flow graph.
+    FF->FindReachable(Fn, MSSA, Sources);
+    Sinks = FF->FindSinks(Sources);
+  } else {
+    Sinks = FF->FindSinks(Fn, MSSA, Sources);
+  }
+
+  ++NumFunctions;
+
+  // Put each source's sinks in instruction order.
+  DenseMap<const Value*, uint32_t> Position;
+
+  for (size_t i = 0; i < Sources.size(); i++) {
+    if (Sinks[i].empty()) {
+      continue;
+    }
 
-      for (Value *Sink : FF.FindEventual(PairwiseFlows, Call, IsSink)) {
-        DataFlows[Call].push_back(Sink);
+    if (Position.empty()) {
+      Position = Number(Fn);
+    }
+
+    std::vector<CallInst*> SinkCalls;
+    for (Value *Sink : Sinks[i]) {
+      auto *Call = cast<CallInst>(Sink);
+      if (ReportOnly or CS.CanSink(Call)) {
+        SinkCalls.push_back(Call);
       }
     }
+
+    if (SinkCalls.empty()) {
+      continue;
+    }
+
+    std::sort(SinkCalls.begin(), SinkCalls.end(),
+              [&Position](const CallInst *x, const CallInst *y) {
+                return Position.lookup(x) < Position.lookup(y);
+              });
+
+    if (Witness) {
+      std::vector<Value*> SinkValues(SinkCalls.begin(), SinkCalls.end());
+      Result.Witnesses.push_back(FF->FindWitnesses(Sources[i], SinkValues));
+    }
+
+    Result.Flows.emplace_back(cast<CallInst>(Sources[i]),
+                              std::move(SinkCalls));
   }
 
-  bool ModifiedIR = false;
+  if (not InstrumentedGraphDir.empty()) {
+    Result.FF = std::move(FF);
+  }
+}
+
+FunctionMemorySSA::FunctionMemorySSA(Function &Fn,
+                                     const TargetLibraryInfo &TLI,
+                                     AssumptionCache &AC)
+  : DT(Fn), BasicAA(Fn.getParent()->getDataLayout(), TLI, AC, &DT), AA(TLI)
+{
+  AA.addAAResult(BasicAA);
+  AA.addAAResult(ScopedNoAliasAA);
+  AA.addAAResult(TypeBasedAA);
+
+  MSSA.reset(new MemorySSA(Fn, &AA, &DT));
+}
 
-  for (auto Flow : DataFlows) {
-    Source Source = IF->TranslateSource(dyn_cast<CallInst>(Flow.first));
+//! Number a function's instructions in order.
+static DenseMap<const Value*, uint32_t> Number(Function &Fn) {
+  DenseMap<const Value*, uint32_t> Numbers;
+  uint32_t N = 0;
 
-    for (Value *SinkCall : Flow.second) {
-      IF->TranslateSink(dyn_cast<CallInst>(SinkCall), Source);
+  for (auto& I : instructions(Fn)) {
+    Numbers[&I] = N++;
+  }
+
+  return Numbers;
+}
+
+/**
+ * Encode a function's flows by instruction number:
+ * [ flow count, { source, sink count, sinks... }... ].
+ */
+static std::vector<uint32_t> EncodeFlows(const FunctionFlows &F) {
+  std::vector<uint32_t> Words = { static_cast<uint32_t>(F.Flows.size()) };
+
+  if (F.Flows.empty()) {
+    return Words;
+  }
+
+  DenseMap<const Value*, uint32_t> Numbers = Number(*F.Fn);
+
+  for (auto &Flow : F.Flows) {
+    Words.push_back(Numbers.lookup(Flow.first));
+    Words.push_back(Flow.second.size());
+
+    for (CallInst *Sink : Flow.second) {
+      Words.push_back(Numbers.lookup(Sink));
     }
+  }
 
-    ModifiedIR = true;
+  return Words;
+}
+
+//! Decode flows encoded by @ref EncodeFlows, checking that they make sense.
+static bool DecodeFlows(FunctionFlows &F, ArrayRef<uint32_t> Words) {
+  if (Words.empty()) {
+    return false;
   }
 
-  return ModifiedIR;
+  std::vector<Instruction*> Instructions;
+  for (auto& I : instructions(*F.Fn)) {
+    Instructions.push_back(&I);
+  }
+
+  auto CallAt = [&](uint32_t N) -> CallInst* {
+    return N < Instructions.size() ? dyn_cast<CallInst>(Instructions[N])
+                                   : nullptr;
+  };
+
+  size_t Pos = 1;
+
+  for (uint32_t i = 0; i < Words[0]; i++) {
+    if (Pos + 2 > Words.size()) {
+      return false;
+    }
+
+    CallInst *Source = CallAt(Words[Pos++]);
+    const uint32_t NumSinks = Words[Pos++];
+
+    if (not Source or NumSinks > Words.size() - Pos) {
+      return false;
+    }
+
+    std::vector<CallInst*> Sinks;
+    for (uint32_t j = 0; j < NumSinks; j++) {
+      CallInst *Sink = CallAt(Words[Pos++]);
+      if (not Sink) {
+        return false;
+      }
+
+      Sinks.push_back(Sink);
+    }
+
+    F.Flows.emplace_back(Source, std::move(Sinks));
+  }
+
+  return Pos == Words.size();
+}
+
+static size_t InstructionCount(const Function &Fn) {
+  size_t Count = 0;
+
+  for (const BasicBlock &BB : Fn) {
+    Count += BB.size();
+  }
+
+  return Count;
+}
+
+/**
+ * Write a function's instrumented flow graph to a directory named after its
+ * module (see @ref GraphArchive::NameFor), so that identically-named
+ * functions in different modules don't overwrite each other.
+ */
+static void WriteGraph(FlowFinder &FF, const Function &Fn) {
+  const string Dir =
+    InstrumentedGraphDir + "/" + GraphArchive::NameFor(*Fn.getParent());
+
+  std::error_code Err = sys::fs::create_directories(Dir);
+  if (Err) {
+    errs() << "Error creating output directory '" << Dir
+      << "': " << Err.message() << "\n";
+    return;
+  }
+
+  std::string Filename = (Dir + "/" + Fn.getName() + ".dot").str();
+  auto Flags = sys::fs::OpenFlags::F_RW | sys::fs::OpenFlags::F_Text;
+
+  raw_fd_ostream GraphFile(Filename, Err, Flags);
+
+  if (Err) {
+    errs() << "Error opening graph file: " << Err.message() << "\n";
+    return;
+  }
+
+  FF.Graph(FF.Flows(), Fn.getName(), true, GraphFile);
 }
 
 static string JoinVec(const std::vector<string>& V) {
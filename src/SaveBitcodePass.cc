@@ -0,0 +1,136 @@
+//! @file SaveBitcodePass.cc  Passes that save a module's optimized bitcode.
+/*
+ * Copyright (c) 2017 Jonathan Anderson
+ * All rights reserved.
+ *
+ * This software was developed by BAE Systems, the University of Cambridge
+ * Computer Laboratory, and Memorial University under DARPA/AFRL contract
+ * FA8650-15-C-7558 ("CADETS"), as part of the DARPA Transparent Computing
+ * (TC) research program.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#include "Passes.hh"
+
+#include <llvm/ADT/Twine.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/Config/llvm-config.h>
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Support/ErrorHandling.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Transforms/IPO/PassManagerBuilder.h>
+#include <llvm/Pass.h>
+
+using namespace llvm;
+using namespace llvm::prov;
+
+
+namespace llvm {
+  struct SaveBitcode : public ModulePass {
+    static char ID;
+    SaveBitcode() : ModulePass(ID) {}
+
+    bool runOnModule(Module&) override;
+    void getAnalysisUsage(AnalysisUsage &AU) const override {
+      AU.setPreservesAll();
+    }
+  };
+}
+
+namespace {
+  cl::opt<std::string> SaveBitcodeFile("prov-save-bitcode",
+    cl::desc("Write the module's bitcode to a file at the end of the "
+             "optimization pipeline, alongside the compiler's usual output "
+             "(see scripts/lpcc)"),
+    cl::value_desc("filename"));
+}
+
+static void Save(const Module&);
+
+
+bool SaveBitcode::runOnModule(Module &M)
+{
+  Save(M);
+  return false;
+}
+
+bool SaveBitcodePass::Enabled()
+{
+  return not SaveBitcodeFile.empty();
+}
+
+PreservedAnalyses SaveBitcodePass::run(Module &M, ModuleAnalysisManager&)
+{
+  Save(M);
+  return PreservedAnalyses::all();
+}
+
+static void Save(const Module &M)
+{
+  std::error_code Err;
+  raw_fd_ostream Out(SaveBitcodeFile, Err, sys::fs::F_None);
+
+  // Whoever asked for the bitcode (e.g., lpcc) expects to find it next to
+  // the object file, so don't carry on compiling without it.
+  if (Err) {
+    report_fatal_error(Twine("Error opening '") + SaveBitcodeFile + "': "
+                       + Err.message(), false);
+  }
+
+#if LLVM_VERSION_MAJOR >= 7
+  WriteBitcodeToFile(M, Out);
+#else
+  WriteBitcodeToFile(&M, Out);
+#endif
+}
+
+
+char SaveBitcode::ID = 0;
+
+static RegisterPass<SaveBitcode> X("save-bitcode",
+                                   "Save bitcode (see -prov-save-bitcode)",
+                                   false, true);
+
+/**
+ * When loaded into clang (`-Xclang -load`), save the bitcode that clang
+ * would have written with `-emit-llvm`, i.e., after the optimizer has run
+ * but before code generation, so that one compilation produces both the
+ * bitcode and the object file.
+ */
+static void AddSaveBitcode(const PassManagerBuilder&,
+                           legacy::PassManagerBase &PM)
+{
+  if (SaveBitcodePass::Enabled()) {
+    PM.add(new SaveBitcode());
+  }
+}
+
+static RegisterStandardPasses
+  SaveOptimized(PassManagerBuilder::EP_OptimizerLast, AddSaveBitcode);
+
+static RegisterStandardPasses
+  SaveUnoptimized(PassManagerBuilder::EP_EnabledOnOptLevel0, AddSaveBitcode);
@@ -0,0 +1,528 @@
+//! @file SemanticsTable.cc  Definition of @ref llvm::prov::SemanticsTable.
+/*
+ * Copyright (c) 2017 Jonathan Anderson
+ * All rights reserved.
+ *
+ * This software was developed by BAE Systems, the University of Cambridge
+ * Computer Laboratory, and Memorial University under DARPA/AFRL contract
+ * FA8650-15-C-7558 ("CADETS"), as part of the DARPA Transparent Computing
+ * (TC) research program.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#include "SemanticsTable.hh"
+
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/ADT/StringSet.h>
+#include <llvm/ADT/Twine.h>
+#include <llvm/Support/MathExtras.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+
+using namespace llvm;
+using namespace llvm::prov;
+using std::string;
+
+
+namespace {
+  //! The header of a compiled table.
+  struct TableHeader {
+    uint32_t Magic;
+    uint32_t Version;
+    uint32_t NumSlots;
+    uint32_t NumBuckets;
+    uint32_t Checksum;        //!< of everything after the header
+    uint32_t NameOffset;      //!< in the string table
+    uint32_t NameLength;
+    uint32_t StringsOffset;   //!< from the start of the table
+    uint32_t StringsSize;
+  };
+
+  //! A slot in a compiled table: one function's roles.
+  struct TableSlot {
+    uint32_t NameOffset;
+    uint32_t NameLength;
+    uint32_t WrapperOffset;
+    uint32_t WrapperLength;
+    uint8_t Flags;
+    uint8_t NumOutputs;
+    int8_t Data;
+    uint8_t Padding;
+    uint8_t Outputs[SemanticsTable::MaxOutputs];
+  };
+
+  enum : uint8_t { SourceFlag = 1, SinkFlag = 2 };
+
+  //! "PSEM" in native byte order: tables are compiled for the host.
+  const uint32_t TableMagic = 0x4d455350;
+  const uint32_t TableVersion = 1;
+
+  //! The most displacements to try for a bucket before adding buckets.
+  const uint32_t MaxDisplacement = 1 << 16;
+
+  //! The layout of a table's displacements and slots.
+  struct Layout {
+    const TableHeader *Header;
+    const uint32_t *Displacements;
+    const TableSlot *Slots;
+    const char *Strings;
+
+    Layout(StringRef Data)
+      : Header(reinterpret_cast<const TableHeader*>(Data.data())),
+        Displacements(reinterpret_cast<const uint32_t*>(Header + 1)),
+        Slots(reinterpret_cast<const TableSlot*>(
+          Displacements + Header->NumBuckets)),
+        Strings(Data.data() + Header->StringsOffset)
+    {
+    }
+
+    StringRef Name(const TableSlot &S) const {
+      return StringRef(Strings + S.NameOffset, S.NameLength);
+    }
+
+    StringRef Wrapper(const TableSlot &S) const {
+      return StringRef(Strings + S.WrapperOffset, S.WrapperLength);
+    }
+  };
+}
+
+//! FNV-1a with a final avalanche, seeded for hash-and-displace lookups.
+static uint32_t Hash(StringRef S, uint32_t Seed)
+{
+  uint32_t H = 2166136261u ^ Seed;
+  for (unsigned char C : S) {
+    H = (H ^ C) * 16777619u;
+  }
+
+  H ^= H >> 16;
+  H *= 0x85ebca6b;
+  H ^= H >> 13;
+  H *= 0xc2b2ae35;
+  H ^= H >> 16;
+
+  return H;
+}
+
+//! FNV-1a over a byte range.
+static uint32_t Checksum(StringRef Bytes)
+{
+  uint32_t H = 2166136261u;
+  for (unsigned char C : Bytes) {
+    H = (H ^ C) * 16777619u;
+  }
+
+  return H;
+}
+
+/**
+ * Find a displacement for each bucket of entries that puts every entry in
+ * its own slot.
+ *
+ * @returns whether or not every bucket could be placed
+ */
+static bool Place(ArrayRef<SemanticsTable::Entry> Entries, uint32_t NumBuckets,
+                  std::vector<uint32_t> &Displacements,
+                  std::vector<uint32_t> &SlotOf)
+{
+  const uint32_t NumSlots = Entries.size();
+
+  std::vector<std::vector<uint32_t>> Buckets(NumBuckets);
+  for (uint32_t i = 0; i < NumSlots; i++) {
+    Buckets[Hash(Entries[i].Name, 0) % NumBuckets].push_back(i);
+  }
+
+  // Place the biggest buckets first, while there are the most free slots.
+  std::vector<uint32_t> Order(NumBuckets);
+  std::iota(Order.begin(), Order.end(), 0);
+  std::stable_sort(Order.begin(), Order.end(), [&](uint32_t x, uint32_t y) {
+    return Buckets[x].size() > Buckets[y].size();
+  });
+
+  std::vector<bool> Taken(NumSlots);
+  Displacements.assign(NumBuckets, 1);
+  SlotOf.assign(NumSlots, 0);
+
+  for (uint32_t B : Order) {
+    if (Buckets[B].empty()) {
+      break;
+    }
+
+    bool Placed = false;
+
+    for (uint32_t D = 1; D < MaxDisplacement and not Placed; D++) {
+      SmallVector<uint32_t, 4> Slots;
+
+      for (uint32_t i : Buckets[B]) {
+        uint32_t S = Hash(Entries[i].Name, D) % NumSlots;
+        if (Taken[S] or is_contained(Slots, S)) {
+          break;
+        }
+
+        Slots.push_back(S);
+      }
+
+      if (Slots.size() < Buckets[B].size()) {
+        continue;
+      }
+
+      for (size_t j = 0; j < Slots.size(); j++) {
+        Taken[Slots[j]] = true;
+        SlotOf[Buckets[B][j]] = Slots[j];
+      }
+
+      Displacements[B] = D;
+      Placed = true;
+    }
+
+    if (not Placed) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+
+const unsigned SemanticsTable::MaxOutputs;
+
+bool SemanticsTable::Parse(StringRef Text, StringRef Filename, string &Name,
+                           std::vector<Entry> &Entries, string &Err)
+{
+  StringSet<> Seen;
+  SmallVector<StringRef, 64> Lines;
+  Text.split(Lines, '\n');
+
+  for (size_t i = 0; i < Lines.size(); i++) {
+    auto Fail = [&](const Twine &Message) {
+      Err = (Filename + ":" + Twine(i + 1) + ": " + Message).str();
+      return false;
+    };
+
+    StringRef Line = Lines[i].split('#').first.trim();
+    if (Line.empty()) {
+      continue;
+    }
+
+    SmallVector<StringRef, 8> Tokens;
+    SplitString(Line, Tokens);
+
+    if (Tokens[0] == "semantics") {
+      if (Tokens.size() != 2) {
+        return Fail("expected 'semantics <name>'");
+      }
+
+      Name = Tokens[1];
+      continue;
+    }
+
+    Entry E;
+    E.Name = Tokens[0];
+
+    if (not Seen.insert(E.Name).second) {
+      return Fail("duplicate entry for '" + E.Name + "'");
+    }
+
+    auto ArgNumber = [](StringRef S, unsigned &N) {
+      return not S.getAsInteger(10, N) and N <= 127;
+    };
+
+    for (StringRef Token : makeArrayRef(Tokens).drop_front()) {
+      if (Token == "source") {
+        E.Source = true;
+        continue;
+      }
+
+      if (Token == "sink") {
+        E.Sink = true;
+        continue;
+      }
+
+      StringRef Key, Value;
+      std::tie(Key, Value) = Token.split('=');
+
+      if (Value.empty()) {
+        return Fail("unexpected '" + Token + "'");
+      }
+
+      if (Key == "out") {
+        SmallVector<StringRef, 4> Args;
+        Value.split(Args, ',');
+
+        for (StringRef Arg : Args) {
+          unsigned N;
+          if (not ArgNumber(Arg, N)) {
+            return Fail("invalid argument number '" + Arg + "'");
+          }
+
+          E.OutputArgs.push_back(N);
+        }
+
+      } else if (Key == "data") {
+        unsigned N;
+        if (Value == "ret") {
+          E.Data = CallSemantics::Roles::ReturnValue;
+        } else if (ArgNumber(Value, N)) {
+          E.Data = N;
+        } else {
+          return Fail("invalid data location '" + Value + "'");
+        }
+
+      } else if (Key == "wrapper") {
+        E.Wrapper = Value;
+
+      } else {
+        return Fail("unknown property '" + Key + "'");
+      }
+    }
+
+    if (not E.Source and not E.Sink) {
+      return Fail("'" + E.Name + "' is neither a source nor a sink");
+    }
+
+    if (E.OutputArgs.size() > MaxOutputs) {
+      return Fail("'" + E.Name + "' has more than " + Twine(MaxOutputs)
+                  + " output arguments");
+    }
+
+    if (E.Data != CallSemantics::Roles::NoData and not E.Source) {
+      return Fail("only sources can have data");
+    }
+
+    Entries.push_back(std::move(E));
+  }
+
+  if (Name.empty()) {
+    Err = (Filename + ": missing 'semantics <name>'").str();
+    return false;
+  }
+
+  return true;
+}
+
+void SemanticsTable::Compile(StringRef Name, ArrayRef<Entry> Entries,
+                             raw_ostream &Out)
+{
+  const uint32_t NumSlots = Entries.size();
+  uint32_t NumBuckets = std::max(1u, (NumSlots + 1) / 2);
+
+  std::vector<uint32_t> Displacements;
+  std::vector<uint32_t> SlotOf;
+
+  if (NumSlots > 0) {
+    while (not Place(Entries, NumBuckets, Displacements, SlotOf)) {
+      NumBuckets *= 2;
+    }
+  } else {
+    Displacements.assign(NumBuckets, 1);
+  }
+
+  string Strings;
+  auto AddString = [&Strings](StringRef S) {
+    uint32_t Offset = Strings.size();
+    Strings += S;
+    return Offset;
+  };
+
+  TableHeader Header;
+  std::memset(&Header, 0, sizeof(Header));
+  Header.Magic = TableMagic;
+  Header.Version = TableVersion;
+  Header.NumSlots = NumSlots;
+  Header.NumBuckets = NumBuckets;
+  Header.NameOffset = AddString(Name);
+  Header.NameLength = Name.size();
+
+  std::vector<TableSlot> Slots(NumSlots);
+  std::memset(Slots.data(), 0, Slots.size() * sizeof(TableSlot));
+
+  for (uint32_t i = 0; i < NumSlots; i++) {
+    const Entry &E = Entries[i];
+    TableSlot &S = Slots[SlotOf[i]];
+
+    S.NameOffset = AddString(E.Name);
+    S.NameLength = E.Name.size();
+    S.WrapperOffset = AddString(E.Wrapper);
+    S.WrapperLength = E.Wrapper.size();
+    S.Flags = (E.Source ? SourceFlag : 0) | (E.Sink ? SinkFlag : 0);
+    S.NumOutputs = E.OutputArgs.size();
+    S.Data = E.Data;
+
+    for (size_t j = 0; j < E.OutputArgs.size(); j++) {
+      S.Outputs[j] = E.OutputArgs[j];
+    }
+  }
+
+  string Body;
+  Body.append(reinterpret_cast<const char*>(Displacements.data()),
+              Displacements.size() * sizeof(uint32_t));
+  Body.append(reinterpret_cast<const char*>(Slots.data()),
+              Slots.size() * sizeof(TableSlot));
+
+  Header.StringsOffset = sizeof(Header) + Body.size();
+  Header.StringsSize = Strings.size();
+  Body += Strings;
+
+  Header.Checksum = Checksum(Body);
+
+  Out.write(reinterpret_cast<const char*>(&Header), sizeof(Header));
+  Out << Body;
+}
+
+std::unique_ptr<SemanticsTable> SemanticsTable::Open(StringRef Data,
+                                                     string &Err)
+{
+  if (Data.size() < sizeof(TableHeader)) {
+    Err = "table is truncated";
+    return nullptr;
+  }
+
+  if (reinterpret_cast<uintptr_t>(Data.data()) % alignof(TableHeader)) {
+    Err = "table is misaligned";
+    return nullptr;
+  }
+
+  const TableHeader &H = *reinterpret_cast<const TableHeader*>(Data.data());
+
+  if (H.Magic != TableMagic) {
+    Err = (H.Magic == ByteSwap_32(TableMagic))
+      ? "table was compiled for a host with a different byte order"
+      : "not a call semantics table";
+    return nullptr;
+  }
+
+  if (H.Version != TableVersion) {
+    Err = "unsupported table version " + std::to_string(H.Version);
+    return nullptr;
+  }
+
+  const uint64_t StringsOffset = sizeof(TableHeader)
+    + uint64_t(H.NumBuckets) * sizeof(uint32_t)
+    + uint64_t(H.NumSlots) * sizeof(TableSlot);
+
+  if (H.NumBuckets == 0 or H.StringsOffset != StringsOffset
+      or StringsOffset + H.StringsSize > Data.size()) {
+    Err = "table is truncated or corrupt";
+    return nullptr;
+  }
+
+  if (Checksum(Data.slice(sizeof(TableHeader), StringsOffset + H.StringsSize))
+      != H.Checksum) {
+    Err = "table checksum mismatch";
+    return nullptr;
+  }
+
+  // Check that all strings are within the table, so lookups needn't.
+  Layout L(Data);
+  auto InStrings = [&H](uint32_t Offset, uint32_t Length) {
+    return uint64_t(Offset) + Length <= H.StringsSize;
+  };
+
+  bool Valid = InStrings(H.NameOffset, H.NameLength);
+  for (uint32_t i = 0; i < H.NumSlots; i++) {
+    const TableSlot &S = L.Slots[i];
+    Valid = Valid and InStrings(S.NameOffset, S.NameLength)
+      and InStrings(S.WrapperOffset, S.WrapperLength)
+      and S.NumOutputs <= MaxOutputs;
+  }
+
+  if (not Valid) {
+    Err = "table is corrupt";
+    return nullptr;
+  }
+
+  return std::unique_ptr<SemanticsTable>(new SemanticsTable(Data));
+}
+
+std::unique_ptr<SemanticsTable> SemanticsTable::Load(StringRef Path,
+                                                     string &Err)
+{
+  auto Buffer = MemoryBuffer::getFile(Path, -1, false);
+  if (std::error_code EC = Buffer.getError()) {
+    Err = EC.message();
+    return nullptr;
+  }
+
+  std::unique_ptr<SemanticsTable> Table = Open((*Buffer)->getBuffer(), Err);
+  if (Table) {
+    Table->Buffer = std::move(*Buffer);
+  }
+
+  return Table;
+}
+
+SemanticsTable::SemanticsTable(StringRef Data,
+                               std::unique_ptr<MemoryBuffer> Buffer)
+  : Data(Data), Buffer(std::move(Buffer))
+{
+  Layout L(Data);
+  const TableHeader &H = *L.Header;
+
+  QualifiedName = (StringRef(L.Strings + H.NameOffset, H.NameLength) + "-"
+                   + utohexstr(H.Checksum)).str();
+}
+
+SemanticsTable::~SemanticsTable()
+{
+}
+
+size_t SemanticsTable::size() const
+{
+  return Layout(Data).Header->NumSlots;
+}
+
+size_t SemanticsTable::SlotFor(StringRef Name) const
+{
+  Layout L(Data);
+  const TableHeader &H = *L.Header;
+
+  uint32_t D = L.Displacements[Hash(Name, 0) % H.NumBuckets];
+  return Hash(Name, D) % H.NumSlots;
+}
+
+CallSemantics::Roles SemanticsTable::Lookup(StringRef Name) const
+{
+  CallSemantics::Roles R;
+
+  Layout L(Data);
+  if (L.Header->NumSlots == 0) {
+    return R;
+  }
+
+  const TableSlot &S = L.Slots[SlotFor(Name)];
+  if (L.Name(S) != Name) {
+    return R;
+  }
+
+  R.Source = S.Flags & SourceFlag;
+  R.Sink = S.Flags & SinkFlag;
+  R.OutputArgs = makeArrayRef(S.Outputs, S.NumOutputs);
+  R.Data = S.Data;
+  R.Wrapper = L.Wrapper(S);
+
+  return R;
+}
@@ -0,0 +1,145 @@
+//! @file SemanticsTable.hh  Declaration of @ref llvm::prov::SemanticsTable.
+/*
+ * Copyright (c) 2017 Jonathan Anderson
+ * All rights reserved.
+ *
+ * This software was developed by BAE Systems, the University of Cambridge
+ * Computer Laboratory, and Memorial University under DARPA/AFRL contract
+ * FA8650-15-C-7558 ("CADETS"), as part of the DARPA Transparent Computing
+ * (TC) research program.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef LLVM_PROV_SEMANTICS_TABLE_H
+#define LLVM_PROV_SEMANTICS_TABLE_H
+
+#include "CallSemantics.hh"
+
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/StringRef.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+
+namespace llvm {
+
+class MemoryBuffer;
+class raw_ostream;
+
+namespace prov {
+
+/**
+ * A compiled, read-only table of the information-flow roles of functions.
+ *
+ * Tables are compiled ahead of time (by `prov-semc`) from declarative
+ * specifications like the following:
+ *
+ * ```
+ * semantics posix
+ *
+ * read    source  out=1   data=1    wrapper=metaio_read
+ * mmap    source  out=0   data=ret  wrapper=metaio_mmap
+ * write   sink                      wrapper=metaio_write
+ * ```
+ *
+ * Compiled tables are used in place, e.g., from a mapped file or from an
+ * array built into the plugin, without any parsing or copying. Functions are
+ * found with a minimal perfect hash (hash and displace): one hash of the name
+ * selects a bucket, the bucket's displacement seeds a second hash that
+ * selects the function's slot and one string comparison confirms the match.
+ */
+class SemanticsTable {
+public:
+  //! A function's entry in a specification.
+  struct Entry {
+    std::string Name;
+    bool Source = false;
+    bool Sink = false;
+    std::vector<unsigned> OutputArgs;
+    int Data = CallSemantics::Roles::NoData;
+    std::string Wrapper;
+  };
+
+  //! The most output arguments that an entry may have.
+  static const unsigned MaxOutputs = 4;
+
+  /**
+   * Parse a textual specification.
+   *
+   * @param   Filename     the name of the specification (for error messages)
+   * @param   Err          a description of the first error found, if any
+   *
+   * @returns whether or not the specification was valid
+   */
+  static bool Parse(StringRef Text, StringRef Filename, std::string &Name,
+                    std::vector<Entry>&, std::string &Err);
+
+  //! Compile named semantics into the binary table format.
+  static void Compile(StringRef Name, ArrayRef<Entry>, raw_ostream&);
+
+  /**
+   * Use a compiled table in place.
+   *
+   * The data must be 4-byte aligned and must outlive the table.
+   *
+   * @returns the table, or null (with a description in @b Err) if invalid
+   */
+  static std::unique_ptr<SemanticsTable> Open(StringRef Data,
+                                              std::string &Err);
+
+  //! Map a compiled table file into memory and use it in place.
+  static std::unique_ptr<SemanticsTable> Load(StringRef Path,
+                                              std::string &Err);
+
+  ~SemanticsTable();
+
+  /**
+   * The name of these semantics, qualified by a checksum of the table:
+   * different tables with the same name have different qualified names.
+   */
+  StringRef Name() const { return QualifiedName; }
+
+  //! Number of functions in the table.
+  size_t size() const;
+
+  //! Look up the roles of a named function.
+  CallSemantics::Roles Lookup(StringRef Name) const;
+
+private:
+  SemanticsTable(StringRef Data, std::unique_ptr<MemoryBuffer> = nullptr);
+
+  //! A name's slot in the table (which may hold some other name).
+  size_t SlotFor(StringRef Name) const;
+
+  StringRef Data;
+  std::unique_ptr<MemoryBuffer> Buffer;
+  std::string QualifiedName;
+};
+
+} // namespace prov
+} // namespace llvm
+
+#endif // LLVM_PROV_SEMANTICS_TABLE_H
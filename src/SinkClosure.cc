@@ -0,0 +1,208 @@
+//! @file SinkClosure.cc  Definition of @ref llvm::prov::SinkClosure.
+/*
+ * Copyright (c) 2017 Jonathan Anderson
+ * All rights reserved.
+ *
+ * This software was developed by BAE Systems, the University of Cambridge
+ * Computer Laboratory, and Memorial University under DARPA/AFRL contract
+ * FA8650-15-C-7558 ("CADETS"), as part of the DARPA Transparent Computing
+ * (TC) research program.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "SinkClosure.hh"
+
+#include <llvm/ADT/Statistic.h>
+
+#include <algorithm>
+
+using namespace llvm;
+using namespace llvm::prov;
+
+#define DEBUG_TYPE "prov-sink-closure"
+
+STATISTIC(NumClosures, "Number of sink closures computed");
+STATISTIC(NumFlowComponents, "Number of strongly-connected flow components");
+STATISTIC(NumCyclicComponents,
+          "Number of flow components containing more than one value");
+
+using NodeID = FlowGraph::NodeID;
+
+
+SinkClosure::SinkClosure(const FlowGraph &G, const BitVector &Sinks)
+  : SinkNodes(Sinks)
+{
+  assert(Sinks.size() == G.NumNodes());
+
+  Condense(G);
+  Close(G);
+
+  ++NumClosures;
+}
+
+std::vector<NodeID> SinkClosure::SinksFrom(NodeID Source) const
+{
+  std::vector<NodeID> Sinks;
+
+  // If the source is a sink, it's only in its own component's set when it
+  // lies on a cycle; either way, it isn't its own sink.
+  for (unsigned N : Reachable[Component[Source]]) {
+    if (N != Source) {
+      Sinks.push_back(N);
+    }
+  }
+
+  return Sinks;
+}
+
+void SinkClosure::Condense(const FlowGraph &G)
+{
+  // Iterative version of Tarjan's algorithm: components are completed in
+  // reverse topological order, so they are numbered in that order too.
+  const uint32_t Unvisited = UINT32_MAX;
+  const size_t Nodes = G.NumNodes();
+
+  std::vector<uint32_t> Index(Nodes, Unvisited), LowLink(Nodes);
+  std::vector<NodeID> Stack;
+  BitVector OnStack(Nodes);
+  uint32_t NextIndex = 0;
+  uint32_t NextComponent = 0;
+
+  struct Frame {
+    NodeID Node;
+    uint32_t NextEdge;
+  };
+  std::vector<Frame> Frames;
+
+  Component.assign(Nodes, Unvisited);
+
+  auto Visit = [&](NodeID N) {
+    Index[N] = LowLink[N] = NextIndex++;
+    Stack.push_back(N);
+    OnStack.set(N);
+    Frames.push_back({ N, 0 });
+  };
+
+  for (NodeID Root = 0; Root < Nodes; Root++) {
+    if (Index[Root] != Unvisited) {
+      continue;
+    }
+
+    Visit(Root);
+
+    while (not Frames.empty()) {
+      const NodeID N = Frames.back().Node;
+      ArrayRef<FlowGraph::Edge> Succ = G.Successors(N);
+
+      if (Frames.back().NextEdge < Succ.size()) {
+        NodeID W = Succ[Frames.back().NextEdge++].Node();
+
+        if (Index[W] == Unvisited) {
+          Visit(W);
+        } else if (OnStack.test(W)) {
+          LowLink[N] = std::min(LowLink[N], Index[W]);
+        }
+
+        continue;
+      }
+
+      Frames.pop_back();
+      if (not Frames.empty()) {
+        NodeID Parent = Frames.back().Node;
+        LowLink[Parent] = std::min(LowLink[Parent], LowLink[N]);
+      }
+
+      if (LowLink[N] != Index[N]) {
+        continue;
+      }
+
+      // N is the root of a component: pop it (and its members) off the stack.
+      NodeID Member;
+      size_t Size = 0;
+      do {
+        Member = Stack.back();
+        Stack.pop_back();
+        OnStack.reset(Member);
+        Component[Member] = NextComponent;
+        Size++;
+      } while (Member != N);
+
+      NextComponent++;
+      if (Size > 1) {
+        ++NumCyclicComponents;
+      }
+    }
+  }
+
+  NumFlowComponents += NextComponent;
+  Reachable.resize(NextComponent);
+}
+
+void SinkClosure::Close(const FlowGraph &G)
+{
+  // Group node numbers by component so that we can visit components in order.
+  const size_t Nodes = G.NumNodes();
+  const size_t Components = Reachable.size();
+
+  std::vector<uint32_t> Start(Components + 1, 0);
+  for (NodeID N = 0; N < Nodes; N++) {
+    Start[Component[N] + 1]++;
+  }
+
+  for (size_t C = 0; C < Components; C++) {
+    Start[C + 1] += Start[C];
+  }
+
+  std::vector<NodeID> Members(Nodes);
+  std::vector<uint32_t> Fill(Start.begin(), Start.end() - 1);
+  for (NodeID N = 0; N < Nodes; N++) {
+    Members[Fill[Component[N]]++] = N;
+  }
+
+  // Components are numbered in reverse topological order, so every component
+  // that C flows to has already been closed by the time we reach C.
+  std::vector<uint32_t> LastMerged(Components, UINT32_MAX);
+
+  for (uint32_t C = 0; C < Components; C++) {
+    SparseBitVector<> &Sinks = Reachable[C];
+
+    for (uint32_t i = Start[C]; i < Start[C + 1]; i++) {
+      NodeID N = Members[i];
+
+      if (SinkNodes.test(N)) {
+        Sinks.set(N);
+      }
+
+      for (FlowGraph::Edge E : G.Successors(N)) {
+        uint32_t Succ = Component[E.Node()];
+        if (Succ == C or LastMerged[Succ] == C) {
+          continue;
+        }
+
+        assert(Succ < C && "components not in reverse topological order");
+        LastMerged[Succ] = C;
+        Sinks |= Reachable[Succ];
+      }
+    }
+  }
+}
@@ -0,0 +1,100 @@
+//! @file SinkClosure.hh  Declaration of @ref llvm::prov::SinkClosure.
+/*
+ * Copyright (c) 2017 Jonathan Anderson
+ * All rights reserved.
+ *
+ * This software was developed by BAE Systems, the University of Cambridge
+ * Computer Laboratory, and Memorial University under DARPA/AFRL contract
+ * FA8650-15-C-7558 ("CADETS"), as part of the DARPA Transparent Computing
+ * (TC) research program.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef LLVM_PROV_SINK_CLOSURE_H
+#define LLVM_PROV_SINK_CLOSURE_H
+
+#include "FlowGraph.hh"
+
+#include <llvm/ADT/BitVector.h>
+#include <llvm/ADT/SparseBitVector.h>
+
+#include <vector>
+
+
+namespace llvm {
+namespace prov {
+
+/**
+ * The set of sinks reachable from every node in a @ref FlowGraph.
+ *
+ * Loops in a function create strongly-connected regions of flows, which
+ * naive searches walk again and again for every source. This type condenses
+ * the flow graph into its strongly-connected components (SCCs) using
+ * Tarjan's algorithm, then computes the set of sinks reachable from each
+ * component once, in reverse topological order, as a sparse bitvector over
+ * sink node numbers. After construction, finding the sinks of any source is
+ * a lookup.
+ */
+class SinkClosure {
+public:
+  /**
+   * Constructor.
+   *
+   * @param   Sinks     one bit per node in @b G: which nodes are sinks
+   */
+  SinkClosure(const FlowGraph &G, const BitVector &Sinks);
+
+  /**
+   * The sinks reachable from a source node, in ascending node order.
+   *
+   * As with @ref FlowFinder::FindEventual, a source is never reported as
+   * its own sink.
+   */
+  std::vector<FlowGraph::NodeID> SinksFrom(FlowGraph::NodeID Source) const;
+
+  //! The sink nodes that this closure was computed for.
+  const BitVector& Sinks() const { return SinkNodes; }
+
+  //! The number of strongly-connected components in the flow graph.
+  size_t NumComponents() const { return Reachable.size(); }
+
+private:
+  //! Assign every node to an SCC, numbered in reverse topological order.
+  void Condense(const FlowGraph&);
+
+  //! Compute each component's reachable sinks from its successors'.
+  void Close(const FlowGraph&);
+
+  const BitVector SinkNodes;
+
+  //! Node -> SCC
+  std::vector<uint32_t> Component;
+
+  //! SCC -> sink nodes reachable from (or within) the SCC
+  std::vector<SparseBitVector<>> Reachable;
+};
+
+} // namespace prov
+} // namespace llvm
+
+#endif // LLVM_PROV_SINK_CLOSURE_H
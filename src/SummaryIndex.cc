@@ -0,0 +1,304 @@
+//! @file SummaryIndex.cc  Definition of @ref llvm::prov::SummaryIndex.
+/*
+ * Copyright (c) 2017 Jonathan Anderson
+ * All rights reserved.
+ *
+ * This software was developed by BAE Systems, the University of Cambridge
+ * Computer Laboratory, and Memorial University under DARPA/AFRL contract
+ * FA8650-15-C-7558 ("CADETS"), as part of the DARPA Transparent Computing
+ * (TC) research program.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "SummaryIndex.hh"
+
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/IR/Metadata.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <algorithm>
+
+using namespace llvm;
+using namespace llvm::prov;
+using std::string;
+
+typedef FlowSummary::ExternalFlow ExternalFlow;
+
+
+//! The first line of an index file.
+static const char IndexHeader[] = "prov-summary-index 1";
+
+const char SummaryIndex::MetadataName[] = "prov.summaries";
+
+
+static void EncodeBits(const BitVector &Bits, raw_ostream &Out)
+{
+  for (unsigned i = 0; i < Bits.size(); i++) {
+    Out << (Bits.test(i) ? '1' : '0');
+  }
+}
+
+static bool DecodeBits(StringRef S, BitVector &Bits)
+{
+  if (S.size() != Bits.size()) {
+    return false;
+  }
+
+  for (unsigned i = 0; i < S.size(); i++) {
+    if (S[i] == '1') {
+      Bits.set(i);
+    } else if (S[i] != '0') {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+/**
+ * Summaries are encoded as semicolon-separated fields: the number of
+ * arguments, bits for each of the per-argument sets (return, memory, sink,
+ * source), whether sources reach the return value and then any number of
+ * external flows, each as `callee:arg:from` (where `from` is an argument
+ * number or `s` for a source).
+ */
+string llvm::prov::EncodeSummary(const FlowSummary &S)
+{
+  string Encoded;
+  raw_string_ostream Out(Encoded);
+
+  Out << S.ArgToReturn.size() << ';';
+  EncodeBits(S.ArgToReturn, Out);
+  Out << ';';
+  EncodeBits(S.ArgToMemory, Out);
+  Out << ';';
+  EncodeBits(S.ArgToSink, Out);
+  Out << ';';
+  EncodeBits(S.SourceToArg, Out);
+  Out << ';' << (S.SourceToReturn ? '1' : '0');
+
+  for (const ExternalFlow &E : S.External) {
+    Out << ';' << E.Callee << ':' << E.Arg << ':';
+
+    if (E.From == ExternalFlow::FromSource) {
+      Out << 's';
+    } else {
+      Out << E.From;
+    }
+  }
+
+  return Out.str();
+}
+
+bool llvm::prov::DecodeSummary(StringRef Encoded, FlowSummary &S)
+{
+  SmallVector<StringRef, 8> Fields;
+  Encoded.split(Fields, ';');
+
+  unsigned NumArgs;
+  if (Fields.size() < 6 or Fields[0].getAsInteger(10, NumArgs)) {
+    return false;
+  }
+
+  S = FlowSummary(NumArgs);
+
+  if (not DecodeBits(Fields[1], S.ArgToReturn)
+      or not DecodeBits(Fields[2], S.ArgToMemory)
+      or not DecodeBits(Fields[3], S.ArgToSink)
+      or not DecodeBits(Fields[4], S.SourceToArg)
+      or (Fields[5] != "0" and Fields[5] != "1")) {
+    return false;
+  }
+
+  S.SourceToReturn = (Fields[5] == "1");
+
+  for (StringRef Field : makeArrayRef(Fields).drop_front(6)) {
+    StringRef Rest, From, Arg;
+    std::tie(Rest, From) = Field.rsplit(':');
+    std::tie(Rest, Arg) = Rest.rsplit(':');
+
+    ExternalFlow E;
+    E.Callee = Rest.str();
+
+    if (Rest.empty() or Arg.getAsInteger(10, E.Arg)) {
+      return false;
+    }
+
+    if (From == "s") {
+      E.From = ExternalFlow::FromSource;
+    } else if (From.getAsInteger(10, E.From) or E.From < 0
+               or static_cast<unsigned>(E.From) >= NumArgs) {
+      return false;
+    }
+
+    S.External.push_back(std::move(E));
+  }
+
+  std::sort(S.External.begin(), S.External.end());
+  return true;
+}
+
+
+bool SummaryIndex::CrossModuleSink::operator < (const CrossModuleSink &S)
+  const
+{
+  return std::tie(Caller, Callee, Arg) < std::tie(S.Caller, S.Callee, S.Arg);
+}
+
+int SummaryIndex::Add(const Module &M)
+{
+  const NamedMDNode *Node = M.getNamedMetadata(MetadataName);
+  if (not Node) {
+    return 0;
+  }
+
+  int Added = 0;
+
+  for (const MDNode *Entry : Node->operands()) {
+    if (Entry->getNumOperands() != 2) {
+      return -1;
+    }
+
+    auto *Name = dyn_cast<MDString>(Entry->getOperand(0));
+    auto *Encoded = dyn_cast<MDString>(Entry->getOperand(1));
+    FlowSummary S;
+
+    if (not Name or not Encoded
+        or not DecodeSummary(Encoded->getString(), S)) {
+      return -1;
+    }
+
+    // Like the linker, take the first definition of each function.
+    if (Summaries.insert({ Name->getString(), std::move(S) }).second) {
+      Added++;
+    }
+  }
+
+  return Added;
+}
+
+bool SummaryIndex::Read(StringRef Text, string &Err)
+{
+  SmallVector<StringRef, 64> Lines;
+  Text.split(Lines, '\n', -1, false);
+
+  if (Lines.empty() or Lines.front() != IndexHeader) {
+    Err = "not a flow summary index";
+    return false;
+  }
+
+  for (size_t i = 1; i < Lines.size(); i++) {
+    StringRef Name, Encoded;
+    std::tie(Name, Encoded) = Lines[i].split('\t');
+
+    FlowSummary S;
+    if (Name.empty() or not DecodeSummary(Encoded, S)) {
+      Err = "invalid summary on line " + std::to_string(i + 1);
+      return false;
+    }
+
+    Summaries[Name] = std::move(S);
+  }
+
+  return true;
+}
+
+void SummaryIndex::Combine()
+{
+  // Flows only ever add bits, so iterating until nothing changes reaches
+  // a fixed point (in at most one round per link in the longest chain of
+  // cross-module calls).
+  bool Changed;
+
+  do {
+    Changed = false;
+
+    for (auto &Entry : Summaries) {
+      FlowSummary &S = Entry.getValue();
+
+      for (const ExternalFlow &E : S.External) {
+        const FlowSummary *Callee = Lookup(E.Callee);
+        if (E.From == ExternalFlow::FromSource or not Callee
+            or E.Arg >= Callee->ArgToSink.size()) {
+          continue;
+        }
+
+        auto Merge = [&](BitVector &Bits, const BitVector &CalleeBits) {
+          if (CalleeBits.test(E.Arg) and not Bits.test(E.From)) {
+            Bits.set(E.From);
+            Changed = true;
+          }
+        };
+
+        // Our argument is passed to the callee: what happens to it there
+        // happens to it here.
+        Merge(S.ArgToSink, Callee->ArgToSink);
+        Merge(S.ArgToMemory, Callee->ArgToMemory);
+        Merge(S.SourceToArg, Callee->SourceToArg);
+      }
+    }
+  } while (Changed);
+}
+
+std::vector<SummaryIndex::CrossModuleSink>
+SummaryIndex::CrossModuleSinks() const
+{
+  std::vector<CrossModuleSink> Sinks;
+
+  for (auto &Entry : Summaries) {
+    for (const ExternalFlow &E : Entry.getValue().External) {
+      const FlowSummary *Callee = Lookup(E.Callee);
+
+      if (E.From == ExternalFlow::FromSource and Callee
+          and E.Arg < Callee->ArgToSink.size()
+          and Callee->ArgToSink.test(E.Arg)) {
+        Sinks.push_back({ Entry.getKey().str(), E.Callee, E.Arg });
+      }
+    }
+  }
+
+  std::sort(Sinks.begin(), Sinks.end());
+  return Sinks;
+}
+
+const FlowSummary* SummaryIndex::Lookup(StringRef Name) const
+{
+  auto i = Summaries.find(Name);
+  return (i == Summaries.end()) ? nullptr : &i->getValue();
+}
+
+void SummaryIndex::print(raw_ostream &Out) const
+{
+  std::vector<StringRef> Names;
+  for (auto &Entry : Summaries) {
+    Names.push_back(Entry.getKey());
+  }
+
+  std::sort(Names.begin(), Names.end());
+
+  Out << IndexHeader << "\n";
+  for (StringRef Name : Names) {
+    Out << Name << "\t" << EncodeSummary(*Lookup(Name)) << "\n";
+  }
+}
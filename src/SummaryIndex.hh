@@ -0,0 +1,120 @@
+//! @file SummaryIndex.hh  Declaration of @ref llvm::prov::SummaryIndex.
+/*
+ * Copyright (c) 2017 Jonathan Anderson
+ * All rights reserved.
+ *
+ * This software was developed by BAE Systems, the University of Cambridge
+ * Computer Laboratory, and Memorial University under DARPA/AFRL contract
+ * FA8650-15-C-7558 ("CADETS"), as part of the DARPA Transparent Computing
+ * (TC) research program.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef LLVM_PROV_SUMMARY_INDEX_H
+#define LLVM_PROV_SUMMARY_INDEX_H
+
+#include "FlowSummary.hh"
+
+#include <llvm/ADT/StringMap.h>
+#include <llvm/ADT/StringRef.h>
+
+#include <string>
+#include <vector>
+
+
+namespace llvm {
+
+class Module;
+class raw_ostream;
+
+namespace prov {
+
+//! Encode a flow summary as a compact string (for metadata or an index).
+std::string EncodeSummary(const FlowSummary&);
+
+//! Decode a summary encoded by @ref EncodeSummary.
+bool DecodeSummary(StringRef, FlowSummary&);
+
+/**
+ * Flow summaries combined across modules, in the style of a ThinLTO index.
+ *
+ * Each module carries summaries of the functions that it exports (see
+ * @ref FlowSummaries::Export), including flows into the arguments of
+ * functions that it only declares. An index reads only these summaries
+ * (not function bodies), so its size depends on the number of exported
+ * functions rather than on the size of the program, and then resolves
+ * flows between modules to a fixed point.
+ */
+class SummaryIndex {
+public:
+  //! The name of the named metadata that modules carry summaries in.
+  static const char MetadataName[];
+
+  //! A call in one module that can pass source data to another's sink.
+  struct CrossModuleSink {
+    std::string Caller;
+    std::string Callee;
+    unsigned Arg;
+
+    bool operator < (const CrossModuleSink&) const;
+  };
+
+  /**
+   * Add the summaries embedded in a module's metadata.
+   *
+   * Only the module's metadata is needed: function bodies can be left
+   * unmaterialized.
+   *
+   * @returns the number of summaries added, or -1 if any were invalid
+   */
+  int Add(const Module&);
+
+  /**
+   * Read an index written by @ref print.
+   *
+   * @param   Err          a description of the first error found, if any
+   */
+  bool Read(StringRef Text, std::string &Err);
+
+  //! Propagate flows through calls between modules until nothing changes.
+  void Combine();
+
+  //! Calls that can pass source data to a sink in another module.
+  std::vector<CrossModuleSink> CrossModuleSinks() const;
+
+  //! The summary of a named function, or nullptr.
+  const FlowSummary* Lookup(StringRef Name) const;
+
+  size_t size() const { return Summaries.size(); }
+
+  //! Write the index, one summary per line, in name order.
+  void print(raw_ostream&) const;
+
+private:
+  StringMap<FlowSummary> Summaries;
+};
+
+} // namespace prov
+} // namespace llvm
+
+#endif // LLVM_PROV_SUMMARY_INDEX_H
@@ -0,0 +1,87 @@
+//! @file TableCallSemantics.cc  Definition of @ref llvm::prov::TableCallSemantics.
+/*
+ * Copyright (c) 2017 Jonathan Anderson
+ * All rights reserved.
+ *
+ * This software was developed by BAE Systems, the University of Cambridge
+ * Computer Laboratory, and Memorial University under DARPA/AFRL contract
+ * FA8650-15-C-7558 ("CADETS"), as part of the DARPA Transparent Computing
+ * (TC) research program.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#include "PosixCallSemantics.hh"
+#include "TableCallSemantics.hh"
+
+#include <llvm/IR/Function.h>
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Support/raw_ostream.h>
+
+using namespace llvm;
+using namespace llvm::prov;
+
+namespace {
+  cl::opt<std::string> TablePath("prov-semantics", cl::init(""),
+    cl::desc("Compiled call semantics table to use (see prov-semc)"),
+    cl::value_desc("file"));
+}
+
+
+const CallSemantics& CallSemantics::Default() {
+  // Load the table once per process, however many modules we see.
+  static std::unique_ptr<CallSemantics> Semantics =
+    []() -> std::unique_ptr<CallSemantics> {
+      if (TablePath.empty()) {
+        return Posix();
+      }
+
+      std::string Err;
+      std::unique_ptr<SemanticsTable> Table = SemanticsTable::Load(TablePath,
+                                                                   Err);
+      if (not Table) {
+        errs() << "Error loading call semantics table '" << TablePath
+          << "': " << Err << "; using POSIX semantics\n";
+        return Posix();
+      }
+
+      return std::unique_ptr<CallSemantics>(
+        new TableCallSemantics(std::move(Table)));
+    }();
+
+  return *Semantics;
+}
+
+
+TableCallSemantics::TableCallSemantics(std::unique_ptr<SemanticsTable> T)
+  : Table(std::move(T))
+{
+}
+
+CallSemantics::Roles TableCallSemantics::RolesOf(const Function &F) const {
+  if (not F.hasName()) {
+    return Roles();
+  }
+
+  return Table->Lookup(F.getName());
+}
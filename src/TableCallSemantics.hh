@@ -0,0 +1,64 @@
+//! @file TableCallSemantics.hh  Declaration of @ref llvm::prov::TableCallSemantics.
+/*
+ * Copyright (c) 2017 Jonathan Anderson
+ * All rights reserved.
+ *
+ * This software was developed by BAE Systems, the University of Cambridge
+ * Computer Laboratory, and Memorial University under DARPA/AFRL contract
+ * FA8650-15-C-7558 ("CADETS"), as part of the DARPA Transparent Computing
+ * (TC) research program.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#ifndef LLVM_PROV_TABLE_CALL_SEMANTICS_H
+#define LLVM_PROV_TABLE_CALL_SEMANTICS_H
+
+#include "CallSemantics.hh"
+#include "SemanticsTable.hh"
+
+#include <memory>
+
+
+namespace llvm {
+namespace prov {
+
+/**
+ * CallSemantics described by a compiled @ref SemanticsTable.
+ */
+class TableCallSemantics : public CallSemantics
+{
+  public:
+  TableCallSemantics(std::unique_ptr<SemanticsTable>);
+
+  StringRef Name() const override { return Table->Name(); }
+  Roles RolesOf(const Function&) const override;
+
+  private:
+  std::unique_ptr<SemanticsTable> Table;
+};
+
+} // namespace prov
+} // namespace llvm
+
+#endif // LLVM_PROV_TABLE_CALL_SEMANTICS_H
@@ -0,0 +1,64 @@
+; @file   alias-analysis.ll
+; @brief  the same flows are found with either pass manager, with or without
+;         a flow cache
+;
+; REQUIRES: pass-plugins
+;
+; RUN: rm -f %t.cache
+; RUN: %prov -prov-report-only -pass-remarks-output=%t.legacy.yaml \
+; RUN:   -disable-output %s
+; RUN: %newpm -passes=prov -prov-report-only \
+; RUN:   -pass-remarks-output=%t.newpm.yaml -disable-output %s
+; RUN: %newpm -passes=prov -prov-report-only -prov-cache=%t.cache \
+; RUN:   -pass-remarks-output=%t.cold.yaml -disable-output %s
+; RUN: %prov -prov-report-only -prov-cache=%t.cache \
+; RUN:   -pass-remarks-output=%t.warm.yaml -disable-output %s
+; RUN: %newpm -aa-pipeline=basic-aa -passes=prov -prov-report-only \
+; RUN:   -prov-cache=%t.cache -pass-remarks-output=%t.pipeline.yaml \
+; RUN:   -disable-output %s
+; RUN: cmp %t.legacy.yaml %t.newpm.yaml
+; RUN: cmp %t.legacy.yaml %t.cold.yaml
+; RUN: cmp %t.legacy.yaml %t.warm.yaml
+; RUN: cmp %t.legacy.yaml %t.pipeline.yaml
+; RUN: %filecheck %s -input-file %t.legacy.yaml
+;
+; CHECK: Function: copy
+; CHECK-NOT: Function: typed
+
+; read(2) only writes to its buffer (as the optimizer's library function
+; attributes would tell us).
+declare i64 @read(i32, i8* nocapture, i64) argmemonly
+declare i64 @write(i32, i8* nocapture readonly, i64)
+
+define void @copy(i32 %in, i32 %out) {
+  %buf = alloca [16 x i8]
+  %b = getelementptr [16 x i8], [16 x i8]* %buf, i64 0, i64 0
+  %r = call i64 @read(i32 %in, i8* %b, i64 16)
+  %w = call i64 @write(i32 %out, i8* %b, i64 16)
+  ret void
+}
+
+; Only type-based alias analysis can tell that the float written here
+; doesn't come from the int stored through %ip.
+define void @typed(i32 %in, i32 %out, i32* %ip, float* %fp) {
+  %buf = alloca [16 x i8]
+  %f = alloca float
+  %b = getelementptr [16 x i8], [16 x i8]* %buf, i64 0, i64 0
+  %r = call i64 @read(i32 %in, i8* %b, i64 16)
+  %c = load i8, i8* %b, !tbaa !3
+  %ci = sext i8 %c to i32
+  store i32 %ci, i32* %ip, !tbaa !5
+  %v = load float, float* %fp, !tbaa !7
+  store float %v, float* %f, !tbaa !7
+  %fb = bitcast float* %f to i8*
+  %w = call i64 @write(i32 %out, i8* %fb, i64 4)
+  ret void
+}
+
+!0 = !{!"Simple C/C++ TBAA"}
+!1 = !{!"omnipotent char", !0, i64 0}
+!3 = !{!1, !1, i64 0}
+!4 = !{!"int", !1, i64 0}
+!5 = !{!4, !4, i64 0}
+!6 = !{!"float", !1, i64 0}
+!7 = !{!6, !6, i64 0}
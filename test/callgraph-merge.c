@@ -0,0 +1,67 @@
+/**
+ * @file   callgraph-merge.c
+ * @brief  tests merging binary call graphs and their reachability index
+ *
+ * RUN: %clang %cflags %s -emit-llvm -S -o %t.a.ll
+ * RUN: %clang %cflags -DSECOND_MODULE %s -emit-llvm -S -o %t.b.ll
+ * RUN: %opt -callgraph -cg-format binary %t.a.ll -o /dev/null
+ * RUN: %opt -callgraph -cg-format binary %t.b.ll -o /dev/null
+ * RUN: %callgraph -o %t.pcg %t.a.ll.callgraph.pcg %t.b.ll.callgraph.pcg
+ * RUN: %callgraph %t.pcg -can-reach=write | %filecheck %s -check-prefix WRITE
+ * RUN: %callgraph %t.pcg -reachable-from=entry \
+ * RUN:   | %filecheck %s -check-prefix ENTRY
+ * RUN: not %callgraph %t.pcg -can-reach=entry 2>&1 \
+ * RUN:   | %filecheck %s -check-prefix NOT-TARGET
+ * RUN: not %callgraph %t.pcg -reachable-from=missing 2>&1 \
+ * RUN:   | %filecheck %s -check-prefix NOT-FUNCTION
+ *
+ * WRITE-NOT: helper
+ * WRITE: entry
+ * WRITE-NEXT: log_message
+ * WRITE-NOT: {{.}}
+ *
+ * ENTRY: _exit
+ * ENTRY-NEXT: close
+ * ENTRY-NEXT: strlen
+ * ENTRY-NEXT: write
+ * ENTRY-NOT: {{.}}
+ *
+ * NOT-TARGET: Error: 'entry' is not an indexed target
+ * NOT-FUNCTION: Error: 'missing' is not in the call graph
+ */
+
+#include <string.h>
+#include <unistd.h>
+
+void log_message(const char*);
+
+#ifndef SECOND_MODULE
+
+// Not the same function as the second module's helper.
+static void helper(int fd)
+{
+	close(fd);
+}
+
+void entry(int fd)
+{
+	log_message("closing");
+	helper(fd);
+}
+
+#else
+
+static void helper(void)
+{
+	_exit(1);
+}
+
+void log_message(const char *message)
+{
+	if (message == NULL)
+		helper();
+
+	write(STDERR_FILENO, message, strlen(message));
+}
+
+#endif
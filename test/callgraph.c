@@ -5,6 +5,10 @@
  * RUN: %clang %cflags %s -emit-llvm -S -o %t.ll
  * RUN: %opt -callgraph -cg-format dot %t.ll -o /dev/null
  * RUN: %filecheck %s -input-file %t.ll.callgraph.dot
+ * RUN: %opt -callgraph -cg-format json %t.ll -o /dev/null
+ * RUN: %filecheck %s -check-prefix JSON -input-file %t.ll.callgraph.json
+ *
+ * JSON: "bar":{"calls":["foo"]}
  */
 
 #include <unistd.h>
@@ -4,7 +4,8 @@
  *         (store->load) flows exist together with direct operand flows.
  *
  * RUN: %clang %cflags -emit-llvm -S %s -o %t.ll
- * RUN: %opt -disable-output -graph-flows -flow-dir=%t.graphs %t.ll
+ * RUN: %opt -disable-output -graph-flows -flow-output=dot -flow-dir=%t.graphs \
+ * RUN:   %t.ll
  * RUN: %filecheck %s -input-file %t.graphs/foo.dot
  */
 
@@ -16,15 +17,15 @@ void foo(int fd)
 {
 	char buffer[1024];
 
-	// CHECK-DAG: [[N:"[0-9a-fx]+"]] [{{.*}}label = "{{ *}}%n = alloca i64
+	// CHECK-DAG: [[N:n[0-9]+]] [{{.*}}label = "{{ *}}%n = alloca i64
 	ssize_t n = 0, total = 0;
 
-	// CHECK-DAG: [[SUB:"[0-9a-fx]+"]] [{{.*}}label = "{{.*}}sub i64 1024, %
-	// CHECK-DAG: [[N_SUB_LOAD:"[0-9a-fx]+"]] -> [[SUB]]
-	// CHECK-DAG: [[READ:"[0-9a-fx]+"]] [{{.*}}label = "{{.*}}call {{.*}}read{{["]?}}(
+	// CHECK-DAG: [[SUB:n[0-9]+]] [{{.*}}label = "{{.*}}sub i64 1024, %
+	// CHECK-DAG: [[N_SUB_LOAD:n[0-9]+]] -> [[SUB]]
+	// CHECK-DAG: [[READ:n[0-9]+]] [{{.*}}label = "{{.*}}call {{.*}}read{{["]?}}(
 	while ((n = read(fd, buffer + n, sizeof(buffer) - n)) > 0)
-		// CHECK-DAG: [[ADD:"[0-9a-fx]+"]] [{{.*}}label = "{{.*}} add nsw
-		// CHECK-DAG: [[ADD]] -> [[STORE_ADDED_N:"[0-9a-fx]+"]]
+		// CHECK-DAG: [[ADD:n[0-9]+]] [{{.*}}label = "{{.*}} add nsw
+		// CHECK-DAG: [[ADD]] -> [[STORE_ADDED_N:n[0-9]+]]
 		// CHECK-DAG: [[STORE_ADDED_N]] -> [[N_SUB_LOAD]]
 		total += n;
 }
@@ -0,0 +1,48 @@
+/**
+ * @file   deterministic.c
+ * @brief  instrumenting or graphing the same module twice gives
+ *         byte-identical output
+ *
+ * RUN: %clang %cflags -S %s -emit-llvm -o %t.ll
+ * RUN: %prov -prov-threads=4 -pass-remarks-output=%t.1.yaml -S %t.ll \
+ * RUN:   -o %t.1.ll
+ * RUN: %prov -prov-threads=4 -pass-remarks-output=%t.2.yaml -S %t.ll \
+ * RUN:   -o %t.2.ll
+ * RUN: cmp %t.1.ll %t.2.ll
+ * RUN: cmp %t.1.yaml %t.2.yaml
+ * RUN: %opt -disable-output -graph-flows -flow-output=dot \
+ * RUN:   -flow-dir=%t.graphs.1 %t.ll
+ * RUN: %opt -disable-output -graph-flows -flow-output=dot \
+ * RUN:   -flow-dir=%t.graphs.2 %t.ll
+ * RUN: cmp %t.graphs.1/fan.dot %t.graphs.2/fan.dot
+ * RUN: %filecheck %s -input-file %t.1.ll
+ */
+
+#include <unistd.h>
+
+// CHECK-LABEL: define void @fan
+void fan(int a, int b, int c, int out)
+{
+	char x[16], y[16], z[16], buf[48];
+	int i;
+
+	// CHECK: call {{.*}} @{{"*}}metaio_{{.*}}read{{"*}}(
+	// CHECK: call {{.*}} @{{"*}}metaio_{{.*}}read{{"*}}(
+	// CHECK: call {{.*}} @{{"*}}metaio_{{.*}}read{{"*}}(
+	read(a, x, sizeof(x));
+	read(b, y, sizeof(y));
+	read(c, z, sizeof(z));
+
+	for (i = 0; i < 16; i++) {
+		buf[i] = x[i];
+		buf[i + 16] = y[i] ^ z[i];
+		buf[i + 32] = x[i] + z[i];
+	}
+
+	// CHECK: call {{.*}} @{{"*}}metaio_{{.*}}write{{"*}}(
+	// CHECK: call {{.*}} @{{"*}}metaio_{{.*}}write{{"*}}(
+	// CHECK: call {{.*}} @{{"*}}metaio_{{.*}}write{{"*}}(
+	write(out, buf, 16);
+	write(out, buf + 16, 16);
+	write(out, buf + 32, 16);
+}
@@ -0,0 +1,39 @@
+/**
+ * @file   flow-cache.c
+ * @brief  flows found in the flow cache give the same output as a fresh run
+ *
+ * RUN: %clang %cflags -S %s -emit-llvm -o %t.ll
+ * RUN: rm -f %t.cache
+ * RUN: %prov -prov-cache=%t.cache -prov-cache-report -S %t.ll -o %t.cold.ll \
+ * RUN:   2> %t.cold.txt
+ * RUN: %prov -prov-cache=%t.cache -prov-cache-report -S %t.ll -o %t.warm.ll \
+ * RUN:   2> %t.warm.txt
+ * RUN: cmp %t.cold.ll %t.warm.ll
+ * RUN: %filecheck %s -check-prefix COLD -input-file %t.cold.txt
+ * RUN: %filecheck %s -check-prefix WARM -input-file %t.warm.txt
+ * RUN: %filecheck %s -input-file %t.warm.ll
+ *
+ * COLD: flow cache: 0 hits, 2 misses
+ * WARM: flow cache: 2 hits, 0 misses
+ */
+
+#include <unistd.h>
+
+// CHECK-LABEL: define void @copy
+void copy(int in, int out)
+{
+	char buf[16];
+
+	// CHECK: [[METAIO:%[a-z0-9]+]] = alloca %struct.metaio
+	// CHECK: call {{.*}} @{{"*}}metaio_{{.*}}read{{"*}}({{.*}}[[METAIO]])
+	// CHECK: call {{.*}} @{{"*}}metaio_{{.*}}write{{"*}}({{.*}}[[METAIO]])
+	read(in, buf, sizeof(buf));
+	write(out, buf, sizeof(buf));
+}
+
+// CHECK-LABEL: define void @nothing
+void nothing(int fd)
+{
+	// CHECK-NOT: metaio
+	close(fd);
+}
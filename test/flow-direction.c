@@ -0,0 +1,39 @@
+/**
+ * @file   flow-direction.c
+ * @brief  forward and backward flow searches instrument the same flows
+ *
+ * RUN: %clang %cflags -S %s -emit-llvm -o %t.ll
+ * RUN: %prov -flow-direction=forward -S %t.ll -o %t.forward.ll
+ * RUN: %prov -flow-direction=forward -flow-lazy=false -S %t.ll -o %t.eager.ll
+ * RUN: %prov -flow-direction=backward -S %t.ll -o %t.backward.ll
+ * RUN: %filecheck %s -input-file %t.forward.ll
+ * RUN: %filecheck %s -input-file %t.eager.ll
+ * RUN: %filecheck %s -input-file %t.backward.ll
+ */
+
+#include <unistd.h>
+
+void foo(int in, int out)
+{
+	char buffer[64];
+	char unrelated[64] = { 0 };
+	ssize_t n;
+
+	// CHECK-LABEL: define void @foo
+	// CHECK: [[METAIO:%[a-z0-9]+]] = alloca %struct.metaio
+
+	// A sink that comes before the source can't be reached from it:
+	// CHECK-NOT: metaio_
+	// CHECK: call {{.*}}write{{"*}}(
+	write(out, unrelated, sizeof(unrelated));
+
+	// CHECK: call {{.*}} @{{"*}}metaio_{{.*}}read{{"*}}({{.*}}[[METAIO]])
+	n = read(in, buffer, sizeof(buffer));
+
+	// Both of these sinks are reached by the read:
+	// CHECK: call {{.*}} @{{"*}}metaio_{{.*}}write{{"*}}({{.*}}[[METAIO]])
+	write(out, buffer, n);
+
+	// CHECK: call {{.*}} @{{"*}}metaio_{{.*}}write{{"*}}({{.*}}[[METAIO]])
+	write(out, buffer + 1, 1);
+}
@@ -0,0 +1,47 @@
+/**
+ * @file   flow-export.c
+ * @brief  Checks that binary flow graphs can be queried without the IR.
+ *
+ * RUN: %clang %cflags -emit-llvm -S %s -o %t.ll
+ * RUN: rm -rf %t.graphs
+ * RUN: %opt -disable-output -graph-flows -flow-output=binary \
+ * RUN:   -flow-dir=%t.graphs %t.ll
+ * RUN: ls %t.graphs | %filecheck %s -check-prefix FILES
+ * RUN: %flows %t.graphs/*.pfg | %filecheck %s -check-prefix SUMMARY
+ * RUN: %flows -query=reach %t.graphs/*.pfg \
+ * RUN:   | %filecheck %s -check-prefix REACH
+ * RUN: %flows -query=top -n=1 %t.graphs/*.pfg \
+ * RUN:   | %filecheck %s -check-prefix TOP
+ *
+ * All of a module's graphs are written to one file:
+ * FILES: flow-export.c{{.*}}-{{[0-9a-f]+}}.pfg
+ * FILES-NOT: .pfg
+ *
+ * SUMMARY: copy {{[0-9]+}} nodes {{[0-9]+}} flows 1 sources 1 sinks
+ * SUMMARY: count {{[0-9]+}} nodes {{[0-9]+}} flows 0 sources 0 sinks
+ *
+ * REACH: copy {{.*}} = call {{.*}} @read({{.*}} -> {{.*}}call {{.*}} @write({{.*$}}
+ * REACH-NOT: copy
+ *
+ * TOP: {{^[0-9]+}} {{copy|count}} {{.+$}}
+ * TOP-NOT: {{.}}
+ */
+
+#include <unistd.h>
+
+void
+copy(int in, int out)
+{
+	char buffer[1024];
+	ssize_t n = read(in, buffer, sizeof(buffer));
+	write(out, buffer, n);
+}
+
+int
+count(int n)
+{
+	int total = 0;
+	for (int i = 0; i < n; i++)
+		total += i;
+	return total;
+}
@@ -0,0 +1,45 @@
+/**
+ * @file   flow-summaries.c
+ * @brief  interprocedural flow summaries
+ *
+ * RUN: %clang %cflags -S %s -emit-llvm -o %t.ll
+ * RUN: %opt -analyze -flow-summaries -flow-summary-threads=2 %t.ll > %t.out
+ * RUN: %filecheck %s -input-file %t.out
+ */
+
+#include <unistd.h>
+
+// CHECK-LABEL: Flow summary for 'emit':
+// CHECK-NEXT: arg 0 -> sink
+// CHECK-NEXT: arg 1 -> sink
+void emit(int fd, const char *p)
+{
+	write(fd, p, 8);
+}
+
+// CHECK-LABEL: Flow summary for 'first':
+// CHECK-NEXT: arg 0 -> return
+// CHECK-NOT: arg 1
+int first(int x, int y)
+{
+	return x;
+}
+
+// CHECK-LABEL: Flow summary for 'fill':
+// CHECK: source -> arg 0
+void fill(char *buf)
+{
+	read(0, buf, 8);
+}
+
+// The buffer is local to foo, so foo isn't a source for its callers:
+// CHECK-LABEL: Flow summary for 'foo':
+// CHECK-NEXT: arg 0 -> sink
+// CHECK-NOT: source
+void foo(int out)
+{
+	char buf[8];
+
+	fill(buf);
+	emit(first(out, 0), buf);
+}
@@ -0,0 +1,33 @@
+/**
+ * @file   graph-archive.c
+ * @brief  Checks that a module's data flow graphs are archived together.
+ *
+ * RUN: %clang %cflags -emit-llvm -S %s -o %t.ll
+ * RUN: rm -rf %t.graphs
+ * RUN: %opt -disable-output -graph-flows -flow-dir=%t.graphs %t.ll
+ * RUN: cat %t.graphs/*.tar | tar -tf - | sort | %filecheck %s -check-prefix LIST
+ * RUN: cat %t.graphs/*.tar | tar -xOf - copy.dot | %filecheck %s
+ *
+ * LIST: a_function_whose_name_is_far_too_long_to_fit_in_a_ustar_header_name_field_without_an_extended_header.dot
+ * LIST: copy.dot
+ *
+ * CHECK: digraph
+ * CHECK: label = "copy";
+ */
+
+#include <unistd.h>
+
+void
+copy(int in, int out)
+{
+	char buffer[1024];
+	ssize_t n = read(in, buffer, sizeof(buffer));
+	write(out, buffer, n);
+}
+
+int
+a_function_whose_name_is_far_too_long_to_fit_in_a_ustar_header_name_field_without_an_extended_header(int fd)
+{
+	char c;
+	return read(fd, &c, 1);
+}
@@ -0,0 +1,45 @@
+/**
+ * @file   helper-sinks.c
+ * @brief  tests applying the module's flow summaries at calls to helpers
+ *
+ * RUN: %clang %cflags -S %s -emit-llvm -o %t.ll
+ * RUN: %prov -prov-report-only -prov-use-summaries \
+ * RUN:   -pass-remarks-output=%t.yaml -disable-output %t.ll
+ * RUN: %filecheck %s -input-file %t.yaml
+ * RUN: %prov -prov-report-only -pass-remarks-output=%t.plain.yaml \
+ * RUN:   -disable-output %t.ll
+ * RUN: %filecheck %s -input-file %t.plain.yaml -check-prefix PLAIN
+ *
+ * A call to a helper that passes its argument to a sink is reported as
+ * a sink, but only with summaries:
+ * CHECK: Function: copy
+ * CHECK: - Source: read
+ * CHECK: - Sink: put
+ *
+ * PLAIN-NOT: Function: copy
+ *
+ * Calls to helpers can't be instrumented as sinks, so nothing in copy is:
+ * RUN: %prov -prov-use-summaries -S %t.ll -o %t.prov.ll
+ * RUN: %filecheck %s -input-file %t.prov.ll -check-prefix INSTR
+ *
+ * INSTR-LABEL: define void @copy
+ * INSTR-NOT: metaio
+ * INSTR: ret void
+ */
+
+#include <unistd.h>
+
+void
+put(int fd, const char *p)
+{
+	write(fd, p, 8);
+}
+
+void
+copy(int in, int out)
+{
+	char buf[8];
+
+	read(in, buf, sizeof(buf));
+	put(out, buf);
+}
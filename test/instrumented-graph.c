@@ -0,0 +1,28 @@
+/**
+ * @file   instrumented-graph.c
+ * @brief  the flow graph is kept up to date through instrumentation
+ *
+ * RUN: %clang %cflags -S %s -emit-llvm -o %t.ll
+ * RUN: rm -rf %t.graphs
+ * RUN: %prov -prov-graph-dir=%t.graphs -S %t.ll -o %t.prov.ll
+ * RUN: cat %t.graphs/*/foo.dot | %filecheck %s
+ * RUN: cat %t.graphs/*/foo.dot | %filecheck %s -check-prefix REPLACED
+ */
+
+#include <unistd.h>
+
+void foo(int in, int out)
+{
+	char buffer[64];
+
+	// CHECK: label = "foo"
+	// CHECK-DAG: [[METAIO:%[a-z0-9]+]] = alloca %struct.metaio
+	// CHECK-DAG: @{{"*}}metaio_{{.*}}read{{"*}}({{.*}}[[METAIO]])
+	// CHECK-DAG: @{{"*}}metaio_{{.*}}write{{"*}}({{.*}}[[METAIO]])
+	//
+	// The original calls have been replaced in the graph:
+	// REPLACED-NOT: @{{"*}}read{{"*}}(
+	// REPLACED-NOT: @{{"*}}write{{"*}}(
+	read(in, buffer, sizeof(buffer));
+	write(out, buffer, sizeof(buffer));
+}
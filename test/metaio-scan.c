@@ -0,0 +1,49 @@
+/**
+ * @file   metaio-scan.c
+ * @brief  tests classifying binaries by their use of metaio wrappers
+ *
+ * RUN: rm -rf %t && mkdir -p %t
+ * RUN: %clang %cflags -c %s -o %t/none.o
+ * RUN: %clang %cflags -DWRAP_READ -c %s -o %t/partial.o
+ * RUN: %clang %cflags -DWRAP_READ -DWRAP_WRITE -c %s -o %t/full.o
+ * RUN: echo "not a binary" > %t/notes.txt
+ * RUN: %metaio %t | %filecheck %s
+ * RUN: %metaio -format=json %t | %filecheck %s -check-prefix JSON
+ *
+ * CHECK: no metaio:
+ * CHECK-NEXT: none.o
+ * CHECK-NEXT: read, write
+ * CHECK: partial metaio:
+ * CHECK-NEXT: partial.o meta: read
+ * CHECK-NEXT: legacy: write
+ * CHECK: full metaio:
+ * CHECK-NEXT: full.o read, write
+ * CHECK: 1 without metaio (0 one-way), 1 partial, 1 full
+ *
+ * JSON: "metaio":"full","one-way":false,"legacy":[],"wrapped":["read","write"]
+ * JSON: "totals":{"none":1,"one-way":0,"partial":1,"full":1}
+ */
+
+#include <sys/types.h>
+#include <unistd.h>
+
+ssize_t metaio_read(int, void*, size_t, void*);
+ssize_t metaio_write(int, const void*, size_t, void*);
+
+void
+copy(int in, int out)
+{
+	char buf[64];
+
+#ifdef WRAP_READ
+	metaio_read(in, buf, sizeof(buf), 0);
+#else
+	read(in, buf, sizeof(buf));
+#endif
+
+#ifdef WRAP_WRITE
+	metaio_write(out, buf, sizeof(buf), 0);
+#else
+	write(out, buf, sizeof(buf));
+#endif
+}
@@ -0,0 +1,33 @@
+/**
+ * @file   new-pm.c
+ * @brief  the new pass manager instruments the same flows as the legacy one
+ *
+ * REQUIRES: pass-plugins
+ *
+ * RUN: %clang %cflags -S %s -emit-llvm -o %t.ll
+ * RUN: %prov -S %t.ll -o %t.legacy.ll
+ * RUN: %newpm -passes=prov -S %t.ll -o %t.newpm.ll
+ * RUN: %filecheck %s -input-file %t.newpm.ll
+ * RUN: %filecheck %s -input-file %t.legacy.ll
+ *
+ * RUN: rm -rf %t.graphs
+ * RUN: %newpm -passes=graph-flows -flow-output=dot -flow-dir=%t.graphs \
+ * RUN:   -disable-output %t.ll
+ * RUN: %filecheck %s -check-prefix GRAPH -input-file %t.graphs/copy.dot
+ *
+ * GRAPH: digraph
+ */
+
+#include <unistd.h>
+
+// CHECK-LABEL: define void @copy
+void copy(int in, int out)
+{
+	char buf[16];
+
+	// CHECK: [[METAIO:%[a-z0-9]+]] = alloca %struct.metaio
+	// CHECK: call {{.*}} @{{"*}}metaio_{{.*}}read{{"*}}({{.*}}[[METAIO]])
+	// CHECK: call {{.*}} @{{"*}}metaio_{{.*}}write{{"*}}({{.*}}[[METAIO]])
+	read(in, buf, sizeof(buf));
+	write(out, buf, sizeof(buf));
+}
@@ -0,0 +1,42 @@
+/**
+ * @file   opt-cache.c
+ * @brief  tests caching instrumented output with prov-opt-cache
+ *
+ * RUN: %clang %cflags %s -emit-llvm -S -o %t.ll
+ * RUN: rm -rf %t.cache
+ * RUN: env PROV_OPT_CACHE_DIR=%t.cache %cache %prov %t.ll -o %t.first.bc
+ * RUN: env PROV_OPT_CACHE_DIR=%t.cache %cache %prov %t.ll -o %t.second.bc
+ * RUN: cmp %t.first.bc %t.second.bc
+ *
+ * Different flags are a different entry:
+ * RUN: env PROV_OPT_CACHE_DIR=%t.cache %cache %prov -S %t.ll -o=%t.ll.out
+ *
+ * Runs that write other files always run (so that those files are written):
+ * RUN: env PROV_OPT_CACHE_DIR=%t.cache %cache %prov %t.ll -o %t.third.bc \
+ * RUN:   -pass-remarks-output=%t.yaml
+ * RUN: rm %t.yaml
+ * RUN: env PROV_OPT_CACHE_DIR=%t.cache %cache %prov %t.ll -o %t.third.bc \
+ * RUN:   -pass-remarks-output=%t.yaml
+ * RUN: test -f %t.yaml
+ *
+ * Another run's half-written entry isn't an entry:
+ * RUN: mkdir -p %t.cache/0
+ * RUN: echo partial > %t.cache/0/0123.tmp-abcdefgh
+ * RUN: env PROV_OPT_CACHE_DIR=%t.cache %cache -s | %filecheck %s
+ *
+ * CHECK: cache hits: 1
+ * CHECK-NEXT: cache misses: 2
+ * CHECK: uncacheable runs: 2
+ * CHECK: entries: 2
+ */
+
+#include <unistd.h>
+
+void
+copy(int in, int out)
+{
+	char buf[64];
+
+	read(in, buf, sizeof(buf));
+	write(out, buf, sizeof(buf));
+}
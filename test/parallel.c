@@ -0,0 +1,44 @@
+/**
+ * @file   parallel.c
+ * @brief  finding flows in parallel gives the same output as serially
+ *
+ * RUN: %clang %cflags -S %s -emit-llvm -o %t.ll
+ * RUN: %prov -prov-threads=1 -S %t.ll -o %t.serial.ll
+ * RUN: %prov -prov-threads=4 -S %t.ll -o %t.parallel.ll
+ * RUN: cmp %t.serial.ll %t.parallel.ll
+ * RUN: %filecheck %s -input-file %t.parallel.ll
+ */
+
+#include <unistd.h>
+
+// CHECK-LABEL: define void @small
+void small(int fd)
+{
+	char c;
+
+	// CHECK: [[METAIO:%[a-z0-9]+]] = alloca %struct.metaio
+	// CHECK: call {{.*}} @{{"*}}metaio_{{.*}}read{{"*}}({{.*}}[[METAIO]])
+	// CHECK: call {{.*}} @{{"*}}metaio_{{.*}}write{{"*}}({{.*}}[[METAIO]])
+	read(fd, &c, 1);
+	write(fd, &c, 1);
+}
+
+// CHECK-LABEL: define void @large
+void large(int in, int out)
+{
+	char a[16], b[16];
+	int i;
+
+	// CHECK: [[METAIO:%[a-z0-9]+]] = alloca %struct.metaio
+	// CHECK: call {{.*}} @{{"*}}metaio_{{.*}}read{{"*}}({{.*}}[[METAIO]])
+	read(in, a, sizeof(a));
+
+	for (i = 0; i < 16; i++) {
+		b[i] = a[i] ^ i;
+	}
+
+	// CHECK: call {{.*}} @{{"*}}metaio_{{.*}}write{{"*}}({{.*}}[[METAIO]])
+	// CHECK: call {{.*}} @{{"*}}metaio_{{.*}}write{{"*}}({{.*}}[[METAIO]])
+	write(out, a, sizeof(a));
+	write(out, b, sizeof(b));
+}
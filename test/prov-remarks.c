@@ -0,0 +1,39 @@
+/**
+ * @file   prov-remarks.c
+ * @brief  tests reporting flows as optimization remarks, with and without
+ *         instrumenting them
+ *
+ * RUN: %clang %cflags -g -S %s -emit-llvm -o %t.ll
+ * RUN: %prov -prov-report-only -pass-remarks-output=%t.yaml -S %t.ll \
+ * RUN:   -o %t.report.ll
+ * RUN: %filecheck %s -input-file %t.yaml -check-prefix YAML
+ * RUN: %filecheck %s -input-file %t.report.ll -check-prefix REPORT
+ * RUN: %prov -pass-remarks=prov -S %t.ll -o %t.prov.ll 2>&1 \
+ * RUN:   | %filecheck %s -check-prefix REMARK
+ *
+ * YAML: --- !Analysis
+ * YAML-NEXT: Pass: prov
+ * YAML-NEXT: Name: Flow
+ * YAML: Function: copy
+ * YAML: - Source: read
+ * YAML: - SourceLoc: {{.*}}prov-remarks.c:37:
+ * YAML: - Sink: write
+ * YAML-NOT: Name: Flow
+ *
+ * The module must not be instrumented:
+ * REPORT-NOT: metaio
+ *
+ * REMARK: prov-remarks.c:38:{{[0-9]+}}: remark: instrumented flow from read
+ * REMARK-SAME: prov-remarks.c:37:{{[0-9]+}}) to write
+ */
+
+#include <unistd.h>
+
+void
+copy(int in, int out)
+{
+	char buf[64];
+
+	read(in, buf, sizeof(buf));
+	write(out, buf, sizeof(buf));
+}
@@ -0,0 +1,46 @@
+/**
+ * @file   prov-witness.c
+ * @brief  tests describing the path that a flow takes from source to sink
+ *
+ * RUN: %clang %cflags -g -S %s -emit-llvm -o %t.ll
+ * RUN: %prov -prov-report-only -prov-witness -pass-remarks-output=%t.yaml \
+ * RUN:   -disable-output %t.ll
+ * RUN: %filecheck %s -input-file %t.yaml
+ * RUN: %prov -prov-witness -pass-remarks=prov -S %t.ll -o %t.prov.ll 2>&1 \
+ * RUN:   | %filecheck %s -check-prefix REMARK
+ *
+ * The path leads from the read through the computation of d to the write:
+ *
+ * CHECK: Name: Flow
+ * CHECK: Function: increment
+ * CHECK: - Source: read
+ * CHECK: - Sink: write
+ * CHECK: - Via: {{.*}}%call
+ * CHECK-NEXT: DebugLoc: {{.*}}Line: 43
+ * CHECK: - Flow: memory
+ * CHECK: - Via: {{.*}}%{{[0-9]+}}
+ * CHECK-NEXT: DebugLoc: {{.*}}Line: 44
+ * CHECK: - Flow: operand
+ * CHECK: - Via: store
+ * CHECK-NEXT: DebugLoc: {{.*}}Line: 44
+ * CHECK-NEXT: - String:
+ * CHECK-NEXT: - Flow: memory
+ * CHECK: - Via: {{.*}}%call{{[0-9]+}}
+ * CHECK-NEXT: DebugLoc: {{.*}}Line: 45
+ *
+ * REMARK: remark: instrumented flow from read
+ * REMARK-SAME: to write; path: %call -memory-> %{{[0-9]+}} -operand->
+ * REMARK-SAME: -operand-> store -memory-> %call{{[0-9]+}}
+ */
+
+#include <unistd.h>
+
+void
+increment(int in, int out)
+{
+	char c, d;
+
+	read(in, &c, 1);
+	d = c + 1;
+	write(out, &d, 1);
+}
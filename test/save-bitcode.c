@@ -0,0 +1,21 @@
+/**
+ * @file   save-bitcode.c
+ * @brief  tests saving bitcode alongside a pipeline's usual output (for lpcc)
+ *
+ * RUN: %clang %cflags %s -emit-llvm -S -o %t.ll
+ * RUN: %opt -save-bitcode -prov-save-bitcode=%t.bc %t.ll -disable-output
+ * RUN: %opt -S %t.bc | %filecheck %s
+ * RUN: not %opt -save-bitcode -prov-save-bitcode=%t.missing/out.bc %t.ll \
+ * RUN:   -disable-output 2>&1 | %filecheck %s -check-prefix ERR
+ *
+ * CHECK: define {{.*}}i32 @answer()
+ * CHECK: ret i32 42
+ *
+ * ERR: Error opening '{{.*}}out.bc'
+ */
+
+int
+answer(void)
+{
+	return 42;
+}
@@ -0,0 +1,38 @@
+/**
+ * @file   semantics-table.c
+ * @brief  sources and sinks can be described by a compiled semantics table
+ *
+ * RUN: %semc -o %t.psem %p/Inputs/custom.sem
+ * RUN: %clang %cflags -S %s -emit-llvm -o %t.ll
+ * RUN: %prov -prov-semantics=%t.psem -S %t.ll -o %t.out.ll
+ * RUN: %filecheck %s -input-file %t.out.ll
+ */
+
+#include <unistd.h>
+
+void get_data(char *buf, int len);
+void put_data(const char *buf, int len);
+
+// CHECK-LABEL: define void @custom
+void custom(void)
+{
+	char buf[16];
+
+	// CHECK: [[METAIO:%[a-z0-9]+]] = alloca %struct.metaio
+	// CHECK: call {{.*}} @metaio_read({{.*}}[[METAIO]])
+	// CHECK: call {{.*}} @metaio_write({{.*}}[[METAIO]])
+	get_data(buf, sizeof(buf));
+	put_data(buf, sizeof(buf));
+}
+
+// Without the POSIX semantics, read(2) and write(2) aren't sources or sinks.
+// CHECK-LABEL: define void @posix
+void posix(int fd)
+{
+	char c;
+
+	// CHECK-NOT: metaio
+	// CHECK: ret void
+	read(fd, &c, 1);
+	write(fd, &c, 1);
+}
@@ -0,0 +1,87 @@
+/**
+ * @file   summary-index.c
+ * @brief  tests combining flow summaries from several modules
+ *
+ * RUN: %clang %cflags %s -emit-llvm -S -o %t.a.ll
+ * RUN: %clang %cflags -DSECOND_MODULE %s -emit-llvm -S -o %t.b.ll
+ * RUN: %prov -prov-export-summaries %t.a.ll -o %t.a.bc
+ * RUN: %prov -prov-export-summaries %t.b.ll -o %t.b.bc
+ * RUN: %summaries -o %t.index -report=%t.report %t.a.bc %t.b.bc
+ * RUN: %filecheck %s -input-file %t.index -check-prefix INDEX
+ * RUN: %filecheck %s -input-file %t.report -check-prefix REPORT
+ * RUN: %opt -analyze -flow-summaries %t.a.ll \
+ * RUN:   | %filecheck %s -check-prefix LOCAL
+ * RUN: %opt -analyze -flow-summaries -flow-summary-index %t.index %t.a.ll \
+ * RUN:   | %filecheck %s -check-prefix IMPORTED
+ *
+ * INDEX: prov-summary-index 1
+ * INDEX-NEXT: emit
+ * INDEX-NEXT: forward
+ * INDEX-NEXT: log_input
+ * INDEX-NEXT: main
+ * INDEX-NEXT: relay
+ * INDEX-NOT: {{.}}
+ *
+ * REPORT: main -> emit arg 1
+ * REPORT-NEXT: relay -> emit arg 1
+ * REPORT-NOT: {{.}}
+ *
+ * Without an index, main can only record that source data enters emit
+ * (and relay, that it does so by way of forward):
+ * LOCAL-LABEL: Flow summary for 'main':
+ * LOCAL: source -> external emit arg 1
+ * LOCAL-LABEL: Flow summary for 'forward':
+ * LOCAL: arg 1 -> external emit arg 1
+ * LOCAL-LABEL: Flow summary for 'relay':
+ * LOCAL: source -> external emit arg 1
+ *
+ * With one, the declaration of emit is summarized by its definition:
+ * IMPORTED-LABEL: Flow summary for 'emit':
+ * IMPORTED-NEXT: arg 0 -> sink
+ * IMPORTED-NEXT: arg 1 -> sink
+ */
+
+#include <unistd.h>
+
+void emit(int fd, const char *p);
+
+#ifdef SECOND_MODULE
+
+void emit(int fd, const char *p)
+{
+	write(fd, p, 8);
+}
+
+void log_input(const char *p)
+{
+	emit(2, p);
+}
+
+#else
+
+int main(int argc, char *argv[])
+{
+	char buf[8];
+
+	read(0, buf, sizeof(buf));
+	emit(1, buf);
+
+	return 0;
+}
+
+void forward(int fd, const char *p)
+{
+	emit(fd, p);
+}
+
+int relay(void)
+{
+	char buf[8];
+
+	read(0, buf, sizeof(buf));
+	forward(1, buf);
+
+	return 0;
+}
+
+#endif
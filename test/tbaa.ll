@@ -0,0 +1,48 @@
+; @file   tbaa.ll
+; @brief  type-based alias analysis rules out flows through differently-typed
+;         memory, whichever pass manager finds them
+;
+; RUN: %prov -prov-report-only -pass-remarks-output=%t.yaml -disable-output %s
+; RUN: %filecheck %s -input-file %t.yaml
+;
+; CHECK: Function: copy
+; CHECK-NOT: Function: typed
+
+; read(2) only writes to its buffer (as the optimizer's library function
+; attributes would tell us).
+declare i64 @read(i32, i8* nocapture, i64) argmemonly
+declare i64 @write(i32, i8* nocapture readonly, i64)
+
+define void @copy(i32 %in, i32 %out) {
+  %buf = alloca [16 x i8]
+  %b = getelementptr [16 x i8], [16 x i8]* %buf, i64 0, i64 0
+  %r = call i64 @read(i32 %in, i8* %b, i64 16)
+  %w = call i64 @write(i32 %out, i8* %b, i64 16)
+  ret void
+}
+
+; Information read into %buf is stored through an int pointer, but what is
+; written comes from a float pointer: they may alias by address, but not
+; by type.
+define void @typed(i32 %in, i32 %out, i32* %ip, float* %fp) {
+  %buf = alloca [16 x i8]
+  %f = alloca float
+  %b = getelementptr [16 x i8], [16 x i8]* %buf, i64 0, i64 0
+  %r = call i64 @read(i32 %in, i8* %b, i64 16)
+  %c = load i8, i8* %b, !tbaa !3
+  %ci = sext i8 %c to i32
+  store i32 %ci, i32* %ip, !tbaa !5
+  %v = load float, float* %fp, !tbaa !7
+  store float %v, float* %f, !tbaa !7
+  %fb = bitcast float* %f to i8*
+  %w = call i64 @write(i32 %out, i8* %fb, i64 4)
+  ret void
+}
+
+!0 = !{!"Simple C/C++ TBAA"}
+!1 = !{!"omnipotent char", !0, i64 0}
+!3 = !{!1, !1, i64 0}
+!4 = !{!"int", !1, i64 0}
+!5 = !{!4, !4, i64 0}
+!6 = !{!"float", !1, i64 0}
+!7 = !{!6, !6, i64 0}
@@ -0,0 +1,299 @@
+//! @file prov-callgraph.cc  Merges and queries binary call graphs.
+/*
+ * Copyright (c) 2017 Jonathan Anderson
+ * All rights reserved.
+ *
+ * This software was developed by BAE Systems, the University of Cambridge
+ * Computer Laboratory, and Memorial University under DARPA/AFRL contract
+ * FA8650-15-C-7558 ("CADETS"), as part of the DARPA Transparent Computing
+ * (TC) research program.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#include "CallGraphFile.hh"
+
+#include <llvm/ADT/StringMap.h>
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/ThreadPool.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <algorithm>
+
+using namespace llvm;
+using namespace llvm::prov;
+using std::string;
+
+typedef CallGraphFile::SymbolID SymbolID;
+
+
+namespace {
+  cl::list<string> InputFilenames(cl::Positional, cl::OneOrMore,
+    cl::desc("<call graphs>"));
+
+  cl::opt<string> OutputFilename("o", cl::desc("Write the merged graph"),
+    cl::value_desc("filename"));
+
+  cl::list<string> Targets("target", cl::CommaSeparated,
+    cl::desc("Functions to index reachability to "
+             "(default: functions without definitions)"),
+    cl::value_desc("function"));
+
+  cl::opt<string> CanReach("can-reach",
+    cl::desc("List the functions that can reach an indexed target"),
+    cl::value_desc("target"));
+
+  cl::opt<string> ReachableFrom("reachable-from",
+    cl::desc("List the indexed targets that a function can reach"),
+    cl::value_desc("function"));
+
+  cl::opt<unsigned> Threads("j", cl::init(0),
+    cl::desc("Number of threads to load graphs with (default: all cores)"));
+}
+
+static std::unique_ptr<CallGraphFile> Merge(
+  ArrayRef<std::unique_ptr<CallGraphFile>>, string &Merged);
+
+static bool ListCallers(const CallGraphFile&, StringRef Target, raw_ostream&);
+static bool ListTargets(const CallGraphFile&, StringRef Fn, raw_ostream&);
+
+
+int main(int argc, char *argv[])
+{
+  cl::ParseCommandLineOptions(argc, argv, "call graph merging and queries\n");
+
+  // Map and check every graph in parallel.
+  std::vector<std::unique_ptr<CallGraphFile>> Inputs(InputFilenames.size());
+  std::vector<string> Errors(InputFilenames.size());
+
+  {
+    std::unique_ptr<ThreadPool> Pool(
+      Threads ? new ThreadPool(Threads) : new ThreadPool());
+
+    for (size_t i = 0; i < Inputs.size(); i++) {
+      Pool->async([&Inputs, &Errors, i]() {
+        Inputs[i] = CallGraphFile::Load(InputFilenames[i], Errors[i]);
+      });
+    }
+
+    Pool->wait();
+  }
+
+  for (size_t i = 0; i < Inputs.size(); i++) {
+    if (not Inputs[i]) {
+      errs() << "Error reading '" << InputFilenames[i] << "': " << Errors[i]
+        << "\n";
+      return 1;
+    }
+  }
+
+  // A single, already-indexed graph can be queried as-is.
+  string Merged;
+  std::unique_ptr<CallGraphFile> Graph;
+
+  if (Inputs.size() == 1 and Targets.empty()
+      and not Inputs.front()->Targets().empty()) {
+    Graph = std::move(Inputs.front());
+  } else {
+    Graph = Merge(Inputs, Merged);
+    if (not Graph) {
+      return 1;
+    }
+  }
+
+  if (not OutputFilename.empty()) {
+    if (Merged.empty()) {
+      errs() << "Error: nothing was merged\n";
+      return 1;
+    }
+
+    std::error_code EC;
+    raw_fd_ostream Out(OutputFilename, EC, sys::fs::F_None);
+    if (EC) {
+      errs() << "Error opening '" << OutputFilename << "': " << EC.message()
+        << "\n";
+      return 1;
+    }
+
+    Out << Merged;
+  }
+
+  bool Answered = true;
+
+  if (not CanReach.empty()) {
+    Answered &= ListCallers(*Graph, CanReach, outs());
+  }
+
+  if (not ReachableFrom.empty()) {
+    Answered &= ListTargets(*Graph, ReachableFrom, outs());
+  }
+
+  return Answered ? 0 : 1;
+}
+
+/**
+ * Merge module call graphs into one, indexed graph.
+ *
+ * Functions are identified by name across modules, except for functions
+ * with local linkage, which are qualified by their module's name.
+ *
+ * @param   Merged    the storage for the merged graph
+ */
+static std::unique_ptr<CallGraphFile> Merge(
+  ArrayRef<std::unique_ptr<CallGraphFile>> Inputs, string &Merged)
+{
+  StringMap<SymbolID> IDs;
+  std::vector<StringRef> Names;
+  std::vector<uint8_t> Flags;
+  std::vector<std::vector<SymbolID>> Remap(Inputs.size());
+
+  for (size_t i = 0; i < Inputs.size(); i++) {
+    const CallGraphFile &G = *Inputs[i];
+    Remap[i].resize(G.NumSymbols());
+
+    for (SymbolID S = 0; S < G.NumSymbols(); S++) {
+      const uint8_t F = G.Flags(S);
+      string Qualified;
+      StringRef Name = G.Name(S);
+
+      if (F & CallGraphFile::Local) {
+        Qualified = (G.Module() + ":" + Name).str();
+        Name = Qualified;
+      }
+
+      auto Entry = IDs.insert({ Name, Names.size() });
+      if (Entry.second) {
+        Names.push_back(Entry.first->getKey());
+        Flags.push_back(0);
+      }
+
+      SymbolID ID = Entry.first->getValue();
+      Flags[ID] |= F;
+      Remap[i][S] = ID;
+    }
+  }
+
+  CallGraphFile::Builder Builder(Inputs.size() == 1
+                                 ? Inputs.front()->Module() : "");
+
+  for (size_t i = 0; i < Names.size(); i++) {
+    Builder.AddSymbol(Names[i], Flags[i]);
+  }
+
+  for (size_t i = 0; i < Inputs.size(); i++) {
+    const CallGraphFile &G = *Inputs[i];
+
+    for (SymbolID S = 0; S < G.NumSymbols(); S++) {
+      for (SymbolID Callee : G.Callees(S)) {
+        Builder.AddCall(Remap[i][S], Remap[i][Callee]);
+      }
+    }
+  }
+
+  std::vector<SymbolID> TargetIDs;
+
+  if (Targets.empty()) {
+    for (SymbolID S = 0; S < Names.size(); S++) {
+      if (not (Flags[S] & CallGraphFile::Defined)) {
+        TargetIDs.push_back(S);
+      }
+    }
+  } else {
+    for (const string &Name : Targets) {
+      auto i = IDs.find(Name);
+      if (i != IDs.end()) {
+        TargetIDs.push_back(i->getValue());
+      } else {
+        errs() << "Warning: target '" << Name << "' is never called\n";
+      }
+    }
+  }
+
+  Builder.SetTargets(TargetIDs);
+
+  raw_string_ostream Out(Merged);
+  Builder.Write(Out);
+  Out.flush();
+
+  string Err;
+  std::unique_ptr<CallGraphFile> Graph = CallGraphFile::Open(Merged, Err);
+  if (not Graph) {
+    errs() << "Error: merged an invalid graph: " << Err << "\n";
+  }
+
+  return Graph;
+}
+
+//! Print a set of names in order.
+static void PrintSorted(std::vector<StringRef> &Names, raw_ostream &Out)
+{
+  std::sort(Names.begin(), Names.end());
+  for (StringRef Name : Names) {
+    Out << Name << "\n";
+  }
+}
+
+static bool ListCallers(const CallGraphFile &Graph, StringRef Target,
+                        raw_ostream &Out)
+{
+  ArrayRef<SymbolID> Indexed = Graph.Targets();
+  auto i = std::find(Indexed.begin(), Indexed.end(), Graph.Find(Target));
+
+  if (i == Indexed.end()) {
+    errs() << "Error: '" << Target << "' is not an indexed target\n";
+    return false;
+  }
+
+  std::vector<StringRef> Callers;
+  for (SymbolID S = 0; S < Graph.NumSymbols(); S++) {
+    if (Graph.CanReach(S, i - Indexed.begin())) {
+      Callers.push_back(Graph.Name(S));
+    }
+  }
+
+  PrintSorted(Callers, Out);
+  return true;
+}
+
+static bool ListTargets(const CallGraphFile &Graph, StringRef Fn,
+                        raw_ostream &Out)
+{
+  SymbolID S = Graph.Find(Fn);
+  if (S == CallGraphFile::NoSymbol) {
+    errs() << "Error: '" << Fn << "' is not in the call graph\n";
+    return false;
+  }
+
+  ArrayRef<SymbolID> Indexed = Graph.Targets();
+  std::vector<StringRef> Reachable;
+
+  for (size_t i = 0; i < Indexed.size(); i++) {
+    if (Graph.CanReach(S, i)) {
+      Reachable.push_back(Graph.Name(Indexed[i]));
+    }
+  }
+
+  PrintSorted(Reachable, Out);
+  return true;
+}
@@ -0,0 +1,284 @@
+//! @file prov-flows.cc  Queries over binary data flow graphs.
+/*
+ * Copyright (c) 2017 Jonathan Anderson
+ * All rights reserved.
+ *
+ * This software was developed by BAE Systems, the University of Cambridge
+ * Computer Laboratory, and Memorial University under DARPA/AFRL contract
+ * FA8650-15-C-7558 ("CADETS"), as part of the DARPA Transparent Computing
+ * (TC) research program.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#include "FlowGraphFile.hh"
+
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <queue>
+#include <tuple>
+#include <vector>
+
+using namespace llvm;
+using namespace llvm::prov;
+using std::string;
+
+
+namespace {
+  enum class Query { Summary, Reach, Degree, Top };
+  enum class Direction { In, Out };
+
+  cl::list<string> InputFilenames(cl::Positional, cl::OneOrMore,
+    cl::desc("<graph files (e.g., from -graph-flows -flow-output=binary)>"));
+
+  cl::opt<Query> Mode("query", cl::desc("What to report"),
+    cl::init(Query::Summary),
+    cl::values(
+      clEnumValN(Query::Summary, "summary",
+                 "nodes, flows, sources and sinks in each graph"),
+      clEnumValN(Query::Reach, "reach",
+                 "the sinks reachable from each source"),
+      clEnumValN(Query::Degree, "degree",
+                 "the number of nodes with each degree"),
+      clEnumValN(Query::Top, "top", "the nodes with the highest degrees")
+    )
+  );
+
+  cl::opt<Direction> By("by", cl::desc("Degree to use for -query=degree|top"),
+    cl::init(Direction::Out),
+    cl::values(
+      clEnumValN(Direction::In, "in", "flows into each node"),
+      clEnumValN(Direction::Out, "out", "flows out of each node")
+    )
+  );
+
+  cl::opt<unsigned> TopN("n", cl::init(10),
+    cl::desc("Number of nodes to report with -query=top"));
+
+  //! A node with a high degree (for -query=top).
+  struct RankedNode {
+    size_t Degree;
+    string Function;
+    string Label;
+
+    bool operator < (const RankedNode &Other) const {
+      // Higher degrees rank first, then names in order.
+      return std::tie(Other.Degree, Function, Label)
+        < std::tie(Degree, Other.Function, Other.Label);
+    }
+  };
+
+  //! State that is kept across graphs.
+  struct QueryState {
+    //! Search marks: node N has been seen iff Seen[N] == Epoch.
+    std::vector<uint32_t> Seen;
+    uint32_t Epoch = 0;
+
+    std::vector<size_t> Degrees;
+    std::map<size_t, size_t> Histogram;
+
+    //! The best nodes seen so far, worst first.
+    std::priority_queue<RankedNode> Top;
+  };
+}
+
+static void Summarize(const FlowGraphFile&, raw_ostream&);
+static void Reach(const FlowGraphFile&, QueryState&, raw_ostream&);
+static void Degrees(const FlowGraphFile&, QueryState&);
+static void Rank(const FlowGraphFile&, QueryState&);
+
+
+int main(int argc, char *argv[])
+{
+  cl::ParseCommandLineOptions(argc, argv, "data flow graph queries\n");
+
+  QueryState State;
+  raw_ostream &Out = outs();
+  int Result = 0;
+
+  for (const string &Filename : InputFilenames) {
+    string Err;
+    auto Graphs = FlowGraphFile::LoadAll(Filename, Err);
+    if (not Err.empty()) {
+      errs() << "Error reading '" << Filename << "': " << Err << "\n";
+      Result = 1;
+      continue;
+    }
+
+    for (auto &Graph : Graphs) {
+      switch (Mode) {
+      case Query::Summary:
+        Summarize(*Graph, Out);
+        break;
+
+      case Query::Reach:
+        Reach(*Graph, State, Out);
+        break;
+
+      case Query::Degree:
+        Degrees(*Graph, State);
+        break;
+
+      case Query::Top:
+        Rank(*Graph, State);
+        break;
+      }
+    }
+  }
+
+  if (Mode == Query::Degree) {
+    for (auto &Count : State.Histogram) {
+      Out << Count.first << "\t" << Count.second << "\n";
+    }
+  }
+
+  if (Mode == Query::Top) {
+    std::vector<RankedNode> Nodes;
+    while (not State.Top.empty()) {
+      Nodes.push_back(State.Top.top());
+      State.Top.pop();
+    }
+
+    for (auto i = Nodes.rbegin(); i != Nodes.rend(); i++) {
+      Out << i->Degree << "\t" << i->Function << "\t" << i->Label << "\n";
+    }
+  }
+
+  return Result;
+}
+
+static void Summarize(const FlowGraphFile &Graph, raw_ostream &Out)
+{
+  Out
+    << Graph.Function()
+    << "\t" << Graph.NumNodes() << " nodes"
+    << "\t" << Graph.NumEdges() << " flows"
+    << "\t" << Graph.Sources().size() << " sources"
+    << "\t" << Graph.Sinks().size() << " sinks"
+    << "\n"
+    ;
+}
+
+static void Reach(const FlowGraphFile &Graph, QueryState &State,
+                  raw_ostream &Out)
+{
+  if (State.Seen.size() < Graph.NumNodes()) {
+    State.Seen.resize(Graph.NumNodes());
+  }
+
+  std::vector<FlowGraphFile::NodeID> Worklist;
+
+  for (FlowGraphFile::NodeID Source : Graph.Sources()) {
+    // Bump the epoch to clear all marks (and really clear them on overflow).
+    if (++State.Epoch == 0) {
+      std::fill(State.Seen.begin(), State.Seen.end(), 0);
+      State.Epoch = 1;
+    }
+
+    Worklist.assign(1, Source);
+    std::vector<FlowGraphFile::NodeID> Sinks;
+
+    while (not Worklist.empty()) {
+      FlowGraphFile::NodeID N = Worklist.back();
+      Worklist.pop_back();
+
+      for (FlowGraphFile::Edge E : Graph.Successors(N)) {
+        FlowGraphFile::NodeID Next = E.Node();
+        if (State.Seen[Next] == State.Epoch) {
+          continue;
+        }
+
+        State.Seen[Next] = State.Epoch;
+        Worklist.push_back(Next);
+
+        if (Graph.Flags(Next) & FlowGraphFile::SinkNode) {
+          Sinks.push_back(Next);
+        }
+      }
+    }
+
+    std::sort(Sinks.begin(), Sinks.end());
+
+    for (FlowGraphFile::NodeID Sink : Sinks) {
+      Out << Graph.Function() << "\t" << Graph.Label(Source) << "\t->\t"
+        << Graph.Label(Sink) << "\n";
+    }
+  }
+}
+
+//! Compute the degree of every node in a graph.
+static const std::vector<size_t>& ComputeDegrees(const FlowGraphFile &Graph,
+                                                 QueryState &State)
+{
+  std::vector<size_t> &Degrees = State.Degrees;
+  Degrees.assign(Graph.NumNodes(), 0);
+
+  for (FlowGraphFile::NodeID N = 0; N < Graph.NumNodes(); N++) {
+    ArrayRef<FlowGraphFile::Edge> Out = Graph.Successors(N);
+
+    if (By == Direction::Out) {
+      Degrees[N] = Out.size();
+      continue;
+    }
+
+    for (FlowGraphFile::Edge E : Out) {
+      Degrees[E.Node()]++;
+    }
+  }
+
+  return Degrees;
+}
+
+static void Degrees(const FlowGraphFile &Graph, QueryState &State)
+{
+  for (size_t D : ComputeDegrees(Graph, State)) {
+    State.Histogram[D]++;
+  }
+}
+
+static void Rank(const FlowGraphFile &Graph, QueryState &State)
+{
+  if (TopN == 0) {
+    return;
+  }
+
+  const std::vector<size_t> &Degrees = ComputeDegrees(Graph, State);
+
+  for (FlowGraphFile::NodeID N = 0; N < Graph.NumNodes(); N++) {
+    // Only copy labels for nodes that might make the cut.
+    if (State.Top.size() == TopN and Degrees[N] < State.Top.top().Degree) {
+      continue;
+    }
+
+    RankedNode Node = { Degrees[N], Graph.Function().str(),
+                        Graph.Label(N).str() };
+    State.Top.push(std::move(Node));
+    if (State.Top.size() > TopN) {
+      State.Top.pop();
+    }
+  }
+}
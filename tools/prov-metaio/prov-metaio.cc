@@ -0,0 +1,391 @@
+//! @file prov-metaio.cc  Report which binaries use metaio wrappers.
+/*
+ * Copyright (c) 2017 Jonathan Anderson
+ * All rights reserved.
+ *
+ * This software was developed by BAE Systems, the University of Cambridge
+ * Computer Laboratory, and Memorial University under DARPA/AFRL contract
+ * FA8650-15-C-7558 ("CADETS"), as part of the DARPA Transparent Computing
+ * (TC) research program.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#include "JSON.hh"
+#include "SemanticsTable.hh"
+
+#include <llvm/ADT/STLExtras.h>
+#include <llvm/Object/ELFObjectFile.h>
+#include <llvm/Object/ObjectFile.h>
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Format.h>
+#include <llvm/Support/ThreadPool.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <algorithm>
+#include <set>
+
+using namespace llvm;
+using namespace llvm::prov;
+using std::string;
+
+// The compiled form of semantics/posix.sem (generated by prov-semc).
+#include "PosixSemantics.inc"
+
+
+namespace {
+  enum class OutputKind { Text, JSON };
+
+  cl::list<string> InputFilenames(cl::Positional, cl::OneOrMore,
+    cl::desc("<binaries or directories>"));
+
+  cl::opt<string> OutputFilename("o", cl::init("-"),
+    cl::desc("Output filename"), cl::value_desc("filename"));
+
+  cl::opt<OutputKind> Format("format", cl::desc("Output format"),
+    cl::init(OutputKind::Text),
+    cl::values(
+      clEnumValN(OutputKind::Text, "text", "a report for people"),
+      clEnumValN(OutputKind::JSON, "json", "a report for programs")
+    )
+  );
+
+  cl::opt<string> SemanticsFile("semantics",
+    cl::desc("Compiled semantics table that describes I/O functions "
+             "(default: built-in POSIX semantics)"),
+    cl::value_desc("filename"));
+
+  cl::opt<unsigned> Threads("j", cl::init(0),
+    cl::desc("Number of threads to scan binaries with (default: all cores)"));
+
+  //! How much of a binary's I/O goes through metaio wrappers.
+  enum class Coverage { None, Partial, Full };
+
+  //! The I/O functions that a binary refers to.
+  struct Binary {
+    string Path;
+
+    //! I/O functions called directly ("legacy" I/O), sorted.
+    std::vector<string> Legacy;
+
+    //! I/O functions called through their metaio wrappers, sorted.
+    std::vector<string> MetaIO;
+
+    bool UsesIO() const { return not Legacy.empty() or not MetaIO.empty(); }
+
+    Coverage MetaIOCoverage() const {
+      if (MetaIO.empty()) {
+        return Coverage::None;
+      }
+
+      return Legacy.empty() ? Coverage::Full : Coverage::Partial;
+    }
+
+    /**
+     * Does this binary only do I/O in one way (e.g., only read or only
+     * write) without using metaio?
+     */
+    bool OneWay() const {
+      return MetaIO.empty() and Legacy.size() < 2;
+    }
+  };
+}
+
+static void FindBinaries(StringRef Path, std::vector<string> &Paths);
+static bool Scan(Binary&, const SemanticsTable&, string &Err);
+static void WriteText(ArrayRef<Binary>, raw_ostream&);
+static void WriteJSON(ArrayRef<Binary>, raw_ostream&);
+
+
+int main(int argc, char *argv[])
+{
+  cl::ParseCommandLineOptions(argc, argv, "metaio coverage scanner\n");
+
+  // The I/O functions (and their wrappers) come from the same semantics
+  // that instrumentation uses, so the two can't disagree.
+  string Err;
+  std::unique_ptr<SemanticsTable> Table;
+
+  if (SemanticsFile.empty()) {
+    StringRef Data(reinterpret_cast<const char*>(PosixSemanticsTable),
+                   sizeof(PosixSemanticsTable));
+    Table = SemanticsTable::Open(Data, Err);
+  } else {
+    Table = SemanticsTable::Load(SemanticsFile, Err);
+  }
+
+  if (not Table) {
+    errs() << "Error loading semantics: " << Err << "\n";
+    return 1;
+  }
+
+  std::vector<string> Paths;
+  for (const string &Input : InputFilenames) {
+    FindBinaries(Input, Paths);
+  }
+
+  std::sort(Paths.begin(), Paths.end());
+  Paths.erase(std::unique(Paths.begin(), Paths.end()), Paths.end());
+
+  // Scan every binary in parallel, each into its own slot.
+  std::vector<Binary> Binaries(Paths.size());
+  std::vector<string> Errors(Paths.size());
+
+  {
+    std::unique_ptr<ThreadPool> Pool(
+      Threads ? new ThreadPool(Threads) : new ThreadPool());
+
+    for (size_t i = 0; i < Paths.size(); i++) {
+      Pool->async([&, i]() {
+        Binaries[i].Path = Paths[i];
+        Scan(Binaries[i], *Table, Errors[i]);
+      });
+    }
+
+    Pool->wait();
+  }
+
+  for (size_t i = 0; i < Paths.size(); i++) {
+    if (not Errors[i].empty()) {
+      errs() << "Error reading '" << Paths[i] << "': " << Errors[i] << "\n";
+    }
+  }
+
+  Binaries.erase(std::remove_if(Binaries.begin(), Binaries.end(),
+                                [](const Binary &B) { return not B.UsesIO(); }),
+                 Binaries.end());
+
+  std::error_code EC;
+  raw_fd_ostream Out(OutputFilename, EC, sys::fs::F_Text);
+  if (EC) {
+    errs() << "Error opening '" << OutputFilename << "': " << EC.message()
+      << "\n";
+    return 1;
+  }
+
+  switch (Format) {
+  case OutputKind::Text:
+    WriteText(Binaries, Out);
+    break;
+
+  case OutputKind::JSON:
+    WriteJSON(Binaries, Out);
+    break;
+  }
+
+  return 0;
+}
+
+
+/**
+ * Find the regular files at or beneath a path. Like `find -type f`, symbolic
+ * links aren't followed, so each file is only found once.
+ */
+static void FindBinaries(StringRef Path, std::vector<string> &Paths)
+{
+  if (not sys::fs::is_directory(Path)) {
+    Paths.push_back((Path.startswith("./") ? Path.substr(2) : Path).str());
+    return;
+  }
+
+  std::error_code Err;
+  for (sys::fs::recursive_directory_iterator i(Path, Err), End;
+       i != End and not Err; i.increment(Err)) {
+    if (sys::fs::is_symlink_file(i->path())) {
+      i.no_push();
+      continue;
+    }
+
+    if (sys::fs::is_regular_file(i->path())) {
+      StringRef P = i->path();
+      Paths.push_back((P.startswith("./") ? P.substr(2) : P).str());
+    }
+  }
+}
+
+/**
+ * Find the I/O functions that a binary refers to (or defines), using only
+ * its symbol tables. Files that aren't ELF objects are quietly ignored.
+ */
+static bool Scan(Binary &B, const SemanticsTable &Table, string &Err)
+{
+  static const StringRef WrapperPrefix = "metaio_";
+
+  // The file is mapped (not read) and only its symbol tables are parsed.
+  auto Obj = object::ObjectFile::createObjectFile(B.Path);
+  if (not Obj) {
+    std::error_code EC = errorToErrorCode(Obj.takeError());
+    if (EC != object::object_error::invalid_file_type) {
+      Err = EC.message();
+    }
+
+    return false;
+  }
+
+  auto *ELF = dyn_cast<object::ELFObjectFileBase>(Obj->getBinary());
+  if (not ELF) {
+    return false;
+  }
+
+  std::set<string> Legacy, MetaIO;
+
+  auto Classify = [&](const object::SymbolRef &Sym) {
+    Expected<StringRef> FullName = Sym.getName();
+    if (not FullName) {
+      consumeError(FullName.takeError());
+      return;
+    }
+
+    // Ignore symbol versions (e.g., read@FBSD_1.0).
+    StringRef Name = FullName->split('@').first;
+    StringRef Base = Name;
+    bool Wrapped = Base.startswith(WrapperPrefix);
+
+    if (Wrapped) {
+      Base = Base.drop_front(WrapperPrefix.size());
+    }
+
+    CallSemantics::Roles R = Table.Lookup(Base);
+    if (not R.Source and not R.Sink) {
+      return;
+    }
+
+    if (not Wrapped) {
+      Legacy.insert(Base.str());
+    } else if (R.Wrapper == Name) {
+      MetaIO.insert(Base.str());
+    }
+  };
+
+  // Installed binaries are usually stripped, leaving only dynamic symbols.
+  for (const object::SymbolRef &Sym : ELF->symbols()) {
+    Classify(Sym);
+  }
+
+  for (const object::SymbolRef &Sym : ELF->getDynamicSymbolIterators()) {
+    Classify(Sym);
+  }
+
+  B.Legacy.assign(Legacy.begin(), Legacy.end());
+  B.MetaIO.assign(MetaIO.begin(), MetaIO.end());
+
+  return true;
+}
+
+static void WriteText(ArrayRef<Binary> Binaries, raw_ostream &Out)
+{
+  size_t None = 0, OneWay = 0, Partial = 0, Full = 0;
+
+  Out << "no metaio:\n";
+  for (const Binary &B : Binaries) {
+    if (B.MetaIOCoverage() == Coverage::None) {
+      Out << B.Path << "\n    " << join(B.Legacy, ", ") << "\n\n";
+      None++;
+      OneWay += B.OneWay();
+    }
+  }
+
+  Out << "partial metaio:\n";
+  for (const Binary &B : Binaries) {
+    if (B.MetaIOCoverage() == Coverage::Partial) {
+      Out
+        << format("%30s", B.Path.c_str()) << "  meta:   "
+        << join(B.MetaIO, ", ") << "\n"
+        ;
+      Out.indent(30) << "  legacy: " << join(B.Legacy, ", ") << "\n";
+      Partial++;
+    }
+  }
+  Out << "\n";
+
+  Out << "full metaio:\n";
+  for (const Binary &B : Binaries) {
+    if (B.MetaIOCoverage() == Coverage::Full) {
+      Out
+        << format("%30s", B.Path.c_str()) << "  " << join(B.MetaIO, ", ")
+        << "\n";
+      Full++;
+    }
+  }
+  Out << "\n";
+
+  Out
+    << None << " without metaio (" << OneWay << " one-way), "
+    << Partial << " partial, " << Full << " full\n"
+    ;
+}
+
+static void WriteList(raw_ostream &Out, ArrayRef<string> Names)
+{
+  Out << '[';
+
+  for (size_t i = 0; i < Names.size(); i++) {
+    if (i > 0) {
+      Out << ',';
+    }
+    WriteQuoted(Out, Names[i]);
+  }
+
+  Out << ']';
+}
+
+/**
+ * Write a report as a JSON object: one entry per binary that does I/O,
+ * followed by the same totals as the text report.
+ */
+static void WriteJSON(ArrayRef<Binary> Binaries, raw_ostream &Out)
+{
+  static const char *CoverageNames[] = { "none", "partial", "full" };
+  size_t Counts[3] = { 0, 0, 0 };
+  size_t OneWay = 0;
+
+  Out << "{\"binaries\":[";
+
+  for (size_t i = 0; i < Binaries.size(); i++) {
+    const Binary &B = Binaries[i];
+    const Coverage C = B.MetaIOCoverage();
+
+    Counts[static_cast<int>(C)]++;
+    OneWay += B.OneWay();
+
+    Out << (i > 0 ? ",\n" : "\n") << "{\"path\":";
+    WriteQuoted(Out, B.Path);
+    Out << ",\"metaio\":\"" << CoverageNames[static_cast<int>(C)] << "\"";
+    Out << ",\"one-way\":" << (B.OneWay() ? "true" : "false");
+    Out << ",\"legacy\":";
+    WriteList(Out, B.Legacy);
+    Out << ",\"wrapped\":";
+    WriteList(Out, B.MetaIO);
+    Out << "}";
+  }
+
+  Out
+    << "\n],\"totals\":{"
+    << "\"none\":" << Counts[static_cast<int>(Coverage::None)]
+    << ",\"one-way\":" << OneWay
+    << ",\"partial\":" << Counts[static_cast<int>(Coverage::Partial)]
+    << ",\"full\":" << Counts[static_cast<int>(Coverage::Full)]
+    << "}}\n"
+    ;
+}
@@ -0,0 +1,689 @@
+//! @file prov-opt-cache.cc  A result cache for instrumenting opt runs.
+/*
+ * Copyright (c) 2017 Jonathan Anderson
+ * All rights reserved.
+ *
+ * This software was developed by BAE Systems, the University of Cambridge
+ * Computer Laboratory, and Memorial University under DARPA/AFRL contract
+ * FA8650-15-C-7558 ("CADETS"), as part of the DARPA Transparent Computing
+ * (TC) research program.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#include <llvm/ADT/SmallString.h>
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/Config/llvm-config.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Format.h>
+#include <llvm/Support/MD5.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/Process.h>
+#include <llvm/Support/Program.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <vector>
+
+using namespace llvm;
+using std::string;
+
+
+static const char Usage[] =
+  "usage: prov-opt-cache <opt> [opt arguments]\n"
+  "       prov-opt-cache -s | -z | -C\n"
+  "\n"
+  "Runs opt through a cache of its results, keyed by a hash of opt's\n"
+  "arguments and of the contents of every file that they name (input\n"
+  "bitcode, -load'ed libraries, ...). Only the output named by -o <file>\n"
+  "or -o=<file> and diagnostics are cached: runs without -o, that read\n"
+  "standard input or that write other files (-prov-graph-dir, -flow-dir,\n"
+  "-pass-remarks-output, -prov-cache, -prov-save-bitcode, -graph-flows,\n"
+  "-callgraph) always run.\n"
+  "\n"
+  "  -s   show statistics\n"
+  "  -z   zero statistics\n"
+  "  -C   clear the cache\n"
+  "\n"
+  "environment:\n"
+  "  PROV_OPT_CACHE_DIR    cache directory (default: ~/.cache/prov-opt)\n"
+  "  PROV_OPT_CACHE_SIZE   maximum cache size in MiB (default: 4096,\n"
+  "                        0 for no limit)\n"
+  "  PROV_OPT_CACHE_DISABLE  run opt without the cache\n"
+  ;
+
+/**
+ * The version of the cache's key and entry formats: this must change
+ * whenever either changes.
+ */
+static const char CacheVersion[] = "prov-opt-cache 1";
+
+/**
+ * Entries are spread across this many subdirectories (by the first digit
+ * of their keys), each of which is kept below its share of the cache size.
+ * Eviction only has to scan the subdirectory that was just written to.
+ */
+static const unsigned Subdirectories = 16;
+
+/**
+ * Entries are written to temporary files (<key>.tmp-XXXXXXXX) and then
+ * renamed into place. A temporary file older than this was left behind by
+ * a run that died before renaming it, rather than being written right now
+ * by another run, so eviction can remove it.
+ */
+static const std::chrono::hours StaleTemporaryAge(1);
+
+//! Results that we record in the statistics file (one character per run).
+enum class Result : char {
+  Hit = 'h',
+  Miss = 'm',
+  Uncacheable = 'u',
+  Failed = 'f',
+};
+
+namespace {
+  //! The on-disk cache of opt results.
+  class Cache {
+  public:
+    Cache(string Dir, uint64_t MaxBytes) : Dir(Dir), MaxBytes(MaxBytes) {}
+
+    //! The path of the entry for a key.
+    string EntryPath(StringRef Key) const;
+
+    //! Atomically add an entry, then evict old entries if necessary.
+    bool Insert(StringRef Key, StringRef Diagnostics, StringRef Output);
+
+    //! Mark an entry as recently used.
+    void Touch(StringRef Path) const;
+
+    //! Append a result to the statistics file.
+    void Record(Result) const;
+
+    void PrintStatistics(raw_ostream&) const;
+    void ZeroStatistics() const;
+    bool Clear() const;
+
+  private:
+    struct Entry {
+      string Path;
+      uint64_t Size;
+      sys::TimePoint<> LastUsed;
+    };
+
+    std::vector<Entry> Entries(StringRef Subdir,
+                               std::vector<Entry> *Temporary = nullptr) const;
+    void Evict(StringRef Subdir) const;
+    string StatisticsPath() const;
+
+    const string Dir;
+    const uint64_t MaxBytes;
+  };
+}
+
+static int RunCached(Cache&, StringRef Program, ArrayRef<const char*> Args);
+static int Run(StringRef Program, ArrayRef<const char*> Args,
+               StringRef ErrorFile = "");
+static bool ComputeKey(StringRef Program, ArrayRef<const char*> Args,
+                       SmallString<32> &Key, StringRef &OutputFile);
+static bool WritesOtherFiles(StringRef Arg);
+static bool HashFile(StringRef Path, MD5&);
+static bool WriteFile(StringRef Path, StringRef Data);
+
+
+int main(int argc, char *argv[])
+{
+  if (argc < 2) {
+    errs() << Usage;
+    return 1;
+  }
+
+  SmallString<128> Dir;
+  if (const char *Env = getenv("PROV_OPT_CACHE_DIR")) {
+    Dir = Env;
+  } else {
+    sys::path::home_directory(Dir);
+    sys::path::append(Dir, ".cache", "prov-opt");
+  }
+
+  uint64_t MaxMiB = 4096;
+  if (const char *Env = getenv("PROV_OPT_CACHE_SIZE")) {
+    if (StringRef(Env).getAsInteger(10, MaxMiB)) {
+      errs() << "prov-opt-cache: invalid PROV_OPT_CACHE_SIZE '" << Env
+        << "'\n";
+      return 1;
+    }
+  }
+
+  Cache C(string(Dir.str()), MaxMiB << 20);
+  StringRef Command = argv[1];
+
+  if (Command == "-s") {
+    C.PrintStatistics(outs());
+    return 0;
+
+  } else if (Command == "-z") {
+    C.ZeroStatistics();
+    return 0;
+
+  } else if (Command == "-C") {
+    return C.Clear() ? 0 : 1;
+
+  } else if (Command.startswith("-")) {
+    errs() << Usage;
+    return 1;
+  }
+
+  auto Program = sys::findProgramByName(Command);
+  if (not Program) {
+    errs() << "prov-opt-cache: unable to find '" << Command << "': "
+      << Program.getError().message() << "\n";
+    return 1;
+  }
+
+  ArrayRef<const char*> Args(argv + 2, argc - 2);
+
+  if (getenv("PROV_OPT_CACHE_DISABLE")) {
+    return Run(*Program, Args);
+  }
+
+  return RunCached(C, *Program, Args);
+}
+
+
+static int RunCached(Cache &C, StringRef Program, ArrayRef<const char*> Args)
+{
+  SmallString<32> Key;
+  StringRef OutputFile;
+
+  if (not ComputeKey(Program, Args, Key, OutputFile)) {
+    C.Record(Result::Uncacheable);
+    return Run(Program, Args);
+  }
+
+  // Cache hit: replay the diagnostics and copy out the cached output.
+  // An entry is `<diagnostics length>\n<diagnostics><output>`.
+  string Entry = C.EntryPath(Key);
+  if (auto Buffer = MemoryBuffer::getFile(Entry, -1, false)) {
+    StringRef Data = (*Buffer)->getBuffer();
+    StringRef Length;
+    size_t DiagnosticsLength;
+
+    std::tie(Length, Data) = Data.split('\n');
+    if (not Length.getAsInteger(10, DiagnosticsLength)
+        and DiagnosticsLength <= Data.size()
+        and WriteFile(OutputFile, Data.substr(DiagnosticsLength))) {
+      errs() << Data.substr(0, DiagnosticsLength);
+      C.Touch(Entry);
+      C.Record(Result::Hit);
+      return 0;
+    }
+  }
+
+  // Cache miss: run opt, capturing its diagnostics.
+  SmallString<128> ErrorFile;
+  if (sys::fs::createTemporaryFile("prov-opt-cache", "err", ErrorFile)) {
+    C.Record(Result::Uncacheable);
+    return Run(Program, Args);
+  }
+
+  int Status = Run(Program, Args, ErrorFile);
+
+  auto Diagnostics = MemoryBuffer::getFile(ErrorFile, -1, false);
+  sys::fs::remove(ErrorFile);
+
+  if (Diagnostics) {
+    errs() << (*Diagnostics)->getBuffer();
+  }
+
+  if (Status != 0 or not Diagnostics) {
+    C.Record(Result::Failed);
+    return Status;
+  }
+
+  auto Output = MemoryBuffer::getFile(OutputFile, -1, false);
+  if (Output) {
+    C.Insert(Key, (*Diagnostics)->getBuffer(), (*Output)->getBuffer());
+  }
+
+  C.Record(Result::Miss);
+  return 0;
+}
+
+static int Run(StringRef Program, ArrayRef<const char*> Args,
+               StringRef ErrorFile)
+{
+  string Err;
+
+#if LLVM_VERSION_MAJOR >= 7
+  std::vector<StringRef> Argv = { Program };
+  Argv.insert(Argv.end(), Args.begin(), Args.end());
+
+  Optional<StringRef> Redirects[] = { None, None, None };
+  if (not ErrorFile.empty()) {
+    Redirects[2] = ErrorFile;
+  }
+
+  int Status = sys::ExecuteAndWait(Program, Argv, None, Redirects, 0, 0,
+                                   &Err);
+#else
+  string ProgramName = Program;
+  std::vector<const char*> Argv = { ProgramName.c_str() };
+  Argv.insert(Argv.end(), Args.begin(), Args.end());
+  Argv.push_back(nullptr);
+
+  const StringRef *Redirects[] = { nullptr, nullptr, nullptr };
+  if (not ErrorFile.empty()) {
+    Redirects[2] = &ErrorFile;
+  }
+
+  int Status = sys::ExecuteAndWait(Program, Argv.data(), nullptr, Redirects,
+                                   0, 0, &Err);
+#endif
+
+  if (Status < 0) {
+    errs() << "prov-opt-cache: error running '" << Program << "': "
+      << Err << "\n";
+    return 1;
+  }
+
+  return Status;
+}
+
+/**
+ * Compute a run's cache key: a hash of opt's identity (its path, size and
+ * modification time, like ccache's default compiler check), of its
+ * arguments and of the contents of any files that they name.
+ *
+ * The output filename isn't part of the key, so the same bitcode
+ * instrumented into different objects (e.g., in different build
+ * directories) shares an entry.
+ *
+ * @returns   false if the run can't be cached
+ */
+static bool ComputeKey(StringRef Program, ArrayRef<const char*> Args,
+                       SmallString<32> &Key, StringRef &OutputFile)
+{
+  MD5 Hash;
+  Hash.update(CacheVersion);
+
+  sys::fs::file_status Status;
+  if (sys::fs::status(Program, Status)) {
+    return false;
+  }
+
+  Hash.update(Program);
+  Hash.update(utostr(Status.getSize()));
+  Hash.update(utostr(
+    Status.getLastModificationTime().time_since_epoch().count()));
+
+  for (size_t i = 0; i < Args.size(); i++) {
+    StringRef Arg = Args[i];
+
+    if (Arg == "-o" and i + 1 < Args.size()) {
+      OutputFile = Args[++i];
+      continue;
+    }
+
+    if (Arg.startswith("-o=")) {
+      OutputFile = Arg.substr(3);
+      continue;
+    }
+
+    // We only replay -o and diagnostics: anything else that the run would
+    // have written would be missing after a cache hit.
+    if (Arg == "-" or WritesOtherFiles(Arg)) {
+      return false;
+    }
+
+    // Separate arguments so that, e.g., "-a b" and "-ab" differ.
+    Hash.update(StringRef("\0", 1));
+    Hash.update(Arg);
+
+    // Arguments may name files in either "-load X" or "-load=X" form.
+    StringRef Value = Arg.startswith("-") ? Arg.split('=').second : Arg;
+    if (not Value.empty() and sys::fs::is_regular_file(Value)
+        and not HashFile(Value, Hash)) {
+      return false;
+    }
+  }
+
+  if (OutputFile.empty() or OutputFile == "-") {
+    return false;
+  }
+
+  MD5::MD5Result Result;
+  Hash.final(Result);
+  MD5::stringifyResult(Result, Key);
+
+  return true;
+}
+
+/**
+ * Does an argument make opt write files other than its -o output
+ * (e.g., -pass-remarks-output=remarks.yaml or -passes=graph-flows)?
+ */
+static bool WritesOtherFiles(StringRef Arg)
+{
+  static const char* const Options[] = {
+    "prov-graph-dir",
+    "flow-dir",
+    "pass-remarks-output",
+    "prov-cache",
+    "prov-cache-report",
+    "prov-save-bitcode",
+  };
+
+  static const char* const Passes[] = {
+    "graph-flows",
+    "callgraph",
+  };
+
+  if (not Arg.startswith("-")) {
+    return false;
+  }
+
+  StringRef Name, Value;
+  std::tie(Name, Value) = Arg.ltrim('-').split('=');
+
+  for (StringRef Option : Options) {
+    if (Name == Option) {
+      return true;
+    }
+  }
+
+  // Passes may be named as legacy pass flags (-graph-flows) or in a
+  // new pass manager pipeline (-passes=prov,graph-flows).
+  SmallVector<StringRef, 8> Pipeline;
+  if (Name == "passes") {
+    Value.split(Pipeline, ',');
+  } else {
+    Pipeline.push_back(Name);
+  }
+
+  for (StringRef Pass : Pipeline) {
+    // Strip pass manager nesting, e.g., module(graph-flows).
+    Pass = Pass.substr(Pass.rfind('(') + 1).rtrim(')');
+
+    for (StringRef P : Passes) {
+      if (Pass == P) {
+        return true;
+      }
+    }
+  }
+
+  return false;
+}
+
+static bool HashFile(StringRef Path, MD5 &Hash)
+{
+  auto Buffer = MemoryBuffer::getFile(Path, -1, false);
+  if (not Buffer) {
+    return false;
+  }
+
+  Hash.update((*Buffer)->getBuffer());
+  return true;
+}
+
+static bool WriteFile(StringRef Path, StringRef Data)
+{
+  std::error_code Err;
+  raw_fd_ostream Out(Path, Err, sys::fs::F_None);
+  if (Err) {
+    return false;
+  }
+
+  Out << Data;
+  Out.close();
+
+  return not Out.has_error();
+}
+
+
+string Cache::EntryPath(StringRef Key) const
+{
+  SmallString<128> Path(Dir);
+  sys::path::append(Path, Key.substr(0, 1), Key);
+  return string(Path.str());
+}
+
+bool Cache::Insert(StringRef Key, StringRef Diagnostics, StringRef Output)
+{
+  string Path = EntryPath(Key);
+  StringRef Subdir = sys::path::parent_path(Path);
+
+  if (sys::fs::create_directories(Subdir)) {
+    return false;
+  }
+
+  // Write the entry to a temporary file in the same directory and then
+  // rename it into place: concurrent readers (and writers of the same entry)
+  // see either no entry or a complete one.
+  int FD;
+  SmallString<128> TempPath;
+  if (sys::fs::createUniqueFile(Path + ".tmp-%%%%%%%%", FD, TempPath)) {
+    return false;
+  }
+
+  {
+    raw_fd_ostream Out(FD, true);
+    Out << Diagnostics.size() << "\n" << Diagnostics << Output;
+  }
+
+  if (sys::fs::rename(TempPath, Path)) {
+    sys::fs::remove(TempPath);
+    return false;
+  }
+
+  Evict(Subdir);
+  return true;
+}
+
+void Cache::Touch(StringRef Path) const
+{
+  int FD;
+  if (sys::fs::openFileForRead(Path, FD)) {
+    return;
+  }
+
+  sys::fs::setLastModificationAndAccessTime(FD,
+    std::chrono::system_clock::now());
+  sys::Process::SafelyCloseFileDescriptor(FD);
+}
+
+/**
+ * Find the entries in a subdirectory.
+ *
+ * Temporary files that entries are being written to aren't entries:
+ * they're skipped, or returned in @b Temporary if it isn't null.
+ */
+std::vector<Cache::Entry> Cache::Entries(StringRef Subdir,
+                                         std::vector<Entry> *Temporary) const
+{
+  std::vector<Entry> Found;
+  std::error_code Err;
+
+  for (sys::fs::directory_iterator i(Subdir, Err), End;
+       i != End and not Err; i.increment(Err)) {
+    sys::fs::file_status Status;
+    if (sys::fs::status(i->path(), Status)) {
+      continue;
+    }
+
+    Entry E = { i->path(), Status.getSize(),
+                Status.getLastModificationTime() };
+
+    if (StringRef(E.Path).contains(".tmp-")) {
+      if (Temporary) {
+        Temporary->push_back(std::move(E));
+      }
+      continue;
+    }
+
+    Found.push_back(std::move(E));
+  }
+
+  return Found;
+}
+
+/**
+ * Evict the least-recently-used entries from a subdirectory that has grown
+ * beyond its share of the cache size, leaving some room to grow, along with
+ * any stale temporary files.
+ */
+void Cache::Evict(StringRef Subdir) const
+{
+  std::vector<Entry> Temporary;
+  std::vector<Entry> Found = Entries(Subdir, &Temporary);
+
+  const auto Stale = std::chrono::system_clock::now() - StaleTemporaryAge;
+  for (const Entry &E : Temporary) {
+    if (E.LastUsed < Stale) {
+      sys::fs::remove(E.Path);
+    }
+  }
+
+  if (MaxBytes == 0) {
+    return;
+  }
+
+  const uint64_t Limit = MaxBytes / Subdirectories;
+
+  uint64_t Total = 0;
+  for (const Entry &E : Found) {
+    Total += E.Size;
+  }
+
+  if (Total <= Limit) {
+    return;
+  }
+
+  std::sort(Found.begin(), Found.end(), [](const Entry &A, const Entry &B) {
+    return A.LastUsed < B.LastUsed;
+  });
+
+  for (const Entry &E : Found) {
+    if (Total <= Limit * 9 / 10) {
+      break;
+    }
+
+    if (not sys::fs::remove(E.Path)) {
+      Total -= E.Size;
+    }
+  }
+}
+
+string Cache::StatisticsPath() const
+{
+  SmallString<128> Path(Dir);
+  sys::path::append(Path, "stats");
+  return string(Path.str());
+}
+
+void Cache::Record(Result R) const
+{
+  if (sys::fs::create_directories(Dir)) {
+    return;
+  }
+
+  // Each result is appended with a single write, so concurrent runs
+  // (e.g., from make -j) don't need to lock the file.
+  std::error_code Err;
+  raw_fd_ostream Out(StatisticsPath(), Err, sys::fs::F_Append);
+  if (not Err) {
+    Out << static_cast<char>(R);
+  }
+}
+
+void Cache::PrintStatistics(raw_ostream &Out) const
+{
+  size_t Hits = 0, Misses = 0, Uncacheable = 0, Failed = 0;
+
+  if (auto Buffer = MemoryBuffer::getFile(StatisticsPath(), -1, false)) {
+    for (char c : (*Buffer)->getBuffer()) {
+      switch (static_cast<Result>(c)) {
+      case Result::Hit:         Hits++;         break;
+      case Result::Miss:        Misses++;       break;
+      case Result::Uncacheable: Uncacheable++;  break;
+      case Result::Failed:      Failed++;       break;
+      }
+    }
+  }
+
+  size_t Count = 0;
+  uint64_t Size = 0;
+
+  for (unsigned i = 0; i < Subdirectories; i++) {
+    SmallString<128> Subdir(Dir);
+    sys::path::append(Subdir, utohexstr(i, true));
+
+    for (const Entry &E : Entries(Subdir)) {
+      Count++;
+      Size += E.Size;
+    }
+  }
+
+  const size_t Lookups = Hits + Misses;
+
+  Out
+    << "cache directory:  " << Dir << "\n"
+    << "cache hits:       " << Hits << "\n"
+    << "cache misses:     " << Misses << "\n"
+    << "hit rate:         "
+    << format("%.1f%%", Lookups ? 100.0 * Hits / Lookups : 0.0) << "\n"
+    << "uncacheable runs: " << Uncacheable << "\n"
+    << "failed runs:      " << Failed << "\n"
+    << "entries:          " << Count << "\n"
+    << "cache size:       " << format("%.1f", Size / 1048576.0) << " MiB"
+    ;
+
+  if (MaxBytes) {
+    Out << " of " << (MaxBytes >> 20) << " MiB";
+  }
+
+  Out << "\n";
+}
+
+void Cache::ZeroStatistics() const
+{
+  sys::fs::remove(StatisticsPath());
+}
+
+bool Cache::Clear() const
+{
+  for (unsigned i = 0; i < Subdirectories; i++) {
+    SmallString<128> Subdir(Dir);
+    sys::path::append(Subdir, utohexstr(i, true));
+
+    if (std::error_code Err = sys::fs::remove_directories(Subdir)) {
+      errs() << "prov-opt-cache: error removing '" << Subdir << "': "
+        << Err.message() << "\n";
+      return false;
+    }
+  }
+
+  return true;
+}
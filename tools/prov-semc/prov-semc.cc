@@ -0,0 +1,162 @@
+//! @file prov-semc.cc  Compiler for call semantics specifications.
+/*
+ * Copyright (c) 2017 Jonathan Anderson
+ * All rights reserved.
+ *
+ * This software was developed by BAE Systems, the University of Cambridge
+ * Computer Laboratory, and Memorial University under DARPA/AFRL contract
+ * FA8650-15-C-7558 ("CADETS"), as part of the DARPA Transparent Computing
+ * (TC) research program.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#include "SemanticsTable.hh"
+
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Format.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/raw_ostream.h>
+
+using namespace llvm;
+using namespace llvm::prov;
+using std::string;
+
+
+namespace {
+  enum class OutputKind { Table, CSource };
+
+  cl::opt<string> InputFilename(cl::Positional, cl::desc("<specification>"),
+    cl::init("-"));
+
+  cl::opt<string> OutputFilename("o", cl::desc("Output filename"),
+    cl::value_desc("filename"), cl::init("-"));
+
+  cl::opt<OutputKind> Emit("emit", cl::desc("What to emit"),
+    cl::init(OutputKind::Table),
+    cl::values(
+      clEnumValN(OutputKind::Table, "table", "a table for -prov-semantics"),
+      clEnumValN(OutputKind::CSource, "c", "a table as a C array")
+    )
+  );
+
+  cl::opt<string> ArrayName("array-name", cl::init("SemanticsTable"),
+    cl::desc("Name of the array to emit with -emit=c"),
+    cl::value_desc("identifier"));
+
+  cl::opt<bool> DarwinSymbols("darwin-symbols", cl::init(false),
+    cl::desc("Also describe each function by its Darwin symbol name"));
+}
+
+static void EmitC(StringRef Table, raw_ostream&);
+
+
+int main(int argc, char *argv[])
+{
+  cl::ParseCommandLineOptions(argc, argv, "call semantics compiler\n");
+
+  auto Input = MemoryBuffer::getFileOrSTDIN(InputFilename);
+  if (std::error_code Err = Input.getError()) {
+    errs() << "Error reading '" << InputFilename << "': " << Err.message()
+      << "\n";
+    return 1;
+  }
+
+  string Name, Err;
+  std::vector<SemanticsTable::Entry> Entries;
+
+  if (not SemanticsTable::Parse((*Input)->getBuffer(), InputFilename, Name,
+                                Entries, Err)) {
+    errs() << "Error: " << Err << "\n";
+    return 1;
+  }
+
+  if (DarwinSymbols) {
+    for (size_t i = 0, Len = Entries.size(); i < Len; i++) {
+      SemanticsTable::Entry Alias = Entries[i];
+      Alias.Name = "\01_" + Alias.Name;
+      Entries.push_back(std::move(Alias));
+    }
+  }
+
+  string Table;
+  raw_string_ostream TableOut(Table);
+  SemanticsTable::Compile(Name, Entries, TableOut);
+  TableOut.flush();
+
+  // Check that every function can be found in the compiled table.
+  std::unique_ptr<SemanticsTable> Check = SemanticsTable::Open(Table, Err);
+  if (not Check) {
+    errs() << "Error: compiled an invalid table: " << Err << "\n";
+    return 1;
+  }
+
+  for (const SemanticsTable::Entry &E : Entries) {
+    CallSemantics::Roles R = Check->Lookup(E.Name);
+    if (R.Source != E.Source or R.Sink != E.Sink or R.Wrapper != E.Wrapper) {
+      errs() << "Error: '" << E.Name << "' not found in compiled table\n";
+      return 1;
+    }
+  }
+
+  std::error_code EC;
+  raw_fd_ostream Out(OutputFilename, EC, sys::fs::F_None);
+  if (EC) {
+    errs() << "Error opening '" << OutputFilename << "': " << EC.message()
+      << "\n";
+    return 1;
+  }
+
+  switch (Emit) {
+  case OutputKind::Table:
+    Out << Table;
+    break;
+
+  case OutputKind::CSource:
+    EmitC(Table, Out);
+    break;
+  }
+
+  return 0;
+}
+
+static void EmitC(StringRef Table, raw_ostream &Out)
+{
+  Out
+    << "// Generated by prov-semc from "
+    << sys::path::filename(InputFilename) << ": do not edit.\n"
+    << "alignas(4) static const unsigned char " << ArrayName << "[] = {"
+    ;
+
+  for (size_t i = 0; i < Table.size(); i++) {
+    if (i % 12 == 0) {
+      Out << "\n ";
+    }
+
+    Out << " " << format_hex(static_cast<uint8_t>(Table[i]), 4) << ",";
+  }
+
+  Out << "\n};\n";
+}
@@ -0,0 +1,151 @@
+//! @file prov-summaries.cc  Link-time combiner for flow summaries.
+/*
+ * Copyright (c) 2017 Jonathan Anderson
+ * All rights reserved.
+ *
+ * This software was developed by BAE Systems, the University of Cambridge
+ * Computer Laboratory, and Memorial University under DARPA/AFRL contract
+ * FA8650-15-C-7558 ("CADETS"), as part of the DARPA Transparent Computing
+ * (TC) research program.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#include "SummaryIndex.hh"
+
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IRReader/IRReader.h>
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/SourceMgr.h>
+#include <llvm/Support/ThreadPool.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <mutex>
+
+using namespace llvm;
+using namespace llvm::prov;
+using std::string;
+
+
+namespace {
+  cl::list<string> InputFilenames(cl::Positional, cl::OneOrMore,
+    cl::desc("<bitcode files>"));
+
+  cl::opt<string> OutputFilename("o", cl::init("-"),
+    cl::desc("Write the combined index (for -flow-summary-index)"),
+    cl::value_desc("filename"));
+
+  cl::opt<string> ReportFilename("report",
+    cl::desc("Write the calls that pass source data to another module's "
+             "sinks"),
+    cl::value_desc("filename"));
+
+  cl::opt<unsigned> Threads("j", cl::init(0),
+    cl::desc("Number of threads to read modules with (default: all cores)"));
+}
+
+static bool Write(StringRef Filename, function_ref<void (raw_ostream&)>);
+
+
+int main(int argc, char *argv[])
+{
+  cl::ParseCommandLineOptions(argc, argv, "flow summary combiner\n");
+
+  SummaryIndex Index;
+  std::mutex IndexLock;
+  bool Failed = false;
+
+  {
+    std::unique_ptr<ThreadPool> Pool(
+      Threads ? new ThreadPool(Threads) : new ThreadPool());
+
+    for (const string &Filename : InputFilenames) {
+      Pool->async([&, Filename]() {
+        // Each module gets its own context, which is freed as soon as its
+        // summaries have been read: memory use depends on the size of the
+        // summaries, not the size of the program.
+        LLVMContext Ctx;
+        SMDiagnostic Diag;
+        string Err;
+
+        // Bitcode is loaded lazily: function bodies are never read.
+        std::unique_ptr<Module> M = getLazyIRFileModule(Filename, Diag, Ctx);
+        if (M) {
+          if (Error E = M->materializeMetadata()) {
+            Err = toString(std::move(E));
+          }
+        } else {
+          Err = Diag.getMessage();
+        }
+
+        std::lock_guard<std::mutex> Lock(IndexLock);
+
+        if (Err.empty() and Index.Add(*M) < 0) {
+          Err = "invalid flow summaries";
+        }
+
+        if (not Err.empty()) {
+          errs() << "Error reading '" << Filename << "': " << Err << "\n";
+          Failed = true;
+        }
+      });
+    }
+
+    Pool->wait();
+  }
+
+  if (Failed) {
+    return 1;
+  }
+
+  Index.Combine();
+
+  bool OK = Write(OutputFilename, [&Index](raw_ostream &Out) {
+    Index.print(Out);
+  });
+
+  if (not ReportFilename.empty()) {
+    OK &= Write(ReportFilename, [&Index](raw_ostream &Out) {
+      for (const SummaryIndex::CrossModuleSink &S : Index.CrossModuleSinks()) {
+        Out << S.Caller << " -> " << S.Callee << " arg " << S.Arg << "\n";
+      }
+    });
+  }
+
+  return OK ? 0 : 1;
+}
+
+static bool Write(StringRef Filename, function_ref<void (raw_ostream&)> F)
+{
+  std::error_code EC;
+  raw_fd_ostream Out(Filename, EC, sys::fs::F_Text);
+  if (EC) {
+    errs() << "Error opening '" << Filename << "': " << EC.message() << "\n";
+    return false;
+  }
+
+  F(Out);
+  return true;
+}